@@ -0,0 +1,1283 @@
+#include "AsyncChannel.h"
+#include "Checksum.h"
+#include "Fec.h"
+#include "Frame.h"
+#include "ImageFormat.h"
+#include "LocalStatusCode.h"
+#include "Lz4.h"
+#include "PayloadSizer.h"
+#include "Protocol.h"
+#include "Trace.h"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+namespace smp {
+
+// biggest frame is limited by 16 bit packet size of handshake
+constexpr size_t receiveBufferSize = 2 * 0x10000;
+
+static std::array<uint8_t, 16> handshakeBuffer{
+    0xAE, 0x71, 0x17, 0x07, 0xAE, 0x71, 0x17, 0x07,
+    0xAE, 0x71, 0x17, 0x07, 0xAE, 0x71, 0x17, 0x07};
+
+Task<void> AsyncChannel::sendHandshake()
+{
+    co_await send({handshakeBuffer.data(), handshakeBuffer.size()});
+}
+
+Task<LocalStatusCode> AsyncChannel::handshake()
+{
+    trace::Span span{"handshake", port->traceTrack()};
+    co_await sendHandshake();
+    co_return co_await handshakeAnswer();
+}
+
+Task<LocalStatusCode> AsyncChannel::handshakeAnswer()
+{
+    // echo of the handshake, then device parameters
+    constexpr size_t answerSize =
+        handshakeBuffer.size() + wireSize<HandshakeInfo>;
+
+    // stale bytes of previous session are skipped up to the answer
+    const auto handshakeWord = decode<uint32_t>(handshakeBuffer.data());
+    auto deadline = std::chrono::steady_clock::now() + handshakeTimeout;
+    auto found = co_await receiver.seek(handshakeWord, deadline);
+    if (!found) {
+        co_return LocalStatusCode::Timeout;
+    }
+    auto filled = co_await receiver.fill(answerSize, deadline);
+    if (!filled) {
+        co_return LocalStatusCode::Timeout;
+    }
+
+    auto answer = receiver.data();
+    if (!std::equal(handshakeBuffer.cbegin(), handshakeBuffer.cend(),
+                    answer.begin())) {
+        receiver.consume(1);
+        co_return LocalStatusCode::HandshakeAnswerHeaderNotEqual;
+    }
+    auto info = decode<HandshakeInfo>(answer.data() + handshakeBuffer.size());
+    receiver.consume(answerSize);
+    startWord = info.startWord;
+    maxPacketSize = info.packetSize;
+    id = info.id;
+    co_return LocalStatusCode::Ok;
+}
+
+AsyncChannel::AsyncChannel(EventLoop &loop, std::string_view portName,
+                           uint32_t baudRate)
+    : AsyncChannel{loop, openTransport(portName, baudRate), baudRate}
+{}
+
+AsyncChannel::AsyncChannel(EventLoop &loop,
+                           std::unique_ptr<Transport> transport,
+                           uint32_t baudRate)
+    : loop{loop}, port{std::move(transport)},
+      receiver{*port, loop, receiveBufferSize},
+      startWord{}, maxPacketSize{}, id{},
+      features{}, windowSize{1}, requestedWindowSize{8}, requestedFec{},
+      ackTimeout{1000}, handshakeTimeout{2000}, baudConfirmTimeout{500},
+      busyTimeout{10000},
+      maxRetransmits{5},
+      rttEstimate{ackTimeout, minRetransmitTimeout, maxRetransmitTimeout},
+      resendable{}, requestSentAt{}, lineIdleAt{}, baudRate{baudRate},
+      packScratch{},
+      fecScratch{}
+{}
+
+Task<LocalStatusCode> AsyncChannel::negotiate()
+{
+    trace::Span span{"negotiate", port->traceTrack()};
+    // negotiation itself is always djb2
+    auto packet = makeFrame(
+        HashKind::djb2, headerFor(action::capabilities),
+        CapabilitiesMsg{.features = capability::windowedLoad |
+                                    capability::crc32cHash |
+                                    capability::deltaLoad |
+                                    capability::compressedLoad |
+                                    capability::baudSwitch |
+                                    capability::offsetLoad |
+                                    capability::resumableLoad |
+                                    capability::busyHint |
+                                    capability::sparseLoad |
+                                    (requestedFec ? capability::fecLoad : 0u),
+                        .windowSize = requestedWindowSize,
+                        .reserved = 0});
+    co_await send({packet.data(), packet.size()});
+    auto sentAt = lineIdleAt;
+
+    features = 0;
+    windowSize = 1;
+
+    WireBuffer<CapabilitiesAnswer> buffer{};
+    auto result = co_await readFrame(buffer.data(), buffer.size(),
+                                     action::capabilities);
+    // old firmware answers NoSuchCommand or keeps silence -> stop-and-wait
+    if (result.localCode == LocalStatusCode::Timeout &&
+        result.answerSize == 0) {
+        co_return LocalStatusCode::Ok;
+    }
+    auto answer = decode<CapabilitiesAnswer>(buffer.data());
+    if (result.localCode == LocalStatusCode::Ok &&
+        result.answerSize == buffer.size() && answer.code == StatusCode::Ok) {
+        // first round trip, requests of loading are resent after it
+        rttEstimate.sample(std::chrono::steady_clock::now() - sentAt -
+                           lineTime(result.answerSize));
+        features = answer.msg.features;
+        if (features & capability::windowedLoad) {
+            windowSize = std::clamp<uint16_t>(answer.msg.windowSize, 1,
+                                              requestedWindowSize);
+        }
+    }
+    co_return result.localCode;
+}
+
+void AsyncChannel::setWindowSize(uint16_t size) noexcept
+{
+    requestedWindowSize = size ? size : 1;
+}
+
+void AsyncChannel::setFec(bool enabled) noexcept { requestedFec = enabled; }
+
+Task<LocalStatusCode>
+AsyncChannel::negotiateBaud(std::span<const uint32_t> rates)
+{
+    if (!(features & capability::baudSwitch)) {
+        co_return LocalStatusCode::Ok;
+    }
+    for (auto rate : rates) {
+        if (rate <= baudRate) {
+            continue;
+        }
+        auto result = co_await switchBaud(rate);
+        if (result == LocalStatusCode::Ok) {
+            break;
+        }
+        if (result == LocalStatusCode::WrongId ||
+            result == LocalStatusCode::WrongStartWord) {
+            co_return result; // not a rate problem
+        }
+    }
+    co_return LocalStatusCode::Ok;
+}
+
+Task<LocalStatusCode> AsyncChannel::switchBaud(uint32_t rate)
+{
+    trace::Span span{"switch baud", port->traceTrack(), "rate", rate};
+    if (!(features & capability::baudSwitch)) {
+        co_return LocalStatusCode::BaudRejected;
+    }
+    if (rate == baudRate) {
+        co_return LocalStatusCode::Ok;
+    }
+    auto packet = makeFrame(
+        hashKind(), headerFor(action::setBaud),
+        BaudMsg{.baudRate = rate,
+                .confirmTimeoutMs =
+                    static_cast<uint16_t>(baudConfirmTimeout.count()),
+                .reserved = 0});
+    co_await send({packet.data(), packet.size()});
+
+    WireBuffer<Answer> answer{};
+    auto read = co_await readFrame(answer.data(), answer.size(),
+                                   action::setBaud);
+    const bool answered = read.localCode == LocalStatusCode::Ok &&
+                          read.answerSize == answer.size();
+    if (answered && decode<Answer>(answer.data()).code != StatusCode::Ok) {
+        co_return LocalStatusCode::BaudRejected;
+    }
+
+    auto result = read.localCode;
+    if (answered) {
+        try {
+            port->setBaudRate(rate);
+            // device takes the rate on the first test it gets, so a lost
+            // echo alone would part the sides, tests are repeated at the
+            // new rate before falling back
+            for (uint8_t attempt = 0; attempt <= maxRetransmits; ++attempt) {
+                result = co_await linkTest(rate);
+                if (result == LocalStatusCode::Ok) {
+                    baudRate = rate;
+                    co_return result;
+                }
+                trace::instant("link test again", port->traceTrack(),
+                               "attempt", attempt);
+            }
+            port->setBaudRate(baudRate);
+        } catch (const std::exception &) {
+            port->setBaudRate(baudRate); // host uart can't do the rate
+            result = LocalStatusCode::BaudRejected;
+        }
+        if (result != LocalStatusCode::BaudRejected) {
+            result = LocalStatusCode::LinkTestFailed;
+        }
+    }
+    // device may have switched even if its answer was lost, it returns to
+    // the previous rate by itself without link test
+    co_await loop.sleepUntil(std::chrono::steady_clock::now() +
+                             baudConfirmTimeout);
+    co_return result;
+}
+
+Task<LocalStatusCode> AsyncChannel::linkTest(uint32_t rate)
+{
+    trace::Span span{"link test", port->traceTrack()};
+    // every byte value, then alternating patterns hard for clock recovery,
+    // in as many frames as echoes of them need
+    constexpr std::array<uint8_t, 4> patterns{0x55, 0xAA, 0x00, 0xFF};
+    std::vector<uint8_t> sequence(256 + 4 * patterns.size());
+    for (size_t i = 0; i < sequence.size(); ++i) {
+        sequence[i] = i < 256 ? static_cast<uint8_t>(i)
+                              : patterns[i % patterns.size()];
+    }
+    const size_t perFrame = maxPacketSize - wireSize<Answer>;
+    std::vector<uint8_t> answer(wireSize<Answer> + perFrame);
+
+    for (size_t offset = 0; offset < sequence.size(); offset += perFrame) {
+        std::span<const uint8_t> payload{
+            sequence.data() + offset,
+            std::min(perFrame, sequence.size() - offset)};
+        FrameBuffer<> packet{};
+        writeFrame(packet, hashKind(), headerFor(action::linkTest), payload);
+        co_await send(
+            {packet.data(), packet.size()},
+            {payload.data(), static_cast<uint32_t>(payload.size())});
+
+        // lost echo is awaited for a retransmit timeout, not ackTimeout,
+        // test and echo bytes at the new rate come on top of it (8N1)
+        const auto lineBytes = packet.size() + wireSize<Answer> +
+                               payload.size();
+        const std::chrono::microseconds lineTime{lineBytes * 10'000'000 /
+                                                 rate};
+        const auto answerSize =
+            static_cast<uint16_t>(wireSize<Answer> + payload.size());
+        auto read = co_await readFrame(
+            answer.data(), answerSize, action::linkTest,
+            std::chrono::steady_clock::now() + rttEstimate.timeout() +
+                lineTime);
+        if (read.localCode != LocalStatusCode::Ok) {
+            co_return read.localCode;
+        }
+        if (read.answerSize != answerSize ||
+            decode<Answer>(answer.data()).code != StatusCode::Ok ||
+            !std::equal(payload.begin(), payload.end(),
+                        answer.begin() + wireSize<Answer>)) {
+            co_return LocalStatusCode::LinkTestFailed;
+        }
+    }
+    co_return LocalStatusCode::Ok;
+}
+
+Task<void> AsyncChannel::peripheral(LedMsg msg)
+{
+    auto packet = makeFrame(hashKind(), headerFor(action::peripheral),
+                            peripheral_devices::LED, msg);
+    co_await send({packet.data(), packet.size()});
+}
+
+Task<ReadResult> AsyncChannel::readFrame(uint8_t *outBuffer,
+                                         uint16_t bufferSize,
+                                         uint16_t requestFlags)
+{
+    using clock = std::chrono::steady_clock;
+    if (resendable.empty()) {
+        co_return co_await readFrame(outBuffer, bufferSize, requestFlags,
+                                     clock::now() + ackTimeout);
+    }
+    for (uint8_t retransmits = 0;; ++retransmits) {
+        auto result = co_await readFrame(outBuffer, bufferSize, requestFlags,
+                                         std::max(clock::now(), requestSentAt) +
+                                             rttEstimate.timeout());
+        // silence or only broken bytes, request or answer was lost
+        const bool lost =
+            result.localCode == LocalStatusCode::Timeout ||
+            result.localCode == LocalStatusCode::WrongHash ||
+            (result.localCode == LocalStatusCode::Ok &&
+             result.answerSize >= wireSize<Answer> &&
+             decode<Answer>(outBuffer).code == StatusCode::HashBroken);
+        if (lost && retransmits < maxRetransmits) {
+            rttEstimate.backOff();
+            trace::instant("resend", port->traceTrack(), "action",
+                           requestFlags);
+            auto request = std::move(resendable);
+            co_await sendRequest(
+                {request.data(), static_cast<uint32_t>(request.size())});
+            continue;
+        }
+        resendable.clear();
+        if (!lost && retransmits == 0) {
+            rttEstimate.sample(clock::now() - requestSentAt -
+                               lineTime(result.answerSize));
+        } else if (!lost) {
+            co_await dropStale();
+        }
+        co_return result;
+    }
+}
+
+Task<ReadResult> AsyncChannel::readFrame(uint8_t *outBuffer,
+                                         uint16_t bufferSize,
+                                         uint16_t requestFlags,
+                                         Transport::Deadline deadline)
+{
+    ReadResult result{.localCode = LocalStatusCode::Timeout, .answerSize = 0};
+    trace::Span span{"rx", port->traceTrack(), "action", requestFlags};
+
+    requestFlags |= 0x8000;
+
+    if (outBuffer == nullptr || bufferSize < wireSize<header>) {
+        throw std::logic_error("Nullptr, 0 or too small sized outBuffer");
+    }
+
+    // noise or broken frame -> skip a byte and look for next start word
+    for (;;) {
+        auto found = co_await receiver.seek(startWord, deadline);
+        if (!found) {
+            break;
+        }
+        auto filled = co_await receiver.fill(wireSize<header>, deadline);
+        if (!filled) {
+            result.answerSize = static_cast<uint16_t>(receiver.data().size());
+            break;
+        }
+        auto frameHeader = decode<header>(receiver.data().data());
+        // device never sends more than its packet size, broken length
+        // would otherwise wait for bytes that don't come
+        const size_t maxLength = maxPacketSize ? maxPacketSize
+                                               : receiver.capacity();
+        if (frameHeader.packetLength < wireSize<header> ||
+            frameHeader.packetLength > maxLength) {
+            receiver.consume(1);
+            continue;
+        }
+        filled = co_await receiver.fill(frameHeader.packetLength, deadline);
+        if (!filled) {
+            result.answerSize = static_cast<uint16_t>(receiver.data().size());
+            break;
+        }
+
+        auto frame = receiver.data().first(frameHeader.packetLength);
+        trace::Span verify{"verify", port->traceTrack()};
+        auto hash = checksum(hashKind(), frame.data(), sizeBeforeHashField);
+        hash = checksum(hashKind(), frame.data() + wireSize<header>,
+                        static_cast<uint32_t>(frame.size()) -
+                            wireSize<header>,
+                        hash);
+        if (frameHeader.hash != hash) {
+            result = {.localCode = LocalStatusCode::WrongHash,
+                      .answerSize = static_cast<uint16_t>(frame.size())};
+            receiver.consume(1);
+            continue;
+        }
+
+        auto statusCode = headerCheck(&frameHeader, requestFlags, bufferSize);
+        if (statusCode == LocalStatusCode::Ok) {
+            std::copy(frame.begin(), frame.end(), outBuffer);
+        }
+        // busy or failing device shows up between the spans
+        if (trace::enabled() && frame.size() >= wireSize<Answer>) {
+            auto code = decode<Answer>(frame.data()).code;
+            if (code != StatusCode::Ok) {
+                trace::instant("device status", port->traceTrack(), "code",
+                               code);
+            }
+        }
+        receiver.consume(frame.size());
+        co_return {.localCode = statusCode,
+                   .answerSize = static_cast<uint16_t>(frame.size())};
+    }
+    co_return result;
+}
+
+// whole frame is out before the next one, other sessions run meanwhile
+Task<void> AsyncChannel::send(ConstBuffer frame, ConstBuffer payload)
+{
+    resendable.clear(); // answer to come is for this frame
+    trace::Span span{"tx", port->traceTrack(), "bytes",
+                     frame.size + payload.size};
+    lineIdleAt = std::max(lineIdleAt, std::chrono::steady_clock::now()) +
+                 lineTime(frame.size + payload.size);
+    std::array<ConstBuffer, 2> buffers{frame, payload};
+    std::span<ConstBuffer> pending{buffers};
+    while (!pending.empty()) {
+        if (port->writeSome(pending) != 0 || pending.empty()) {
+            continue;
+        }
+        co_await port->writable(loop, EventLoop::Deadline::max());
+    }
+}
+
+Task<void> AsyncChannel::sendRequest(ConstBuffer frame)
+{
+    co_await send(frame);
+    requestSentAt = lineIdleAt;
+    auto *bytes = static_cast<const uint8_t *>(frame.data);
+    resendable.assign(bytes, bytes + frame.size);
+}
+
+Task<void> AsyncChannel::dropStale()
+{
+    WireBuffer<Answer> stale{}; // whole frame is consumed whatever its size
+    for (;;) {
+        auto read = co_await readFrame(
+            stale.data(), stale.size(), 0,
+            std::chrono::steady_clock::now() + rttEstimate.timeout());
+        if (read.localCode == LocalStatusCode::Timeout) {
+            co_return;
+        }
+    }
+}
+
+bool AsyncChannel::goodbye() noexcept
+{
+    auto packet = makeFrame(hashKind(), headerFor(action::goodbye));
+    try {
+        port->writeAll({{packet.data(), packet.size()}});
+    } catch (const std::exception &) {
+        return false;
+    }
+    return true;
+}
+
+AsyncChannel::~AsyncChannel()
+{
+    goodbye(); // check return value and log?
+}
+
+std::string AsyncChannel::values() const
+{
+    return std::to_string(startWord) + ' ' + std::to_string(maxPacketSize) +
+           ' ' + std::to_string(id) + ' ' + std::to_string(windowSize) +
+           ' ' + std::to_string(baudRate);
+}
+
+uint16_t AsyncChannel::window() const noexcept { return windowSize; }
+
+uint32_t AsyncChannel::baud() const noexcept { return baudRate; }
+
+std::chrono::steady_clock::duration
+AsyncChannel::lineTime(size_t bytes) const noexcept
+{
+    if (baudRate == 0) {
+        return {};
+    }
+    return std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::nanoseconds{bytes * 10'000'000'000ull / baudRate});
+}
+
+std::chrono::nanoseconds AsyncChannel::retransmitTimeout() const noexcept
+{
+    return rttEstimate.timeout();
+}
+
+HashKind AsyncChannel::hashKind() const noexcept
+{
+    return features & capability::crc32cHash ? HashKind::crc32c
+                                             : HashKind::djb2;
+}
+
+LocalStatusCode AsyncChannel::headerCheck(const smp::header *headerView,
+                                     uint16_t requestedFlags,
+                                     uint16_t buffSize) const
+{
+    LocalStatusCode result;
+    if (headerView->startWord == startWord) {
+        if (headerView->connectionId == id) {
+            if (headerView->flags == requestedFlags) {
+                if (headerView->packetLength < wireSize<header>) {
+                    result = LocalStatusCode::WrongLength;
+                } else if (buffSize >= headerView->packetLength) {
+                    result = LocalStatusCode::Ok;
+                } else {
+                    result = LocalStatusCode::BufferToSmall;
+                }
+            } else {
+                result = LocalStatusCode::WrongFlags;
+            }
+        } else {
+            result = LocalStatusCode::WrongId;
+        }
+    } else {
+        result = LocalStatusCode::WrongStartWord;
+    }
+    return result;
+}
+
+Task<LocalStatusCode> AsyncChannel::uploadFrame(BinMsg &msg)
+{
+    skipUnchanged(msg);
+    auto leftToWrite = msg.image.size() - msg.written;
+    if (leftToWrite > 0) {
+        auto msgSize = std::min<size_t>(leftToWrite, nextPayloadSize(msg));
+        co_await sendLoadFrame(msg, msg.nextPacketId, msg.written,
+                               static_cast<uint32_t>(msgSize));
+        msg.written += msgSize;
+        msg.nextPacketId += 1;
+        co_return LocalStatusCode::Ok;
+    } else {
+        co_return LocalStatusCode::NothingToWrite;
+    }
+}
+
+uint32_t AsyncChannel::chunkSize() const noexcept
+{
+    return maxPacketSize - frameSize<LoadMsg>;
+}
+
+void AsyncChannel::skipUnchanged(BinMsg &msg) const noexcept
+{
+    // delta blocks are chunkSize() long whatever the frame size
+    for (auto block = msg.written / chunkSize();
+         block < msg.unchangedPackets.size() && msg.unchangedPackets[block];
+         ++block) {
+        msg.written = static_cast<uint32_t>(
+            std::min<size_t>((block + 1) * chunkSize(), msg.image.size()));
+        if (!msg.offsetFrames) {
+            msg.nextPacketId += 1; // packet id is block number
+        }
+    }
+}
+
+uint32_t AsyncChannel::nextPayloadSize(const BinMsg &msg) const noexcept
+{
+    if (!msg.offsetFrames) {
+        return chunkSize();
+    }
+    if (const auto *fill = fillAt(msg, msg.written)) {
+        return fill->first + fill->second - msg.written; // rest of the run
+    }
+    // frame ends where next unchanged block or fill run starts
+    auto end = msg.written + msg.payloadSize;
+    auto nextFill = std::upper_bound(
+        msg.fills.cbegin(), msg.fills.cend(), msg.written,
+        [](uint32_t offset, auto &&fill) { return offset < fill.first; });
+    if (nextFill != msg.fills.cend()) {
+        end = std::min(end, nextFill->first);
+    }
+    for (auto block = msg.written / chunkSize() + 1;
+         block < msg.unchangedPackets.size() && block * chunkSize() < end;
+         ++block) {
+        if (msg.unchangedPackets[block]) {
+            end = block * chunkSize();
+            break;
+        }
+    }
+    return end - msg.written;
+}
+
+const std::pair<uint32_t, uint32_t> *
+AsyncChannel::fillAt(const BinMsg &msg, uint32_t offset) noexcept
+{
+    auto next = std::upper_bound(
+        msg.fills.cbegin(), msg.fills.cend(), offset,
+        [](uint32_t at, auto &&fill) { return at < fill.first; });
+    if (next == msg.fills.cbegin()) {
+        return nullptr;
+    }
+    auto fill = std::prev(next);
+    return offset < fill->first + fill->second ? &*fill : nullptr;
+}
+
+void AsyncChannel::planFills(BinMsg &msg) const
+{
+    msg.fills.clear();
+    if (!msg.offsetFrames || !(features & capability::sparseLoad) ||
+        !msg.unchangedPackets.empty()) {
+        return;
+    }
+    trace::Span span{"plan fills", port->traceTrack()};
+    const auto erased = static_cast<char>(erasedByte);
+    const auto begin = msg.image.begin();
+    for (auto run = std::find(begin, msg.image.end(), erased);
+         run != msg.image.end();) {
+        auto end = std::find_if(run, msg.image.end(),
+                                [&](char byte) { return byte != erased; });
+        auto size = static_cast<uint32_t>(end - run);
+        if (size >= minFillRun) {
+            msg.fills.emplace_back(static_cast<uint32_t>(run - begin), size);
+        }
+        run = std::find(end, msg.image.end(), erased);
+    }
+}
+
+uint32_t AsyncChannel::maxPayloadSize(const BinMsg &msg) const noexcept
+{
+    const uint32_t wire = maxPacketSize - frameSize<LoadExMsg>;
+    return msg.fecPayload ? fec::capacity(wire) : wire;
+}
+
+uint32_t AsyncChannel::packPayloads(BinMsg &msg) const
+{
+    trace::Span span{"pack payloads", port->traceTrack()};
+    msg.packed.clear();
+    msg.packedOffsets.clear();
+    const bool compress = features & capability::compressedLoad;
+    if (msg.offsetFrames) {
+        return offsetWireSize(msg, compress);
+    }
+    const uint32_t blocks =
+        static_cast<uint32_t>((msg.image.size() + chunkSize() - 1) /
+                              chunkSize());
+    std::vector<uint32_t> offsets(blocks + 1, 0);
+    std::vector<uint8_t> scratch(chunkSize());
+    uint32_t wireSize = 0;
+
+    for (uint32_t packetId = 0; packetId < blocks; ++packetId) {
+        offsets[packetId] = static_cast<uint32_t>(msg.packed.size());
+        if (packetId < msg.unchangedPackets.size() &&
+            msg.unchangedPackets[packetId]) {
+            continue;
+        }
+        auto offset = static_cast<size_t>(packetId) * chunkSize();
+        auto size = std::min<size_t>(chunkSize(), msg.image.size() - offset);
+        // only packets that get smaller are sent compressed
+        size_t packedSize = 0;
+        if (compress) {
+            packedSize = lz4Compress(
+                {reinterpret_cast<const uint8_t *>(msg.image.data()) + offset,
+                 size},
+                {scratch.data(), size - 1});
+        }
+        if (packedSize) {
+            msg.packed.insert(msg.packed.end(), scratch.begin(),
+                              scratch.begin() +
+                                  static_cast<std::ptrdiff_t>(packedSize));
+        }
+        wireSize += static_cast<uint32_t>(packedSize ? packedSize : size);
+    }
+    offsets[blocks] = static_cast<uint32_t>(msg.packed.size());
+    if (!msg.packed.empty()) {
+        msg.packedOffsets = std::move(offsets);
+    }
+    return wireSize;
+}
+
+// offset frames are compressed as they are sent, their payloads are counted
+// as frames of the starting payload size carry them
+uint32_t AsyncChannel::offsetWireSize(BinMsg &msg, bool compress) const
+{
+    const auto written = msg.written;
+    std::vector<uint8_t> scratch(msg.payloadSize);
+    uint32_t wireSize = 0;
+    for (msg.written = 0;;) {
+        skipUnchanged(msg);
+        if (msg.written >= msg.image.size()) {
+            break;
+        }
+        auto size = static_cast<uint32_t>(std::min<size_t>(
+            msg.image.size() - msg.written, nextPayloadSize(msg)));
+        size_t packedSize = 0;
+        if (fillAt(msg, msg.written)) {
+            packedSize = 1;
+        } else if (compress && size > 1) {
+            packedSize = lz4Compress(
+                {reinterpret_cast<const uint8_t *>(msg.image.data()) +
+                     msg.written,
+                 size},
+                {scratch.data(), size - 1});
+        }
+        wireSize += static_cast<uint32_t>(packedSize ? packedSize : size);
+        msg.written += size;
+    }
+    msg.written = written;
+    return wireSize;
+}
+
+Task<DeltaPlan> AsyncChannel::planDelta(BinMsg &msg)
+{
+    trace::Span span{"plan delta", port->traceTrack()};
+    const auto blocks =
+        static_cast<uint32_t>((msg.image.size() + chunkSize() - 1) /
+                              chunkSize());
+    DeltaPlan plan{.localCode = LocalStatusCode::Ok,
+                   .upToDate = false,
+                   .changedBlocks = blocks,
+                   .blocks = blocks};
+    msg.unchangedPackets.clear();
+    if (!(features & capability::deltaLoad) || blocks == 0) {
+        co_return plan;
+    }
+
+    const auto kind = hashKind();
+    const auto imageHash = msg.imageHash(kind);
+    const auto perAnswer = static_cast<uint16_t>(std::max<size_t>(
+        (maxPacketSize - wireSize<FlashHashesAnswer>) / sizeof(uint32_t), 1));
+    std::vector<uint8_t> answer(wireSize<FlashHashesAnswer> +
+                                perAnswer * sizeof(uint32_t));
+    std::vector<bool> unchanged(blocks, false);
+    uint32_t unchangedCount = 0;
+    std::span<const uint32_t> imageBlocks;
+
+    for (uint32_t firstBlock = 0; firstBlock < blocks;) {
+        const FlashHashesMsg request{
+            .firstBlock = firstBlock,
+            .blockCount = static_cast<uint16_t>(
+                std::min<uint32_t>(perAnswer, blocks - firstBlock)),
+            .blockSize = static_cast<uint16_t>(chunkSize())};
+        auto packet =
+            makeFrame(kind, headerFor(action::flashHashes), request);
+        co_await sendRequest({packet.data(), packet.size()});
+
+        auto read = co_await readFrame(answer.data(),
+                                       static_cast<uint16_t>(answer.size()),
+                                       action::flashHashes);
+        if (read.localCode != LocalStatusCode::Ok) {
+            plan.localCode = read.localCode;
+            co_return plan;
+        }
+        if (read.answerSize < wireSize<Answer> ||
+            decode<Answer>(answer.data()).code != StatusCode::Ok) {
+            co_return plan; // device can't compare, send everything
+        }
+        auto hashes = decode<FlashHashesAnswer>(answer.data());
+        if (read.answerSize < wireSize<FlashHashesAnswer> ||
+            read.answerSize != wireSize<FlashHashesAnswer> +
+                                   hashes.info.blockCount * sizeof(uint32_t) ||
+            hashes.info.firstBlock != firstBlock ||
+            hashes.info.blockCount > request.blockCount) {
+            plan.localCode = LocalStatusCode::LoadAnswerNotEqual;
+            co_return plan;
+        }
+        if (firstBlock == 0 && hashes.info.imageSize == msg.image.size() &&
+            hashes.info.imageHash == imageHash) {
+            plan.upToDate = true;
+            plan.changedBlocks = 0;
+            co_return plan;
+        }
+
+        // from the manifest or hashed once, its buffer outlives new entries
+        if (imageBlocks.empty()) {
+            imageBlocks = msg.blockHashes(kind, chunkSize());
+        }
+        for (uint16_t i = 0; i < hashes.info.blockCount; ++i, ++firstBlock) {
+            auto deviceHash = decode<uint32_t>(
+                answer.data() + wireSize<FlashHashesAnswer> +
+                i * sizeof(uint32_t));
+            if (imageBlocks[firstBlock] == deviceHash) {
+                unchanged[firstBlock] = true;
+                unchangedCount += 1;
+            }
+        }
+        if (hashes.info.blockCount < request.blockCount) {
+            break; // rest is past the end of device flash
+        }
+    }
+
+    // nothing in common -> plain load, no endLoad round trip
+    if (unchangedCount != 0) {
+        msg.unchangedPackets = std::move(unchanged);
+        plan.changedBlocks = blocks - unchangedCount;
+    }
+    co_return plan;
+}
+
+Task<uint32_t> AsyncChannel::sendLoadFrame(const BinMsg &msg,
+                                           uint32_t packetId, uint32_t offset,
+                                           uint32_t size)
+{
+    trace::Span span{"frame", port->traceTrack(), "packet", packetId};
+    if (msg.offsetFrames) {
+        co_return co_await sendLoadExFrame(msg, packetId, offset, size);
+    }
+    auto payload =
+        reinterpret_cast<const uint8_t *>(msg.image.data()) + offset;
+    uint16_t flags = action::loading;
+    if (packetId + 1 < msg.packedOffsets.size() &&
+        msg.packedOffsets[packetId] != msg.packedOffsets[packetId + 1]) {
+        payload = msg.packed.data() + msg.packedOffsets[packetId];
+        size = msg.packedOffsets[packetId + 1] - msg.packedOffsets[packetId];
+        flags |= compressedPayloadFlag;
+    }
+
+    FrameBuffer<LoadMsg> packet;
+    {
+        trace::Span hashing{"hash", port->traceTrack(), "bytes", size};
+        writeFrame(packet, hashKind(), headerFor(flags), {payload, size},
+                   LoadMsg{.packetId = packetId, .msgHash = msg.hash});
+    }
+
+    co_await send({packet.data(), packet.size()}, {payload, size});
+    co_return size + packet.size();
+}
+
+Task<uint32_t> AsyncChannel::sendLoadExFrame(const BinMsg &msg,
+                                             uint32_t packetId,
+                                             uint32_t offset, uint32_t size)
+{
+    auto payload =
+        reinterpret_cast<const uint8_t *>(msg.image.data()) + offset;
+    auto payloadSize = size;
+    uint16_t flags = action::loading;
+    if (fillAt(msg, offset)) {
+        payloadSize = 1; // frames never cross the end of a run
+        flags |= fillPayloadFlag;
+    } else if ((features & capability::compressedLoad) && size > 1) {
+        trace::Span compress{"compress", port->traceTrack(), "bytes", size};
+        packScratch.resize(size - 1); // only if it gets smaller
+        auto packedSize = lz4Compress({payload, size}, packScratch);
+        if (packedSize) {
+            payload = packScratch.data();
+            payloadSize = static_cast<uint32_t>(packedSize);
+            flags |= compressedPayloadFlag;
+        }
+    }
+    if (msg.fecPayload) {
+        trace::Span parity{"fec", port->traceTrack(), "bytes", payloadSize};
+        fecScratch.clear();
+        fec::encode({payload, payloadSize}, fecScratch);
+        payload = fecScratch.data();
+        payloadSize = static_cast<uint32_t>(fecScratch.size());
+    }
+
+    FrameBuffer<LoadExMsg> packet;
+    {
+        trace::Span hashing{"hash", port->traceTrack(), "bytes", payloadSize};
+        writeFrame(packet, hashKind(), headerFor(flags),
+                   {payload, payloadSize},
+                   LoadExMsg{.packetId = packetId,
+                             .msgHash = msg.hash,
+                             .offset = offset,
+                             .size = size});
+    }
+
+    co_await send({packet.data(), packet.size()}, {payload, payloadSize});
+    co_return payloadSize + packet.size();
+}
+
+Task<UploadResult> AsyncChannel::upload(BinMsg &msg, UploadStats *stats,
+                                        UploadProgress progress)
+{
+    trace::Span span{"upload", port->traceTrack()};
+    using clock = std::chrono::steady_clock;
+    struct InFlightFrame {
+        uint32_t packetId;
+        uint32_t offset;
+        uint32_t size;
+        uint32_t wireBytes;
+        clock::time_point sentAt;
+        clock::time_point leftAt; // its last byte left the port, estimated
+        uint8_t retransmits;
+        uint32_t copies;  // sent, busy resends included
+        uint32_t answers; // to any copy, broken ones of legacy too
+    };
+
+    // legacy answer has no packetId, stop-and-wait keeps it unambiguous
+    const bool windowed = features & capability::windowedLoad;
+    const size_t window = windowed ? windowSize : 1;
+    const uint16_t answerSize =
+        windowed ? wireSize<LoadAnswer> : wireSize<Answer>;
+    // busy answers may be longer, they carry retry delay
+    const uint16_t busyAnswerSize =
+        windowed && (features & capability::busyHint)
+            ? wireSize<BusyLoadAnswer>
+            : answerSize;
+    std::vector<InFlightFrame> inFlight;
+    inFlight.reserve(window);
+    WireBuffer<BusyLoadAnswer> buffer{};
+    BusyLoadAnswer answer{}; // packetId and retryAfterMs 0 if not carried
+
+    // offset frames only, window hides round trip, else it is paid per frame
+    PayloadSizer sizer{minAdaptivePayload, maxPayloadSize(msg),
+                       frameSize<LoadExMsg> + answerSize};
+    const double bytesPerSecond = baudRate / 10.0; // 8N1
+    double roundTrip = 0; // smoothed, byte times beyond frame and answer
+    const auto answerTime = lineTime(answerSize);
+    // answer is late once the device took longer than it usually does,
+    // after the frame and those queued before it are through the line
+    auto deadline = [&](const InFlightFrame &frame) {
+        return frame.leftAt + answerTime + rttEstimate.timeout();
+    };
+    uint32_t reportedAcked = msg.acked;
+    std::deque<std::pair<uint32_t, uint32_t>> leftovers; // offset, size
+    // latest leftAt of an answered frame, a frame sent before it that
+    // times out was lost on a line that works
+    auto answeredUpTo = clock::time_point::min();
+
+    // busy device takes no frames, they go out again after a pause. Busy
+    // answers to frames sent before the pause began need no new one.
+    auto pauseStart = clock::time_point::min();
+    auto pauseEnd = clock::time_point::min();
+    auto busySince = clock::time_point::max(); // of current spell
+    auto busyPause = initialBusyPause;
+    auto waitBusy = [&](InFlightFrame &frame,
+                        uint16_t retryAfterMs) -> Task<bool> {
+        auto now = clock::now();
+        busySince = std::min(busySince, now);
+        if (now - busySince > busyTimeout) {
+            co_return false;
+        }
+        if (frame.sentAt >= pauseStart) {
+            std::chrono::milliseconds pause{retryAfterMs};
+            if (!retryAfterMs) {
+                pause = busyPause;
+                busyPause = std::min(busyPause * 2, ackTimeout);
+            }
+            trace::instant("busy pause", port->traceTrack(), "ms",
+                           static_cast<uint32_t>(pause.count()));
+            pauseStart = now;
+            pauseEnd = now + pause;
+        }
+        if (now < pauseEnd) {
+            co_await loop.sleepUntil(pauseEnd);
+        }
+        frame.sentAt = clock::now();
+        frame.copies += 1;
+        frame.wireBytes = co_await sendLoadFrame(msg, frame.packetId,
+                                                 frame.offset, frame.size);
+        frame.leftAt = lineIdleAt;
+        co_return true;
+    };
+
+    // frame is resent as lost to noise only if broken, a timeout alone may
+    // be a slow device and tells nothing about bit errors
+    auto retransmit = [&](InFlightFrame &frame, bool broken) -> Task<bool> {
+        frame.retransmits += 1;
+        frame.copies += 1;
+        frame.sentAt = clock::now();
+        trace::instant("retransmit", port->traceTrack(), "packet",
+                       frame.packetId);
+        if (stats) {
+            stats->retransmits += 1;
+        }
+        if (broken) {
+            sizer.failed(frame.wireBytes);
+        }
+        if (msg.offsetFrames && !fillAt(msg, frame.offset)) {
+            // resent smaller, the rest goes out as fresh frames
+            auto size = std::min(frame.size,
+                                 sizer.payload(windowed ? 0 : roundTrip));
+            if (size < frame.size) {
+                leftovers.push_back(
+                    {frame.offset + size, frame.size - size});
+                frame.size = size;
+                frame.retransmits = 1; // shrunk frame gets its own tries
+            }
+        }
+        frame.wireBytes = co_await sendLoadFrame(msg, frame.packetId,
+                                                 frame.offset, frame.size);
+        frame.leftAt = lineIdleAt;
+        co_return frame.retransmits <= maxRetransmits;
+    };
+
+    for (;;) {
+        while (inFlight.size() < window) {
+            if (msg.offsetFrames) {
+                msg.payloadSize = sizer.payload(windowed ? 0 : roundTrip);
+            }
+            InFlightFrame frame{.packetId = msg.nextPacketId,
+                                .offset = msg.written,
+                                .size = 0,
+                                .wireBytes = 0,
+                                .sentAt = clock::now(),
+                                .leftAt = {},
+                                .retransmits = 0,
+                                .copies = 1,
+                                .answers = 0};
+            if (!leftovers.empty()) {
+                auto &[offset, size] = leftovers.front();
+                frame.offset = offset;
+                frame.size = std::min(size, msg.payloadSize);
+                offset += frame.size;
+                size -= frame.size;
+                if (size == 0) {
+                    leftovers.pop_front();
+                }
+            } else {
+                skipUnchanged(msg);
+                if (msg.written >= msg.image.size()) {
+                    break;
+                }
+                frame.offset = msg.written;
+                frame.size = static_cast<uint32_t>(std::min<size_t>(
+                    msg.image.size() - msg.written, nextPayloadSize(msg)));
+                msg.written += frame.size;
+            }
+            frame.packetId = msg.nextPacketId; // skipped blocks take ids
+            frame.wireBytes = co_await sendLoadFrame(msg, frame.packetId,
+                                                     frame.offset, frame.size);
+            frame.leftAt = lineIdleAt;
+            msg.nextPacketId += 1;
+            inFlight.push_back(frame);
+            if (stats) {
+                stats->frames += 1;
+                stats->payloadSizes[frame.size] += 1;
+            }
+        }
+        if (inFlight.empty()) {
+            break;
+        }
+
+        // frames are kept in send order, the first one expires first
+        auto read = co_await readFrame(buffer.data(), busyAnswerSize,
+                                       action::loading,
+                                       deadline(inFlight.front()));
+        if (read.localCode == LocalStatusCode::Timeout) {
+            // only the expired frame goes again, backed off timeout gives
+            // the ones behind it more time before they count as lost
+            rttEstimate.backOff();
+            const bool lost = answeredUpTo > inFlight.front().leftAt;
+            auto retrying = co_await retransmit(inFlight.front(), lost);
+            if (!retrying) {
+                co_return {LocalStatusCode::Timeout, StatusCode::Invalid};
+            }
+            std::rotate(inFlight.begin(), inFlight.begin() + 1,
+                        inFlight.end());
+            continue;
+        }
+        if (read.localCode != LocalStatusCode::Ok) {
+            // broken ack or answer to a frame whose action got broken,
+            // frame is resent on its timeout
+            if (read.localCode == LocalStatusCode::WrongHash ||
+                read.localCode == LocalStatusCode::WrongFlags) {
+                if (!windowed) {
+                    inFlight.front().answers += 1;
+                }
+                sizer.failed(answerSize);
+                continue;
+            }
+            co_return {read.localCode, StatusCode::Invalid};
+        }
+        const bool hinted = busyAnswerSize != answerSize &&
+                            read.answerSize == busyAnswerSize;
+        if (read.answerSize != answerSize && !hinted) {
+            if (windowed) {
+                continue; // plain answer to a frame cut short by noise
+            }
+            co_return {LocalStatusCode::LoadAnswerNotEqual,
+                       StatusCode::Invalid};
+        }
+        answer = decode<BusyLoadAnswer>(buffer.data());
+        if (!hinted) {
+            answer.retryAfterMs = 0; // left from an earlier busy answer
+        }
+
+        auto frame = inFlight.begin();
+        if (windowed) {
+            frame = std::find_if(inFlight.begin(), inFlight.end(),
+                                 [&](auto &&inFlightFrame) {
+                                     return inFlightFrame.packetId ==
+                                            answer.packetId;
+                                 });
+            if (answer.packetId == loadCompletePacketId) {
+                // whole image arrived, acks of the last frames were lost
+                co_return {LocalStatusCode::Ok, answer.code};
+            }
+            if (frame == inFlight.end()) {
+                continue; // late answer on already acked frame
+            }
+        }
+
+        frame->answers += 1;
+        answeredUpTo = std::max(answeredUpTo, frame->leftAt);
+        // legacy device asks for the next packet when it already has this
+        // one, so a resent copy whose first ack was lost gets this answer
+        if (!windowed && answer.code == StatusCode::LoadWrongPacket &&
+            frame->retransmits != 0) {
+            answer.code = StatusCode::Ok;
+        }
+
+        switch (answer.code) {
+        case StatusCode::Ok:
+            // ambiguous which copy was acked for retransmitted frames
+            if (frame->retransmits == 0) {
+                auto now = clock::now();
+                if (stats) {
+                    stats->frameRtt.push_back(now - frame->sentAt);
+                }
+                // device time alone, line time of the frame, of frames
+                // queued before it and of the answer taken out
+                auto latency = std::max(now - frame->leftAt - answerTime,
+                                        clock::duration::zero());
+                rttEstimate.sample(latency);
+                sizer.delivered(frame->wireBytes);
+                auto sample = std::chrono::duration<double>(latency).count() *
+                              bytesPerSecond;
+                roundTrip = roundTrip ? roundTrip * 0.875 + sample * 0.125
+                                      : sample;
+            } else if (!windowed && frame->answers < frame->copies &&
+                       msg.written < msg.image.size()) {
+                // legacy answers carry no id, one to a copy still unanswered
+                // would be taken for the next frame's. After the last frame
+                // the image answer comes instead.
+                co_await dropStale();
+            }
+            inFlight.erase(frame);
+            busySince = clock::time_point::max();
+            busyPause = initialBusyPause;
+            // below the oldest unacked byte, journaled for resume
+            msg.acked = msg.written;
+            for (const auto &unacked : inFlight) {
+                msg.acked = std::min(msg.acked, unacked.offset);
+            }
+            for (const auto &[offset, size] : leftovers) {
+                msg.acked = std::min(msg.acked, offset);
+            }
+            if (progress && msg.acked >= reportedAcked + progressInterval) {
+                reportedAcked = msg.acked;
+                progress(msg.acked);
+            }
+            break;
+        case StatusCode::DeviceBusy:
+        case StatusCode::WaitLoad: {
+            auto waited = co_await waitBusy(*frame, answer.retryAfterMs);
+            if (!waited) {
+                co_return {LocalStatusCode::Ok, answer.code};
+            }
+            std::rotate(frame, frame + 1, inFlight.end());
+            break;
+        }
+        case StatusCode::HashBroken:
+        case StatusCode::LoadWrongPacket:
+            // legacy device asking for another packet won't take this one
+            if (windowed || answer.code == StatusCode::HashBroken) {
+                auto retrying = co_await retransmit(
+                    *frame, answer.code == StatusCode::HashBroken);
+                if (!retrying) {
+                    co_return {LocalStatusCode::Ok, answer.code};
+                }
+                std::rotate(frame, frame + 1, inFlight.end());
+                break;
+            }
+            [[fallthrough]];
+        default:
+            co_return {LocalStatusCode::Ok, answer.code};
+        }
+    }
+
+    if (!msg.unchangedPackets.empty()) {
+        co_return co_await endLoad();
+    }
+
+    // device checks whole image hash after the last frame
+    ReadResult read{};
+    do {
+        read = co_await readFrame(buffer.data(), answerSize,
+                                  action::loading);
+        answer = decode<BusyLoadAnswer>(buffer.data());
+    } while (windowed && read.localCode == LocalStatusCode::Ok &&
+             read.answerSize == answerSize &&
+             answer.packetId != loadCompletePacketId);
+    if (read.localCode != LocalStatusCode::Ok) {
+        co_return {read.localCode, StatusCode::Invalid};
+    }
+    if (read.answerSize != answerSize) {
+        co_return {LocalStatusCode::LoadAnswerNotEqual, StatusCode::Invalid};
+    }
+    co_return {LocalStatusCode::Ok, answer.code};
+}
+
+StartLoadExMsg AsyncChannel::prepareLoad(BinMsg &msg) const
+{
+    msg.hash = msg.imageHash(hashKind()); // cached if precomputed
+    msg.offsetFrames = features & capability::offsetLoad;
+    msg.fecPayload = msg.offsetFrames && (features & capability::fecLoad);
+    msg.payloadSize = maxPayloadSize(msg);
+    planFills(msg);
+    auto wireSize = packPayloads(msg);
+    const bool compressed =
+        !msg.packedOffsets.empty() ||
+        (msg.offsetFrames && (features & capability::compressedLoad));
+    return {.wholeMsgSize = msg.getMsgSize(),
+            .wholeMsgHash = msg.hash,
+            .options =
+                (msg.unchangedPackets.empty() ? 0u : loadOption::deltaImage) |
+                (compressed ? loadOption::compressed : 0u) |
+                (msg.offsetFrames ? loadOption::offsetFrames : 0u) |
+                (msg.fecPayload ? loadOption::fecPayload : 0u) |
+                (msg.fills.empty() ? 0u : loadOption::fillFrames),
+            .wireSize = wireSize};
+}
+
+Task<void> AsyncChannel::startLoad(BinMsg &msg)
+{
+    trace::Span span{"start load", port->traceTrack()};
+    auto request = prepareLoad(msg);
+    if (request.options) {
+        auto packet =
+            makeFrame(hashKind(), headerFor(action::startLoad), request);
+        co_await sendRequest({packet.data(), packet.size()});
+        co_return;
+    }
+    auto packet = makeFrame(hashKind(), headerFor(action::startLoad),
+                            StartLoadMsg{.wholeMsgSize = request.wholeMsgSize,
+                                         .wholeMsgHash = request.wholeMsgHash});
+    co_await sendRequest({packet.data(), packet.size()});
+}
+
+Task<UploadResult> AsyncChannel::resumeLoad(BinMsg &msg, uint32_t ackedBytes)
+{
+    trace::Span span{"resume load", port->traceTrack()};
+    if (!(features & capability::resumableLoad)) {
+        co_return {LocalStatusCode::Ok, StatusCode::NoSuchCommand};
+    }
+    auto packet = makeFrame(hashKind(), headerFor(action::resumeLoad),
+                            prepareLoad(msg));
+    co_await sendRequest({packet.data(), packet.size()});
+
+    WireBuffer<ResumeLoadAnswer> buffer{};
+    auto read = co_await readFrame(buffer.data(), buffer.size(),
+                                   action::resumeLoad);
+    if (read.localCode != LocalStatusCode::Ok) {
+        co_return {read.localCode, StatusCode::Invalid};
+    }
+    auto answer = decode<ResumeLoadAnswer>(buffer.data());
+    if (read.answerSize < wireSize<Answer> ||
+        (answer.code == StatusCode::Ok && read.answerSize != buffer.size())) {
+        co_return {LocalStatusCode::LoadAnswerNotEqual, StatusCode::Invalid};
+    }
+    if (answer.code != StatusCode::Ok) {
+        co_return {LocalStatusCode::Ok, answer.code};
+    }
+
+    auto offset = std::min(answer.info.offset, msg.getMsgSize());
+    // device can't tell skipped delta blocks from missing ones
+    if (!msg.unchangedPackets.empty()) {
+        offset = std::max(offset, std::min(ackedBytes, msg.getMsgSize()) /
+                                      chunkSize() * chunkSize());
+    }
+    msg.written = offset;
+    msg.acked = offset;
+    msg.nextPacketId =
+        msg.offsetFrames ? answer.info.nextPacketId
+                         : offset / chunkSize();
+    co_return {LocalStatusCode::Ok, StatusCode::Ok};
+}
+
+Task<UploadResult> AsyncChannel::endLoad()
+{
+    auto packet = makeFrame(hashKind(), headerFor(action::endLoad));
+    co_await send({packet.data(), packet.size()});
+
+    WireBuffer<Answer> answer{};
+    auto read = co_await readFrame(answer.data(), answer.size(),
+                                   action::endLoad);
+    if (read.localCode != LocalStatusCode::Ok) {
+        co_return {read.localCode, StatusCode::Invalid};
+    }
+    if (read.answerSize != answer.size()) {
+        co_return {LocalStatusCode::LoadAnswerNotEqual, StatusCode::Invalid};
+    }
+    co_return {LocalStatusCode::Ok, decode<Answer>(answer.data()).code};
+}
+
+Task<void> AsyncChannel::boot()
+{
+    auto packet = makeFrame(hashKind(), headerFor(action::boot));
+    co_await send({packet.data(), packet.size()});
+}
+
+header AsyncChannel::headerFor(uint16_t flags) const noexcept
+{
+    return {.startWord = startWord,
+            .packetLength = 0,
+            .connectionId = id,
+            .flags = flags,
+            .hash = 0};
+}
+
+} // namespace smp
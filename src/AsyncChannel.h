@@ -0,0 +1,214 @@
+#pragma once
+#include "BinMsg.h"
+#include "Checksum.h"
+#include "EventLoop.h"
+#include "FrameReceiver.h"
+#include "LocalStatusCode.h"
+#include "Msg.h"
+#include "Protocol.h"
+#include "RttEstimator.h"
+#include "Task.h"
+#include "Transport.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace smp {
+
+// booted firmware stays silent, answer in this time means boot failed
+constexpr std::chrono::milliseconds bootAnswerTimeout{500};
+
+// tried fastest first by negotiateBaud
+constexpr std::array<uint32_t, 6> fastBaudRates{3000000, 2000000, 1000000,
+                                                921600,  460800,  230400};
+
+struct ReadResult final {
+    LocalStatusCode localCode;
+    uint16_t answerSize;
+};
+
+struct UploadResult final {
+    LocalStatusCode localCode;
+    StatusCode deviceCode; // valid if localCode is Ok
+};
+
+struct UploadStats final {
+    std::vector<std::chrono::nanoseconds> frameRtt; // not retransmitted only
+    uint32_t frames;
+    uint32_t retransmits;
+    std::map<uint32_t, uint32_t> payloadSizes; // raw payload -> frames
+};
+
+// told the acked prefix of an upload, so it can be journaled
+using UploadProgress = std::function<void(uint32_t ackedBytes)>;
+
+// progress is told each time the acked prefix grows by this much
+constexpr uint32_t progressInterval = 16 * 1024;
+
+// adaptive payload of offset frames never goes below
+constexpr uint32_t minAdaptivePayload = 32;
+
+// shorter erased runs go as they are, a frame header costs about as much
+constexpr uint32_t minFillRun = 64;
+
+// retransmit timeout adapts within these, ackTimeout until measured
+constexpr std::chrono::milliseconds minRetransmitTimeout{20};
+constexpr std::chrono::milliseconds maxRetransmitTimeout{10000};
+
+// busy device without retry hint is paused for, doubled while it stays busy
+constexpr std::chrono::milliseconds initialBusyPause{2};
+
+struct DeltaPlan final {
+    LocalStatusCode localCode;
+    bool upToDate;          // device already holds the image, nothing to send
+    uint32_t changedBlocks; // packets to send
+    uint32_t blocks;        // packets of whole image
+};
+
+/*
+ * Channel protocol as coroutines on an EventLoop, waiting for the device
+ * suspends instead of blocking, so one thread runs many channels. Loop has
+ * to outlive the channel. Channel is the blocking wrapper of this.
+ */
+class AsyncChannel final {
+public:
+    // opens portName with openTransport
+    AsyncChannel(EventLoop &loop, std::string_view portName,
+                 uint32_t baudRate);
+    // baudRate is the one transport is set to
+    AsyncChannel(EventLoop &loop, std::unique_ptr<Transport> transport,
+                 uint32_t baudRate);
+    AsyncChannel(const AsyncChannel &) = delete;
+    AsyncChannel &operator=(const AsyncChannel &) = delete;
+
+    // sendHandshake and handshakeAnswer
+    Task<LocalStatusCode> handshake();
+    // start word 4 times, start handshake word is 0xAE711707
+    Task<void> sendHandshake();
+    Task<LocalStatusCode> handshakeAnswer();
+    // after handshake, falls back to stop-and-wait if firmware can't negotiate
+    Task<LocalStatusCode> negotiate();
+    void setWindowSize(uint16_t size) noexcept; // applied on next negotiate
+    // parity on loading payloads, repaired by device instead of resent,
+    // applied on next negotiate
+    void setFec(bool enabled) noexcept;
+    // after negotiate, stays on the first faster rate passing link test,
+    // Ok if the current rate is kept too
+    Task<LocalStatusCode> negotiateBaud(std::span<const uint32_t> rates =
+                                            fastBaudRates);
+    // previous rate is restored on both sides if link test fails
+    Task<LocalStatusCode> switchBaud(uint32_t rate);
+    bool goodbye() noexcept; // best effort, written without waiting
+    Task<void> peripheral(LedMsg msg);
+    // assumed that outBuffer is big enough. Answer to a request that is safe
+    // to repeat is awaited for the retransmit timeout and the request is
+    // resent while none comes, answers to others are awaited ackTimeout
+    Task<ReadResult> readFrame(uint8_t *outBuffer, uint16_t bufferSize,
+                               uint16_t requestFlags);
+    // Timeout if whole answer didn't arrive before deadline
+    Task<ReadResult> readFrame(uint8_t *outBuffer, uint16_t bufferSize,
+                               uint16_t requestFlags,
+                               Transport::Deadline deadline);
+    // next not yet sent frame of msg, NothingToWrite after the last one
+    Task<LocalStatusCode> uploadFrame(BinMsg &msg);
+    // sends all frames after startLoad ack, windowed if negotiated
+    Task<UploadResult> upload(BinMsg &msg, UploadStats *stats = nullptr,
+                              UploadProgress progress = {});
+    // compares device flash by blocks, marks unchanged packets of msg,
+    // full upload is planned if deltaLoad wasn't negotiated
+    Task<DeltaPlan> planDelta(BinMsg &msg);
+    // readFrame resends it while its answer doesn't come
+    Task<void> startLoad(BinMsg &msg);
+    // instead of startLoad, continues the unfinished load of msg from the
+    // first missing byte, deviceCode WaitStartLoad if device has none.
+    // ackedBytes of journal count for delta loads, device can't tell
+    // skipped blocks from missing ones
+    Task<UploadResult> resumeLoad(BinMsg &msg, uint32_t ackedBytes);
+    Task<void> boot();
+
+    ~AsyncChannel();
+
+    [[nodiscard]] std::string values() const;
+    [[nodiscard]] uint16_t window() const noexcept; // negotiated
+    [[nodiscard]] HashKind hashKind() const noexcept; // negotiated
+    [[nodiscard]] uint32_t baud() const noexcept;
+    // current one, follows round trips measured so far
+    [[nodiscard]] std::chrono::nanoseconds retransmitTimeout() const noexcept;
+
+private:
+    EventLoop &loop;
+    std::unique_ptr<Transport> port;
+    FrameReceiver receiver;
+    uint32_t startWord;
+    uint16_t maxPacketSize;
+    uint16_t id;
+    uint32_t features;
+    uint16_t windowSize;
+    uint16_t requestedWindowSize;
+    bool requestedFec;
+    std::chrono::milliseconds ackTimeout;
+    std::chrono::milliseconds handshakeTimeout;
+    std::chrono::milliseconds baudConfirmTimeout;
+    std::chrono::milliseconds busyTimeout; // longest busy spell of upload
+    uint8_t maxRetransmits;
+    RttEstimator rttEstimate;
+    // last request sent, empty if answered or unsafe to send again
+    std::vector<uint8_t> resendable;
+    // when the last byte of the request leaves the port
+    std::chrono::steady_clock::time_point requestSentAt;
+    // estimated end of all bytes written so far, round trips are measured
+    // from it so queued bytes and the frame's own don't count as latency
+    std::chrono::steady_clock::time_point lineIdleAt;
+    uint32_t baudRate;
+    std::vector<uint8_t> packScratch; // compressed offset frame
+    std::vector<uint8_t> fecScratch;  // offset frame payload with parity
+
+    [[nodiscard]] uint32_t chunkSize() const noexcept;
+    // of bytes at current rate, 8N1
+    [[nodiscard]] std::chrono::steady_clock::duration
+    lineTime(size_t bytes) const noexcept;
+    // length and hash are filled in by writeFrame
+    [[nodiscard]] header headerFor(uint16_t flags) const noexcept;
+    // sets up msg for loading, returns what startLoad announces
+    StartLoadExMsg prepareLoad(BinMsg &msg) const;
+    // whole frame, suspends while port output buffer is full,
+    // brace lists can't be kept across suspension by gcc 12
+    Task<void> send(ConstBuffer frame, ConstBuffer payload = {});
+    // send of a request that does the same if it arrives twice
+    Task<void> sendRequest(ConstBuffer frame);
+    // answers to resent frames may come twice, extra ones are dropped
+    // until the line is silent for the retransmit timeout
+    Task<void> dropStale();
+    Task<UploadResult> endLoad(); // whole image check of delta load
+    // echoed test frames at rate the port was just set to
+    Task<LocalStatusCode> linkTest(uint32_t rate);
+    void skipUnchanged(BinMsg &msg) const noexcept;
+    // compresses packets if negotiated, returns payload bytes to be sent
+    uint32_t packPayloads(BinMsg &msg) const;
+    uint32_t offsetWireSize(BinMsg &msg, bool compress) const;
+    [[nodiscard]] uint32_t nextPayloadSize(const BinMsg &msg) const noexcept;
+    // biggest raw payload of an offset frame, parity fits in too
+    [[nodiscard]] uint32_t maxPayloadSize(const BinMsg &msg) const noexcept;
+    // erased runs of a full sparse load go as fill frames
+    void planFills(BinMsg &msg) const;
+    // fill run holding byte at offset, nullptr if it is sent as is
+    [[nodiscard]] static const std::pair<uint32_t, uint32_t> *
+    fillAt(const BinMsg &msg, uint32_t offset) noexcept;
+    // return frame bytes written
+    Task<uint32_t> sendLoadFrame(const BinMsg &msg, uint32_t packetId,
+                                 uint32_t offset, uint32_t size);
+    Task<uint32_t> sendLoadExFrame(const BinMsg &msg, uint32_t packetId,
+                                   uint32_t offset, uint32_t size);
+    LocalStatusCode headerCheck(const smp::header *headerView,
+                                uint16_t requestedFlags,
+                                uint16_t buffSize) const;
+};
+
+} // namespace smp
@@ -1,31 +1,175 @@
 #include "BinMsg.h"
+#include "ImageFormat.h"
+#include "Trace.h"
+#include <algorithm>
 #include <filesystem>
 #include <fstream>
 
 namespace smp {
 
+namespace {
+
+// image work isn't bound to a port, it gets its own row
+uint32_t imageTrack()
+{
+    static const auto track = trace::track("image");
+    return track;
+}
+
+} // namespace
+
 BinMsg::BinMsg(std::string_view binFilePath)
-    : buffer{}, written{}, nextPacketId{}, hash{}
+    : storage{std::make_shared<Storage>()}, image{}, written{}, acked{},
+      nextPacketId{}, hash{}, unchangedPackets{},
+      packed{}, packedOffsets{}, fills{}, offsetFrames{}, fecPayload{},
+      payloadSize{}
 {
     using namespace std::filesystem;
+    trace::Span span{"read image", imageTrack()};
 
     path pathToBinFile{binFilePath.cbegin(), binFilePath.cend()};
     if (exists(pathToBinFile) && is_regular_file(pathToBinFile)) {
-        auto fileSize = static_cast<std::streamsize>(file_size(pathToBinFile));
-        std::vector<char> tempBuffer(fileSize);
-        std::ifstream binFile{pathToBinFile, std::ios::binary};
-        binFile.read(tempBuffer.data(), fileSize);
-        if (binFile) {
-            buffer = std::move(tempBuffer);
-        } else {
-            throw std::logic_error("Can't read from file");
+        if (auto manifest = ImageManifest::of(pathToBinFile)) {
+            storage->path = pathToBinFile;
+            storage->manifest = std::move(*manifest);
+        }
+        try {
+            storage->mapping = MappedFile{pathToBinFile};
+            image = storage->mapping.view();
+        } catch (const std::exception &) {
+            // empty file or no mmap, read into buffer
+            readFile(pathToBinFile);
+        }
+        flattenSegments(pathToBinFile);
+        // kept hashes are of an image this long, not of the file
+        auto &manifest = storage->manifest;
+        if (manifest.imageSize != image.size()) {
+            manifest.hashes = {};
+            manifest.blocks.clear();
+            manifest.imageSize = image.size();
         }
     } else {
         throw std::logic_error("Wrong file");
     }
 }
+
+BinMsg::BinMsg(std::vector<char> content)
+    : storage{std::make_shared<Storage>()}, image{}, written{}, acked{},
+      nextPacketId{}, hash{}, unchangedPackets{},
+      packed{}, packedOffsets{}, fills{}, offsetFrames{}, fecPayload{},
+      payloadSize{}
+{
+    storage->buffer = std::move(content);
+    image = storage->buffer;
+}
+
+BinMsg::BinMsg(std::shared_ptr<Storage> sharedStorage,
+               std::span<const char> sharedImage) noexcept
+    : storage{std::move(sharedStorage)}, image{sharedImage}, written{},
+      acked{},
+      nextPacketId{}, hash{}, unchangedPackets{},
+      packed{}, packedOffsets{}, fills{}, offsetFrames{}, fecPayload{},
+      payloadSize{}
+{}
+
+void BinMsg::readFile(const std::filesystem::path &pathToBinFile)
+{
+    auto fileSize =
+        static_cast<std::streamsize>(std::filesystem::file_size(pathToBinFile));
+    std::vector<char> tempBuffer(fileSize);
+    std::ifstream binFile{pathToBinFile, std::ios::binary};
+    binFile.read(tempBuffer.data(), fileSize);
+    if (binFile) {
+        storage->buffer = std::move(tempBuffer);
+        image = storage->buffer;
+    } else {
+        throw std::logic_error("Can't read from file");
+    }
+}
+
+// segment images are uploaded as flashed, mapping of the file isn't needed
+void BinMsg::flattenSegments(const std::filesystem::path &pathToBinFile)
+{
+    auto format = imageFormat(pathToBinFile, image);
+    if (format == ImageFormat::binary) {
+        return;
+    }
+    auto flat = flatten(readSegments(format, image));
+    if (flat.bytes.empty()) {
+        throw std::logic_error("Image has nothing to flash");
+    }
+    storage->baseAddress = flat.baseAddress;
+    storage->buffer = std::move(flat.bytes);
+    storage->mapping = MappedFile{};
+    image = storage->buffer;
+}
+
+BinMsg BinMsg::share() const { return BinMsg{storage, image}; }
+
+void BinMsg::precomputeHashes()
+{
+    trace::Span span{"image hashes", imageTrack()};
+    for (auto kind : {HashKind::djb2, HashKind::crc32c}) {
+        static_cast<void>(imageHash(kind));
+    }
+}
+
+uint32_t BinMsg::imageHash(HashKind kind) const noexcept
+{
+    auto &cached = storage->manifest.hashes[static_cast<size_t>(kind)];
+    if (!cached) {
+        trace::Span span{"image hash", imageTrack()};
+        cached =
+            checksum(kind, reinterpret_cast<const uint8_t *>(image.data()),
+                     static_cast<uint32_t>(image.size()));
+        storage->manifestChanged = true;
+    }
+    return *cached;
+}
+
+std::span<const uint32_t> BinMsg::blockHashes(HashKind kind,
+                                              uint32_t blockSize) const
+{
+    auto &blocks = storage->manifest.blocks;
+    auto cached = std::find_if(blocks.begin(), blocks.end(), [&](auto &&entry) {
+        return entry.kind == kind && entry.blockSize == blockSize;
+    });
+    if (cached != blocks.end()) {
+        return cached->hashes;
+    }
+
+    trace::Span span{"block hashes", imageTrack(), "block", blockSize};
+    ImageManifest::Blocks computed{.kind = kind,
+                                   .blockSize = blockSize,
+                                   .hashes = {}};
+    auto data = reinterpret_cast<const uint8_t *>(image.data());
+    for (size_t offset = 0; offset < image.size(); offset += blockSize) {
+        auto size = std::min<size_t>(blockSize, image.size() - offset);
+        computed.hashes.push_back(
+            checksum(kind, data + offset, static_cast<uint32_t>(size)));
+    }
+    storage->manifestChanged = true;
+    return blocks.emplace_back(std::move(computed)).hashes;
+}
+
+void BinMsg::saveManifest() const noexcept
+{
+    if (!storage->path.empty() && storage->manifestChanged &&
+        storage->manifest.write(storage->path)) {
+        storage->manifestChanged = false;
+    }
+}
+
 uint32_t BinMsg::getWrittenBytes() const noexcept { return written; };
-uint32_t BinMsg::getMsgSize() const noexcept { return buffer.size(); }
+uint32_t BinMsg::getAckedBytes() const noexcept { return acked; }
+uint32_t BinMsg::getMsgSize() const noexcept
+{
+    return static_cast<uint32_t>(image.size());
+}
+uint32_t BinMsg::getBaseAddress() const noexcept
+{
+    return storage->baseAddress;
+}
 
 
 }; // namespace smp
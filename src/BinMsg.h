@@ -1,30 +1,82 @@
 #pragma once
 
+#include "Checksum.h"
+#include "ImageManifest.h"
+#include "MappedFile.h"
+#include <array>
+#include <filesystem>
 #include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
 #include <string_view>
+#include <utility>
 #include <vector>
 
 namespace smp {
 
 class BinMsg {
 public:
-    friend class Channel;
+    friend class AsyncChannel;
     explicit BinMsg(std::string_view binFilePath);
+    explicit BinMsg(std::vector<char> content);
     BinMsg(BinMsg &&) noexcept = default;
     BinMsg &operator=(BinMsg &&) noexcept = default;
     BinMsg(const BinMsg &) = delete;
     BinMsg &operator=(const BinMsg &) = delete;
 
+    // new upload of the same image, image memory is shared
+    [[nodiscard]] BinMsg share() const;
+    // before share() to other threads, hashes are read only after it
+    void precomputeHashes();
+    // computed once, kept in the manifest of images read from files
+    [[nodiscard]] uint32_t imageHash(HashKind kind) const noexcept;
+    [[nodiscard]] std::span<const uint32_t>
+    blockHashes(HashKind kind, uint32_t blockSize) const;
+    // keeps hashes computed so far for the next load of the file
+    void saveManifest() const noexcept;
+
     uint32_t getWrittenBytes() const noexcept;
+    // image prefix acknowledged by device, resume point of a broken load
+    uint32_t getAckedBytes() const noexcept;
     uint32_t getMsgSize() const noexcept;
+    // address of image start, lowest segment address of hex, S-record and
+    // ELF images, 0 for binary ones
+    uint32_t getBaseAddress() const noexcept;
 
     ~BinMsg() = default;
 
 private:
-    std::vector<char> buffer;
+    struct Storage {
+        MappedFile mapping;       // preferred, no copy of image
+        std::vector<char> buffer; // fallback if file can't be mapped
+        std::filesystem::path path; // empty -> not a file, no manifest
+        ImageManifest manifest;
+        bool manifestChanged{};
+        uint32_t baseAddress{};
+    };
+
+    std::shared_ptr<Storage> storage;
+    std::span<const char> image; // view of mapping or buffer
     uint32_t written;
+    uint32_t acked;
     uint32_t nextPacketId;
     uint32_t hash;
+    std::vector<bool> unchangedPackets; // delta plan by packetId, empty -> all
+    // lz4 payload of packet i is packed[packedOffsets[i]..packedOffsets[i+1]),
+    // empty range or no offsets -> raw bytes
+    std::vector<uint8_t> packed;
+    std::vector<uint32_t> packedOffsets;
+    // erased runs sent as fill frames, offset and size, sorted
+    std::vector<std::pair<uint32_t, uint32_t>> fills;
+    bool offsetFrames;    // LoadExMsg frames of payloadSize, set by startLoad
+    bool fecPayload;      // parity after each offset frame payload
+    uint32_t payloadSize; // adapted during upload
+
+    BinMsg(std::shared_ptr<Storage> sharedStorage,
+           std::span<const char> sharedImage) noexcept;
+    void readFile(const std::filesystem::path &pathToBinFile);
+    void flattenSegments(const std::filesystem::path &pathToBinFile);
 };
 
 }; // namespace smp
@@ -1,260 +1,96 @@
 #include "Channel.h"
-#include "LocalStatusCode.h"
-#include "Protocol.h"
-#include <algorithm>
-#include <cstdint>
-#include <stdexcept>
+#include <utility>
 
 namespace smp {
 
-static std::array<uint8_t, 16> handshakeBuffer{
-    0xAE, 0x71, 0x17, 0x07, 0xAE, 0x71, 0x17, 0x07,
-    0xAE, 0x71, 0x17, 0x07, 0xAE, 0x71, 0x17, 0x07};
+Channel::Channel(std::string_view portName, uint32_t baudRate)
+    : loop{}, channel{loop, portName, baudRate}
+{}
 
-void Channel::handshake()
-{
-    auto res = port.write(handshakeBuffer.data(), handshakeBuffer.size());
-    // 16 bytes should write at once
-    if (res != handshakeBuffer.size()) {
-        throw std::logic_error(
-            "Can't write serial port whole message, partly not implemented");
-    }
-}
+Channel::Channel(std::unique_ptr<Transport> transport, uint32_t baudRate)
+    : loop{}, channel{loop, std::move(transport), baudRate}
+{}
+
+void Channel::handshake() { loop.wait(channel.sendHandshake()); }
 
 LocalStatusCode Channel::handshakeAnswer()
 {
-    uint32_t size = 0;
-    union{
-        struct{
-            std::array<uint8_t, handshakeBuffer.size()> header;
-            uint32_t startWord;
-            uint16_t packetSize;
-            uint16_t id;
-        }con;
-        std::array<uint8_t, sizeof(con)> buffer;
-    }packet{};
-    static_assert(sizeof(packet) == handshakeBuffer.size() + sizeof(uint32_t) + 2 * sizeof(uint16_t));
-
-    // TODO add timeouts for read and write
-    while (size != packet.buffer.size()) {
-        size += port.read(static_cast<void *>(packet.buffer.data() + size),
-                          packet.buffer.size() - size);
-    }
-
-    if (std::equal(packet.con.header.cbegin(), packet.con.header.cend(),
-                   handshakeBuffer.cbegin())) {
-        // TODO byte ordering can fail here?
-        // little endian assumed
-        startWord = packet.con.startWord;// no cast from begin to
-                                                       // pointer here in msvc
-        maxPacketSize = packet.con.packetSize;
-        id = packet.con.id;
-        return LocalStatusCode::Ok;
-    } else {
-        return LocalStatusCode::HandshakeAnswerHeaderNotEqual;
-    }
+    return loop.wait(channel.handshakeAnswer());
 }
 
-Channel::Channel(std::string_view portName, uint32_t baudRate)
-    : port{portName, baudRate}, startWord{}, maxPacketSize{}, id{}
-{}
+LocalStatusCode Channel::negotiate() { return loop.wait(channel.negotiate()); }
 
-void Channel::peripheral(LedMsg msg)
+void Channel::setWindowSize(uint16_t size) noexcept
 {
-    BufferedLedPacket ledPacket{};
-    ledPacket.packet = {.baseHeader{.startWord = startWord,
-                                    .packetLength = ledPacket.buffer.size(),
-                                    .connectionId = id,
-                                    .flags = action::peripheral},
-                        .dev = peripheral_devices::LED,
-                        .msg = msg};
+    channel.setWindowSize(size);
+}
 
-    auto hash = djb2(ledPacket.buffer.data(), sizeBeforeHashField);
-    hash = djb2(ledPacket.buffer.data() + sizeof(header),
-                ledPacket.buffer.size() - sizeof(header), hash);
-    ledPacket.packet.baseHeader.hash = hash;
+void Channel::setFec(bool enabled) noexcept { channel.setFec(enabled); }
 
-    auto res = port.write(ledPacket.buffer.data(), ledPacket.buffer.size());
-    if (res != ledPacket.buffer.size()) {
-        throw std::logic_error(
-            "Can't write serial port whole message, partly not implemented");
-    }
+LocalStatusCode Channel::negotiateBaud(std::span<const uint32_t> rates)
+{
+    return loop.wait(channel.negotiateBaud(rates));
 }
 
-ReadResult Channel::getHeaderedMsg(uint8_t *outBuffer, uint16_t bufferSize,
-                                   uint16_t requestFlags)
+LocalStatusCode Channel::switchBaud(uint32_t rate)
 {
-    // wrong implementation
-    ReadResult result{};
-    uint16_t answerSize = 0;
-    bool done = false;
-    uint16_t readSize = sizeof(smp::header);
-    const smp::header *headerView = nullptr;
+    return loop.wait(channel.switchBaud(rate));
+}
 
-    requestFlags |= 0x8000;
+bool Channel::goodbye() noexcept { return channel.goodbye(); }
 
-    if (outBuffer == nullptr || bufferSize == 0 || bufferSize < readSize) {
-        throw std::logic_error("Nullptr, 0 or too small sized outBuffer");
-    }
+void Channel::peripheral(LedMsg msg) { loop.wait(channel.peripheral(msg)); }
 
-    while (!done) {
-        auto res = port.read(outBuffer + answerSize, readSize - answerSize);
-        if(res){
-            answerSize += res;
-            if (headerView == nullptr && answerSize == 16) {
-                headerView = reinterpret_cast<const smp::header *>(outBuffer);
-                auto statusCode = headerCheck(headerView, requestFlags, bufferSize);
-                if (statusCode != LocalStatusCode::Ok) {
-                    result = {.localCode = statusCode, .answerSize = answerSize};
-                    done = true;
-                } else {
-                    readSize = headerView->packetLength;
-                }
-            }
-     
-            if (!done && headerView != nullptr && answerSize == readSize) {
-                auto hash = djb2(outBuffer, sizeBeforeHashField);
-                hash = djb2(outBuffer + sizeof(smp::header),
-                        answerSize - sizeof(smp::header), hash);
-                if (headerView->hash == hash) {
-                    result = {.localCode = LocalStatusCode::Ok,
-                          .answerSize = answerSize};
-                } else {
-                    result = {.localCode = LocalStatusCode::WrongHash,
-                          .answerSize = answerSize};
-                }
-                done = true;
-            }
-        } else {
-            done = true; // timeout exit
-            result = {.localCode = LocalStatusCode::Timeout, .answerSize = answerSize};
-        }
-        
-    }
-    return result;
+ReadResult Channel::getHeaderedMsg(uint8_t *outBuffer, uint16_t bufferSize,
+                                   uint16_t requestFlags)
+{
+    return loop.wait(channel.readFrame(outBuffer, bufferSize, requestFlags));
 }
 
-bool Channel::goodbye() noexcept
+ReadResult Channel::getHeaderedMsg(uint8_t *outBuffer, uint16_t bufferSize,
+                                   uint16_t requestFlags,
+                                   Transport::Deadline deadline)
 {
-    BufferedHeader packet;
-    packet.header = {.startWord = startWord,
-                     .packetLength = sizeof(header),
-                     .connectionId = id,
-                     .flags = action::goodbye};
-    auto hash =
-        djb2(packet.buffer.data(), sizeBeforeHashField); // header before hash
-    packet.header.hash = hash;
-
-    auto res = port.write(packet.buffer.data(), packet.buffer.size());
-    return res == packet.buffer.size();
+    return loop.wait(
+        channel.readFrame(outBuffer, bufferSize, requestFlags, deadline));
 }
 
-Channel::~Channel()
+LocalStatusCode Channel::load(BinMsg &msg)
 {
-    goodbye(); // check return value and log?
+    return loop.wait(channel.uploadFrame(msg));
 }
 
-std::string Channel::values() const
+UploadResult Channel::upload(BinMsg &msg, UploadStats *stats,
+                             UploadProgress progress)
 {
-    return std::to_string(startWord) + ' ' + std::to_string(maxPacketSize) +
-           ' ' + std::to_string(id);
+    return loop.wait(channel.upload(msg, stats, std::move(progress)));
 }
 
-LocalStatusCode Channel::headerCheck(const smp::header *headerView,
-                                     uint16_t requestedFlags,
-                                     uint16_t buffSize) const
+DeltaPlan Channel::planDelta(BinMsg &msg)
 {
-    LocalStatusCode result;
-    if (headerView->startWord == startWord) {
-        if (headerView->connectionId == id) {
-            if (headerView->flags == requestedFlags) {
-                if (buffSize >= headerView->packetLength) {
-                    result = LocalStatusCode::Ok;
-                } else {
-                    result = LocalStatusCode::BufferToSmall;
-                }
-            } else {
-                result = LocalStatusCode::WrongFlags;
-            }
-        } else {
-            result = LocalStatusCode::WrongId;
-        }
-    } else {
-        result = LocalStatusCode::WrongStartWord;
-    }
-    return result;
+    return loop.wait(channel.planDelta(msg));
 }
 
-LocalStatusCode Channel::load(BinMsg &msg)
+void Channel::startLoad(BinMsg &msg) { loop.wait(channel.startLoad(msg)); }
+
+UploadResult Channel::resumeLoad(BinMsg &msg, uint32_t ackedBytes)
 {
-    auto leftToWrite = msg.buffer.size() - msg.written;
-    if (leftToWrite > 0) {
-        BufferedLoadHeader packet{};
+    return loop.wait(channel.resumeLoad(msg, ackedBytes));
+}
 
-        auto msgSize = leftToWrite > maxPacketSize - sizeof(LoadHeader)
-                          ? maxPacketSize - sizeof(LoadHeader)
-                          : leftToWrite;
-        packet.header = {
-            .baseHeader{.startWord = startWord,
-                        .packetLength = static_cast<uint16_t>(
-                            msgSize + sizeof(LoadHeader)),
-                        .connectionId = id,
-                        .flags = action::loading},
-            .msg = {.packetId = msg.nextPacketId,
-                    .msgHash= static_cast<uint32_t>(msg.hash)}};
-        auto hash = djb2(packet.buffer.data(), sizeBeforeHashField);
-        hash =
-            djb2(packet.buffer.data() + sizeof(header), sizeof(LoadMsg), hash);
-        hash = djb2(reinterpret_cast<const uint8_t *>(msg.buffer.data()) +
-                        msg.written,
-                    msgSize, hash);
-        packet.header.baseHeader.hash = hash;
+void Channel::boot() { loop.wait(channel.boot()); }
 
-        uint32_t offset = 0;
-        while (sizeof(packet) - offset) {
-            offset += port.write(packet.buffer.data() + offset, sizeof(packet) - offset);
-        }
+std::string Channel::values() const { return channel.values(); }
 
-        offset = 0;
-        while (msgSize - offset) {
-            offset += port.write(msg.buffer.data() + msg.written + offset, msgSize - offset);
-        }
-        msg.written += offset;
-        msg.nextPacketId += 1;
-        return LocalStatusCode::Ok;
-    } else {
-        return LocalStatusCode::NothingToWrite;
-    }
-}
+uint16_t Channel::window() const noexcept { return channel.window(); }
 
-void Channel::startLoad(BinMsg& msg)
-{
-    BufferedStartLoadHeader packet{};
-    auto msgHash = smp::djb2(reinterpret_cast<const uint8_t*>(msg.buffer.data()), msg.buffer.size());
-    msg.hash = msgHash;
-    packet.content = {.baseHeader = {.startWord = startWord, .packetLength = packet.buffer.size(), .connectionId = id, .flags = action::startLoad}, .msg = {.wholeMsgSize = msg.getMsgSize(), .wholeMsgHash = msgHash}};
-    auto hash = djb2(packet.buffer.data(),
-                sizeBeforeHashField); 
-    hash = djb2(packet.buffer.data() + sizeof(header), sizeof(StartLoadMsg),
-            hash);
-    packet.content.baseHeader.hash = hash;
-    uint32_t offset = 0;
-    while(packet.buffer.size() - offset){
-        offset += port.write(packet.buffer.data() + offset, packet.buffer.size() - offset);
-    }
+HashKind Channel::hashKind() const noexcept { return channel.hashKind(); }
 
-}
+uint32_t Channel::baud() const noexcept { return channel.baud(); }
 
-void Channel::boot()
+std::chrono::nanoseconds Channel::retransmitTimeout() const noexcept
 {
-    BufferedHeader packet{}; 
-    packet.header = {.startWord = startWord, .packetLength = packet.buffer.size(), .connectionId = id, .flags = action::boot}; 
-    auto hash = djb2(packet.buffer.data(), sizeBeforeHashField);
-    packet.header.hash = hash;
-    uint32_t offset = 0;
-    while(packet.buffer.size() - offset){
-        offset += port.write(packet.buffer.data() + offset, packet.buffer.size() - offset);
-    }
+    return channel.retransmitTimeout();
 }
 
 } // namespace smp
@@ -1,49 +1,64 @@
 #pragma once
-#include "BinMsg.h"
-#include "LocalStatusCode.h"
-#include "Msg.h"
-#include "Protocol.h"
-#include "SerialPort.h"
-#include <cstddef>
+#include "AsyncChannel.h"
+#include "EventLoop.h"
+#include "Transport.h"
+#include <chrono>
 #include <cstdint>
+#include <memory>
+#include <span>
 #include <string>
+#include <string_view>
 
 namespace smp {
 
-struct ReadResult final {
-    LocalStatusCode localCode;
-    uint16_t answerSize;
-};
-
+// blocking AsyncChannel on its own loop, for one device at a time
 class Channel final {
 public:
     Channel(std::string_view portName, uint32_t baudRate);
+    Channel(std::unique_ptr<Transport> transport, uint32_t baudRate);
     // handshake -> start word 4 times
     void handshake(); // start handshake word is 0xAE711707
     LocalStatusCode handshakeAnswer();
+    // after handshake, falls back to stop-and-wait if firmware can't negotiate
+    LocalStatusCode negotiate();
+    void setWindowSize(uint16_t size) noexcept; // applied on next negotiate
+    void setFec(bool enabled) noexcept;         // applied on next negotiate
+    // after negotiate, stays on the first faster rate passing link test,
+    // Ok if the current rate is kept too
+    LocalStatusCode negotiateBaud(std::span<const uint32_t> rates =
+                                      fastBaudRates);
+    // previous rate is restored on both sides if link test fails
+    LocalStatusCode switchBaud(uint32_t rate);
     bool goodbye() noexcept;
     void peripheral(LedMsg msg);
-    // assumed that outBuffer is big enough
+    // assumed that outBuffer is big enough, waits for answer ackTimeout
     ReadResult getHeaderedMsg(uint8_t *outBuffer, uint16_t bufferSize,
                               uint16_t requestFlags);
-    // rewrite as coroutine?
+    // Timeout if whole answer didn't arrive before deadline
+    ReadResult getHeaderedMsg(uint8_t *outBuffer, uint16_t bufferSize,
+                              uint16_t requestFlags,
+                              Transport::Deadline deadline);
     LocalStatusCode load(BinMsg &msg);
-    void startLoad(BinMsg& msg); // possible change of prototype in favour of return LocalStatusCode (espcially if timeout would be implemented)
+    // sends all frames after startLoad ack, windowed if negotiated
+    UploadResult upload(BinMsg &msg, UploadStats *stats = nullptr,
+                        UploadProgress progress = {});
+    // compares device flash by blocks, marks unchanged packets of msg,
+    // full upload is planned if deltaLoad wasn't negotiated
+    DeltaPlan planDelta(BinMsg &msg);
+    void startLoad(BinMsg &msg);
+    // instead of startLoad, deviceCode WaitStartLoad if nothing to resume
+    UploadResult resumeLoad(BinMsg &msg, uint32_t ackedBytes);
     void boot();
 
-    ~Channel();
-
     [[nodiscard]] std::string values() const;
+    [[nodiscard]] uint16_t window() const noexcept; // negotiated
+    [[nodiscard]] HashKind hashKind() const noexcept; // negotiated
+    [[nodiscard]] uint32_t baud() const noexcept;
+    [[nodiscard]] std::chrono::nanoseconds retransmitTimeout() const noexcept;
 
 private:
-    SerialPort port;
-    uint32_t startWord;
-    uint16_t maxPacketSize;
-    uint16_t id;
-
-    LocalStatusCode headerCheck(const smp::header *headerView,
-                                uint16_t requestedFlags,
-                                uint16_t buffSize) const;
+    EventLoop loop; // before channel, channel keeps a reference
+    AsyncChannel channel;
 };
 
 } // namespace smp
@@ -0,0 +1,135 @@
+#include "Checksum.h"
+#include <array>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SMP_CRC32C_X86 1
+#include <nmmintrin.h>
+#elif defined(__GNUC__) && defined(__aarch64__)
+#define SMP_CRC32C_ARM 1
+#include <arm_acle.h>
+#if defined(__linux__)
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#endif
+#endif
+
+namespace smp {
+
+namespace {
+
+constexpr uint32_t castagnoli = 0x82F63B78; // reflected 0x1EDC6F41
+
+constexpr std::array<std::array<uint32_t, 256>, 8> makeTables() noexcept
+{
+    std::array<std::array<uint32_t, 256>, 8> tables{};
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc >> 1) ^ ((crc & 1) ? castagnoli : 0);
+        }
+        tables[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; ++i) {
+        for (size_t slice = 1; slice < tables.size(); ++slice) {
+            auto previous = tables[slice - 1][i];
+            tables[slice][i] = (previous >> 8) ^ tables[0][previous & 0xFF];
+        }
+    }
+    return tables;
+}
+
+constexpr auto tables = makeTables();
+
+uint64_t loadLittleEndian64(const uint8_t *buffer) noexcept
+{
+    uint64_t value;
+    std::memcpy(&value, buffer, sizeof(value)); // little endian assumed
+    return value;
+}
+
+#if SMP_CRC32C_X86
+__attribute__((target("sse4.2"))) uint32_t
+crc32cHardware(const uint8_t *buffer, uint32_t size, uint32_t crc) noexcept
+{
+    crc = ~crc;
+#if defined(__x86_64__)
+    uint64_t crc64 = crc;
+    for (; size >= 8; size -= 8, buffer += 8) {
+        crc64 = _mm_crc32_u64(crc64, loadLittleEndian64(buffer));
+    }
+    crc = static_cast<uint32_t>(crc64);
+#endif
+    for (; size; --size, ++buffer) {
+        crc = _mm_crc32_u8(crc, *buffer);
+    }
+    return ~crc;
+}
+
+bool detectHardware() noexcept { return __builtin_cpu_supports("sse4.2"); }
+
+#elif SMP_CRC32C_ARM
+__attribute__((target("+crc"))) uint32_t
+crc32cHardware(const uint8_t *buffer, uint32_t size, uint32_t crc) noexcept
+{
+    crc = ~crc;
+    for (; size >= 8; size -= 8, buffer += 8) {
+        crc = __crc32cd(crc, loadLittleEndian64(buffer));
+    }
+    for (; size; --size, ++buffer) {
+        crc = __crc32cb(crc, *buffer);
+    }
+    return ~crc;
+}
+
+bool detectHardware() noexcept
+{
+#if defined(__linux__)
+    return getauxval(AT_HWCAP) & HWCAP_CRC32;
+#else
+    return true; // armv8 hosts without linux are apple silicon
+#endif
+}
+
+#else
+uint32_t crc32cHardware(const uint8_t *buffer, uint32_t size,
+                        uint32_t crc) noexcept
+{
+    return crc32cSlice8(buffer, size, crc);
+}
+
+bool detectHardware() noexcept { return false; }
+#endif
+
+} // namespace
+
+uint32_t crc32cSlice8(const uint8_t *buffer, uint32_t size,
+                      uint32_t crc) noexcept
+{
+    crc = ~crc;
+    for (; size >= 8; size -= 8, buffer += 8) {
+        auto word = loadLittleEndian64(buffer) ^ crc;
+        crc = tables[7][word & 0xFF] ^ tables[6][(word >> 8) & 0xFF] ^
+              tables[5][(word >> 16) & 0xFF] ^ tables[4][(word >> 24) & 0xFF] ^
+              tables[3][(word >> 32) & 0xFF] ^ tables[2][(word >> 40) & 0xFF] ^
+              tables[1][(word >> 48) & 0xFF] ^ tables[0][word >> 56];
+    }
+    for (; size; --size, ++buffer) {
+        crc = (crc >> 8) ^ tables[0][(crc ^ *buffer) & 0xFF];
+    }
+    return ~crc;
+}
+
+bool crc32cHardwareAvailable() noexcept
+{
+    static const bool available = detectHardware();
+    return available;
+}
+
+uint32_t crc32c(const uint8_t *buffer, uint32_t size, uint32_t crc) noexcept
+{
+    return crc32cHardwareAvailable() ? crc32cHardware(buffer, size, crc)
+                                     : crc32cSlice8(buffer, size, crc);
+}
+
+} // namespace smp
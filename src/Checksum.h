@@ -0,0 +1,32 @@
+#pragma once
+
+#include "Protocol.h"
+#include <cstdint>
+
+namespace smp {
+
+// frame and image hash, crc32c only if negotiated with capability
+enum class HashKind : uint8_t { djb2, crc32c };
+
+// Castagnoli, reflected, chains as crc32c(b, crc32c(a)) == crc32c(a + b)
+uint32_t crc32c(const uint8_t *buffer, uint32_t size,
+                uint32_t crc = 0) noexcept;
+uint32_t crc32cSlice8(const uint8_t *buffer, uint32_t size,
+                      uint32_t crc = 0) noexcept;
+bool crc32cHardwareAvailable() noexcept;
+
+inline uint32_t checksum(HashKind kind, const uint8_t *buffer, uint32_t size,
+                         uint32_t start) noexcept
+{
+    return kind == HashKind::crc32c ? crc32c(buffer, size, start)
+                                    : djb2(buffer, size, start);
+}
+
+inline uint32_t checksum(HashKind kind, const uint8_t *buffer,
+                         uint32_t size) noexcept
+{
+    return kind == HashKind::crc32c ? crc32c(buffer, size)
+                                    : djb2(buffer, size);
+}
+
+} // namespace smp
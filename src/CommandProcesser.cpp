@@ -1,29 +1,42 @@
 #include "CommandProcesser.h"
 #include "ErrnoException.h"
+#include "LoadJournal.h"
 #include "LocalStatusCode.h"
 #include "Msg.h"
+#include "Frame.h"
 #include "Protocol.h"
+#include "StatusText.h"
+#include "Trace.h"
 #include <algorithm>
+#include <array>
 #include <charconv>
+#include <chrono>
+#include <fstream>
+#include <optional>
 #include <string_view>
 #include <unordered_map>
 #include <stdexcept>
 
 namespace {
 
-bool checkAnswer(const smp::BufferedAnswer& answer, smp::ReadResult readResult, std::string& error) noexcept;
-constexpr std::string_view localCodeToStr(LocalStatusCode code) noexcept;
-constexpr std::string_view codeToStr(smp::StatusCode code) noexcept;
+bool checkAnswer(const smp::WireBuffer<smp::Answer>& answer, smp::ReadResult readResult, std::string& error) noexcept;
 void fillLedCommand(std::string_view command, smp::LedMsg &msg) ;
+std::string_view firstWord(std::string_view command) noexcept;
 
 }
 CommandProcesser::CommandProcesser(std::string_view portName, size_t baudRate)
-    : comChannel(portName, baudRate)
+    : portName(portName), comChannel(portName, baudRate)
 {}
 
-enum class commands { START, LED, LOAD, STOP, BOOT};
+enum class commands {
+    START, LED, LOAD, STOP, BOOT, WINDOW, PIPELINE, BAUD, TRACE};
 
 std::string CommandProcesser::process(std::string_view command)
+{
+    return execute(command).text;
+}
+
+CommandResult CommandProcesser::execute(std::string_view command)
 {
     using namespace std::string_view_literals;
     static const std::unordered_map strToCommand{
@@ -32,6 +45,10 @@ std::string CommandProcesser::process(std::string_view command)
         {"stop"sv, commands::STOP},
         {"load"sv, commands::LOAD},
         {"boot"sv, commands::BOOT},
+        {"window"sv, commands::WINDOW},
+        {"pipeline"sv, commands::PIPELINE},
+        {"baud"sv, commands::BAUD},
+        {"trace"sv, commands::TRACE},
     };
 
     auto commandIndex = command.find_first_of(' ');
@@ -52,137 +69,323 @@ std::string CommandProcesser::process(std::string_view command)
                 commandIndex + 1, command.size() - 1 - commandIndex));
         case commands::BOOT:
             return bootCommand();
+        case commands::WINDOW:
+            return windowCommand(command.substr(
+                commandIndex + 1, command.size() - 1 - commandIndex));
+        case commands::PIPELINE:
+            return pipelineCommand(command.substr(
+                commandIndex + 1, command.size() - 1 - commandIndex));
+        case commands::BAUD:
+            return baudCommand(commandIndex == std::string_view::npos
+                                   ? std::string_view{}
+                                   : command.substr(commandIndex + 1));
+        case commands::TRACE:
+            return traceCommand(commandIndex == std::string_view::npos
+                                    ? std::string_view{}
+                                    : command.substr(commandIndex + 1));
         }
     } else {
-        return "No such command";
+        return {"No such command", false};
     }
-    return "";
+    return {"", true};
 }
 
-std::string CommandProcesser::startCommand()
+CommandResult CommandProcesser::startCommand()
 {
     comChannel.handshake();
     auto result = comChannel.handshakeAnswer();
     if (result == LocalStatusCode::Ok) {
-        return "Values: " + comChannel.values();
+        result = comChannel.negotiate();
+    }
+    if (result == LocalStatusCode::Ok) {
+        return {"Values: " + comChannel.values(), true};
     } else {
-        return localCodeToStr(result).data();
+        return {localCodeToStr(result).data(), false};
     }
 }
 
-std::string CommandProcesser::ledCommand(std::string_view command)
+CommandResult CommandProcesser::ledCommand(std::string_view command)
 {
-    std::string resultString = "Led operation succeeded";
+    CommandResult result{"Led operation succeeded", true};
 
     smp::LedMsg msg{};
-    smp::BufferedAnswer answer{};
+    smp::WireBuffer<smp::Answer> answer{};
 
     fillLedCommand(command, msg);
 
     comChannel.peripheral(msg);
 
-    auto result = comChannel.getHeaderedMsg(
-        answer.buffer.data(), answer.buffer.size(), smp::action::peripheral);
-    checkAnswer(answer, result, resultString);
-    return resultString;
+    auto readResult = comChannel.getHeaderedMsg(
+        answer.data(), answer.size(), smp::action::peripheral);
+    result.ok = checkAnswer(answer, readResult, result.text);
+    return result;
 }
 
-// write as coroutine?
-std::string CommandProcesser::loadCommand(std::string_view command)
+// unfinished load of the same image to the same port resumes where the
+// device stopped, progress is journaled next to the image
+CommandResult CommandProcesser::loadCommand(std::string_view command)
 {
     std::string resultStr{};
-    smp::BufferedAnswer receiver{};
+    smp::WireBuffer<smp::Answer> receiver{};
     smp::BinMsg msg(command);
+    LoadJournal journal{std::string(command) + ".journal"};
 
-    comChannel.startLoad(msg);
-
-    auto readResult = comChannel.getHeaderedMsg(receiver.buffer.data(), receiver.buffer.size(), smp::action::startLoad);
+    auto plan = comChannel.planDelta(msg);
+    if (plan.localCode != LocalStatusCode::Ok) {
+        return {localCodeToStr(plan.localCode).data(), false};
+    }
+    if (plan.upToDate) {
+        journal.remove();
+        msg.saveManifest();
+        return {"Already loaded", true};
+    }
 
-    if(checkAnswer(receiver, readResult, resultStr)){
-        
-        LocalStatusCode result = comChannel.load(msg);
-        while(result == LocalStatusCode::Ok){
-            readResult = comChannel.getHeaderedMsg(receiver.buffer.data(), receiver.buffer.size(), smp::action::loading);
-            if(checkAnswer(receiver, readResult, resultStr)){
-                result = comChannel.load(msg);
-            } else {
-                break;
-            }
+    JournalEntry entry{.port = portName,
+                       .imageSize = msg.getMsgSize(),
+                       .imageHash = msg.imageHash(comChannel.hashKind()),
+                       .ackedBytes = 0};
+    bool resumed = false;
+    if (auto last = journal.read(); last && last->port == entry.port &&
+                                    last->imageSize == entry.imageSize &&
+                                    last->imageHash == entry.imageHash) {
+        auto [localCode, deviceCode] =
+            comChannel.resumeLoad(msg, last->ackedBytes);
+        if (localCode != LocalStatusCode::Ok) {
+            return {localCodeToStr(localCode).data(), false};
+        }
+        resumed = deviceCode == smp::StatusCode::Ok;
+    }
+    if (!resumed) {
+        comChannel.startLoad(msg);
+        auto readResult = comChannel.getHeaderedMsg(
+            receiver.data(), receiver.size(), smp::action::startLoad);
+        if (!checkAnswer(receiver, readResult, resultStr)) {
+            return {resultStr, false};
         }
+    }
+    auto resumedAt = msg.getAckedBytes();
+    entry.ackedBytes = resumedAt;
+    journal.write(entry);
+    msg.saveManifest(); // hashes are all known once load has started
 
-        if(result == LocalStatusCode::NothingToWrite){
-            readResult = comChannel.getHeaderedMsg(receiver.buffer.data(), receiver.buffer.size(), smp::action::loading);
-            if(checkAnswer(receiver, readResult, resultStr)){
-                resultStr = "Loaded";
-            }
-        } 
+    // acked prefix is journaled as it grows, a killed client resumes near
+    // where it stopped, an exception journals the last one before leaving
+    auto journalAcked = [&](uint32_t ackedBytes) {
+        entry.ackedBytes = ackedBytes;
+        journal.write(entry);
+    };
+    smp::UploadResult uploaded{};
+    try {
+        uploaded = comChannel.upload(msg, nullptr, journalAcked);
+    } catch (...) {
+        journalAcked(msg.getAckedBytes());
+        throw;
     }
-    return resultStr;
+    auto [localCode, deviceCode] = uploaded;
+    if (localCode != LocalStatusCode::Ok ||
+        deviceCode != smp::StatusCode::Ok) {
+        entry.ackedBytes = msg.getAckedBytes();
+        journal.write(entry);
+        return {localCode != LocalStatusCode::Ok
+                    ? std::string(localCodeToStr(localCode))
+                    : std::string(codeToStr(deviceCode)),
+                false};
+    }
+    journal.remove();
+
+    if (plan.changedBlocks != plan.blocks) {
+        resultStr = "Loaded " + std::to_string(plan.changedBlocks) + '/' +
+                    std::to_string(plan.blocks) + " blocks";
+    } else {
+        resultStr = "Loaded";
+    }
+    if (resumed) {
+        resultStr += ", resumed at " + std::to_string(resumedAt) + " bytes";
+    }
+    // hex, S-record and ELF images start at their lowest segment
+    if (auto base = msg.getBaseAddress()) {
+        std::array<char, 8> digits{};
+        auto end = std::to_chars(digits.begin(), digits.end(), base, 16).ptr;
+        resultStr += ", image at 0x" + std::string(digits.begin(), end);
+    }
+    return {resultStr, true};
 }
 
-std::string CommandProcesser::bootCommand()
+CommandResult CommandProcesser::bootCommand()
 {
     std::string resultString{};
-    smp::BufferedAnswer receiver{};
+    bool booted = false;
+    smp::WireBuffer<smp::Answer> receiver{};
     comChannel.boot();
-    // somehow wait on timeout
     // if out from timeout -> all done, else error
-    auto readResult = comChannel.getHeaderedMsg(receiver.buffer.data(), receiver.buffer.size(), smp::action::boot);
+    auto readResult = comChannel.getHeaderedMsg(
+        receiver.data(), receiver.size(), smp::action::boot,
+        std::chrono::steady_clock::now() + smp::bootAnswerTimeout);
     if(readResult.localCode == LocalStatusCode::Timeout && !readResult.answerSize){
         resultString = "Booted!";
+        booted = true;
     } else {
         checkAnswer(receiver, readResult, resultString);
     }
-    return resultString;
+    return {resultString, booted};
 }
 
+// frames in flight during load, takes effect on next start
+CommandResult CommandProcesser::windowCommand(std::string_view command)
+{
+    uint16_t size{};
+    auto [ptr, err] =
+        std::from_chars(command.data(), command.data() + command.size(), size);
+    if (err != std::errc() || size == 0) {
+        throw std::logic_error("Window size must be a positive number: " +
+                               std::string(command));
+    }
+    comChannel.setWindowSize(size);
+    return {"Window size: " + std::to_string(size), true};
+}
 
-namespace{
+// loading window is a different device resource, led depth is set apart
+CommandResult CommandProcesser::pipelineCommand(std::string_view command)
+{
+    uint16_t depth{};
+    auto [ptr, err] = std::from_chars(command.data(),
+                                      command.data() + command.size(), depth);
+    if (err != std::errc() || depth == 0) {
+        throw std::logic_error("Led depth must be a positive number: " +
+                               std::string(command));
+    }
+    ledDepth = depth;
+    return {"Led depth: " + std::to_string(depth), true};
+}
 
-constexpr std::string_view localCodeToStr(LocalStatusCode code) noexcept
+// without rate tries the fastest both sides pass link test on
+CommandResult CommandProcesser::baudCommand(std::string_view command)
 {
-    using namespace std::string_view_literals;
-    constexpr std::array localStatusCodeToString{
-        std::pair{LocalStatusCode::WrongHash, "Wrong hash"sv},
-        std::pair{LocalStatusCode::BufferToSmall, "Buffer too small"sv},
-        std::pair{LocalStatusCode::WrongId, "Wrong response id"sv},
-        std::pair{LocalStatusCode::WrongStartWord, "Wrong start word"sv},
-        std::pair{LocalStatusCode::HandshakeAnswerHeaderNotEqual,
-         "Handshake answer header not equal"sv},
-        std::pair{LocalStatusCode::WrongFlags, "Header flags are different"sv},
-        std::pair{LocalStatusCode::Timeout, "Timeout"sv}
-    };
-    auto res = std::find_if(localStatusCodeToString.cbegin(), localStatusCodeToString.cend(), [=](auto&& codeAndStr){return codeAndStr.first == code;});
-    if(res != localStatusCodeToString.cend()){
-        return res->second;
+    LocalStatusCode result;
+    if (command.empty()) {
+        result = comChannel.negotiateBaud();
     } else {
-        return "Unkonwn error";
+        uint32_t rate{};
+        auto [ptr, err] = std::from_chars(
+            command.data(), command.data() + command.size(), rate);
+        if (err != std::errc() || rate == 0) {
+            throw std::logic_error("Baud rate must be a positive number: " +
+                                   std::string(command));
+        }
+        result = comChannel.switchBaud(rate);
     }
+    if (result != LocalStatusCode::Ok) {
+        return {localCodeToStr(result).data(), false};
+    }
+    return {"Baud rate: " + std::to_string(comChannel.baud()), true};
 }
 
-constexpr std::string_view codeToStr(smp::StatusCode code) noexcept
+// on, off or file to write recorded spans to as Chrome trace json
+CommandResult CommandProcesser::traceCommand(std::string_view command)
 {
-    using namespace std::string_view_literals;
-    constexpr std::array statusCodeToStr{
-        std::pair{smp::StatusCode::Invalid, "Invalid status code"sv},
-        std::pair{smp::StatusCode::Ok, "Success"sv},
-        std::pair{smp::StatusCode::InvalidId, "Invalid id"sv},
-        std::pair{smp::StatusCode::WrongMsgSize, "Wrong msg size"sv},
-        std::pair{smp::StatusCode::NoSuchCommand, "NO such command"sv},
-        std::pair{smp::StatusCode::NoSuchDevice, "No such device"sv},
-        std::pair{smp::StatusCode::HashBroken, "Hash broken"sv},
-        std::pair{smp::StatusCode::LoadExtraSize, "Load extra size"sv},
-        std::pair{smp::StatusCode::WaitLoad, "Wait for loading"sv},
-        std::pair{smp::StatusCode::NoMemory, "No memory"sv},
-        std::pair{smp::StatusCode::WaitStartLoad, "Wait for start loading"sv},
-        std::pair{smp::StatusCode::LoadWrongPacket, "Wrong packet id"sv},
-    };
-    auto res = std::find_if(statusCodeToStr.cbegin(), statusCodeToStr.cend(), [=](auto&& codeAndStr){return codeAndStr.first == code;});
-    if(res != statusCodeToStr.cend()){
-        return res->second;
-    } else {
-        return "Unkonwn smp error";
+    if (command == "on") {
+        smp::trace::enable();
+        return {"Tracing on", true};
+    }
+    if (command == "off") {
+        smp::trace::disable();
+        return {"Tracing off", true};
+    }
+    if (command.empty()) {
+        throw std::logic_error("Trace needs on, off or file name");
+    }
+    std::ofstream out{std::string(command)};
+    if (!out) {
+        throw std::logic_error("Can't open trace file: " +
+                               std::string(command));
+    }
+    smp::trace::writeChromeJson(out);
+    return {"Trace written: " + std::string(command), true};
+}
+
+std::vector<CommandResult>
+CommandProcesser::run(const std::vector<std::string> &script)
+{
+    std::vector<CommandResult> results;
+    results.reserve(script.size());
+    for (size_t line = 0; line < script.size();) {
+        auto word = firstWord(script[line]);
+        if (word == "stop") {
+            break;
+        }
+        try {
+            if (word == "LED") {
+                line += ledPipeline({script.data() + line,
+                                     script.size() - line},
+                                    results);
+                continue;
+            }
+            results.push_back(execute(script[line]));
+        } catch (const ErrnoException &) {
+            throw; // port is gone, nothing after can run
+        } catch (const std::logic_error &error) {
+            results.push_back({error.what(), false});
+        }
+        line += 1;
     }
+    return results;
+}
+
+// led answers carry no id, device answers in order so reading them in
+// send order pairs them while none is lost; depth is set by pipeline
+size_t CommandProcesser::ledPipeline(std::span<const std::string> script,
+                                     std::vector<CommandResult> &results)
+{
+    const size_t depth = ledDepth;
+    std::vector<size_t> waiting;
+    size_t count = 0;
+    while (count < script.size() && waiting.size() < depth &&
+           firstWord(script[count]) == "LED") {
+        std::string_view command{script[count++]};
+        smp::LedMsg msg{};
+        try {
+            fillLedCommand(command.substr(std::min(command.find(' ') + 1,
+                                                   command.size())),
+                           msg);
+        } catch (const std::logic_error &error) {
+            results.push_back({error.what(), false});
+            continue;
+        }
+        comChannel.peripheral(msg);
+        waiting.push_back(results.size());
+        results.push_back({"Led operation succeeded", true});
+    }
+    // a lost answer shifts the later ones onto wrong commands, so after
+    // the first one missing the rest is drained and the batch fails
+    std::optional<std::string> lost;
+    for (auto index : waiting) {
+        smp::WireBuffer<smp::Answer> answer{};
+        auto readResult = comChannel.getHeaderedMsg(
+            answer.data(), answer.size(),
+            smp::action::peripheral);
+        if (readResult.localCode != LocalStatusCode::Ok) {
+            if (lost) {
+                break; // device is silent, nothing left to drain
+            }
+            lost = localCodeToStr(readResult.localCode);
+            continue;
+        }
+        results[index].ok =
+            checkAnswer(answer, readResult, results[index].text);
+    }
+    if (lost) {
+        for (auto index : waiting) {
+            results[index] = {"Led batch failed: " + *lost, false};
+        }
+    }
+    return count;
+}
+
+namespace{
+
+std::string_view firstWord(std::string_view command) noexcept
+{
+    return command.substr(0, command.find(' '));
 }
 
 void fillLedCommand(std::string_view command, smp::LedMsg &msg) 
@@ -192,8 +395,6 @@ void fillLedCommand(std::string_view command, smp::LedMsg &msg)
         std::pair{"on"sv, smp::led_ops::ON},
         {"off"sv, smp::led_ops::OFF},
         {"toggle"sv, smp::led_ops::TOGGLE}};
-    // static smp::BufferedLedPacket ledPacket;
-
     auto firstSpace = command.find_first_of(' ');
     if ("all" != command.substr(0, firstSpace)) {
         uint8_t val;
@@ -220,15 +421,16 @@ void fillLedCommand(std::string_view command, smp::LedMsg &msg)
     }
 }
 
-bool checkAnswer(const smp::BufferedAnswer& answer, smp::ReadResult readResult, std::string& error) noexcept
+bool checkAnswer(const smp::WireBuffer<smp::Answer>& answer, smp::ReadResult readResult, std::string& error) noexcept
 {
     auto [code, received] = readResult;
     if(code == LocalStatusCode::Ok){
-        if(received == answer.buffer.size()){
-           if(answer.answer.code == smp::StatusCode::Ok){
+        auto status = smp::decode<smp::Answer>(answer.data()).code;
+        if(received == answer.size()){
+           if(status == smp::StatusCode::Ok){
                return true;
            } else{
-                error = codeToStr(answer.answer.code);
+                error = codeToStr(status);
            }
         } else {
             error = "Wrong size";
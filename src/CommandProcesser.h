@@ -1,17 +1,40 @@
 #include "Channel.h"
+#include <span>
 #include <string>
+#include <vector>
+
+struct CommandResult final {
+    std::string text;
+    bool ok; // device or command failure -> false, for exit codes
+};
 
 class CommandProcesser final {
 public:
     CommandProcesser(std::string_view portName, size_t baudRate);
     std::string process(std::string_view command); // with answer return
+    CommandResult execute(std::string_view command);
+    // script lines in order, stops at stop; led runs pipelined up to
+    // ledDepth commands
+    std::vector<CommandResult> run(const std::vector<std::string> &script);
     ~CommandProcesser() = default;
 
 private:
+    std::string portName; // journal entries belong to it
     smp::Channel comChannel;
+    // led commands in flight, device says nothing of its peripheral queue,
+    // so 1 -> stop-and-wait unless the script asks for more
+    size_t ledDepth{1};
 
-    std::string loadCommand(std::string_view command);
-    std::string startCommand();
-    std::string bootCommand();
-    std::string ledCommand(std::string_view command);
+    CommandResult loadCommand(std::string_view command);
+    CommandResult startCommand();
+    CommandResult bootCommand();
+    CommandResult ledCommand(std::string_view command);
+    CommandResult windowCommand(std::string_view command);
+    CommandResult pipelineCommand(std::string_view command);
+    CommandResult baudCommand(std::string_view command);
+    CommandResult traceCommand(std::string_view command);
+    // sends consecutive led commands before reading answers, returns
+    // script lines consumed
+    size_t ledPipeline(std::span<const std::string> script,
+                       std::vector<CommandResult> &results);
 };
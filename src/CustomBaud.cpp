@@ -0,0 +1,65 @@
+#include "CustomBaud.h"
+#include "ErrnoException.h"
+
+#if defined(__linux__)
+
+#include <asm/termbits.h>
+#include <sys/ioctl.h>
+
+void setCustomBaudRate(int descriptor, uint32_t baudRate)
+{
+    termios2 options{};
+    if (ioctl(descriptor, TCGETS2, &options) == -1) {
+        throw ErrnoException("Can't get port options");
+    }
+    options.c_cflag &= ~(CBAUD | (CBAUD << IBSHIFT));
+    options.c_cflag |= BOTHER | (BOTHER << IBSHIFT);
+    options.c_ispeed = baudRate;
+    options.c_ospeed = baudRate;
+    if (ioctl(descriptor, TCSETS2, &options) == -1) {
+        throw ErrnoException("Can't set custom baud rate");
+    }
+}
+
+uint32_t lineBaudRate(int descriptor) noexcept
+{
+    termios2 options{};
+    if (ioctl(descriptor, TCGETS2, &options) == -1) {
+        return 0;
+    }
+    return options.c_ospeed;
+}
+
+#elif defined(__APPLE__)
+
+#include <IOKit/serial/ioss.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+
+void setCustomBaudRate(int descriptor, uint32_t baudRate)
+{
+    speed_t speed = baudRate;
+    if (ioctl(descriptor, IOSSIOSPEED, &speed) == -1) {
+        throw ErrnoException("Can't set custom baud rate");
+    }
+}
+
+uint32_t lineBaudRate(int descriptor) noexcept
+{
+    termios options{};
+    if (tcgetattr(descriptor, &options) == -1) {
+        return 0;
+    }
+    return static_cast<uint32_t>(cfgetospeed(&options)); // speed is rate
+}
+
+#else
+
+void setCustomBaudRate(int, uint32_t)
+{
+    throw std::logic_error("No such baud rate");
+}
+
+uint32_t lineBaudRate(int) noexcept { return 0; }
+
+#endif
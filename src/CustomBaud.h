@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstdint>
+
+// POSIX only, own unit because linux asm/termbits.h clashes with termios.h
+
+// any rate the driver accepts, termios2 BOTHER on linux, IOSSIOSPEED on mac
+void setCustomBaudRate(int descriptor, uint32_t baudRate);
+// line rate of tty, pty master reports its slave, 0 if unknown
+uint32_t lineBaudRate(int descriptor) noexcept;
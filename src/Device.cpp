@@ -0,0 +1,713 @@
+#include "Device.h"
+#include "Checksum.h"
+#include "Fec.h"
+#include "Lz4.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <thread>
+
+namespace smp::sim {
+
+namespace {
+
+constexpr std::array<uint8_t, 16> handshakeBuffer{
+    0xAE, 0x71, 0x17, 0x07, 0xAE, 0x71, 0x17, 0x07,
+    0xAE, 0x71, 0x17, 0x07, 0xAE, 0x71, 0x17, 0x07};
+
+constexpr size_t startWordSize = sizeof(uint32_t);
+
+template <typename T>
+T readAt(const uint8_t *data) noexcept
+{
+    T value;
+    std::memcpy(&value, data, sizeof(T));
+    return value;
+}
+
+uint32_t frameHash(HashKind kind, const uint8_t *frame, uint32_t length)
+{
+    auto hash = checksum(kind, frame, sizeBeforeHashField);
+    return checksum(kind, frame + sizeof(header),
+                    length - static_cast<uint32_t>(sizeof(header)), hash);
+}
+
+template <typename T>
+void append(std::vector<uint8_t> &output, const T &value)
+{
+    auto bytes = reinterpret_cast<const uint8_t *>(&value);
+    output.insert(output.end(), bytes, bytes + sizeof(T));
+}
+
+} // namespace
+
+Device::Device(const DeviceConfig &config)
+    : config{config}, input{}, connected{}, isBooted{}, ledState{},
+      sessionFeatures{}, sessionWindow{1}, baudRate{config.baudRate},
+      fallbackBaudRate{config.baudRate}, fallbackAt{}, loading{}, loadOptions{},
+      imageLoaded{}, staging{}, receivedPackets{}, receivedBytes{},
+      receivedCount{}, firstMissing{}, imageHash{}, erasedPages{},
+      busyUntil{}, flashImage{}, repaired{}, stripped{}
+{}
+
+void Device::receive(const uint8_t *data, size_t size,
+                     std::vector<uint8_t> &output)
+{
+    input.insert(input.end(), data, data + size);
+
+    size_t position = 0;
+    while (input.size() - position >= startWordSize) {
+        const uint8_t *current = input.data() + position;
+        size_t available = input.size() - position;
+
+        if (std::equal(current, current + startWordSize,
+                       handshakeBuffer.cbegin())) {
+            if (available < handshakeBuffer.size()) {
+                break;
+            }
+            if (std::equal(handshakeBuffer.cbegin(), handshakeBuffer.cend(),
+                           current)) {
+                output.insert(output.end(), handshakeBuffer.cbegin(),
+                              handshakeBuffer.cend());
+                append(output, config.startWord);
+                append(output, config.packetSize);
+                append(output, config.id);
+                connected = true;
+                isBooted = false;
+                sessionFeatures = 0;
+                sessionWindow = 1;
+                position += handshakeBuffer.size();
+                continue;
+            }
+        } else if (connected && readAt<uint32_t>(current) == config.startWord) {
+            auto consumed = processFrame(current, available, output);
+            if (consumed == 0) {
+                break;
+            }
+            position += consumed;
+            continue;
+        }
+        position += 1; // noise, resync on next byte
+    }
+    input.erase(input.begin(),
+                input.begin() + static_cast<std::ptrdiff_t>(position));
+}
+
+void Device::tick(std::chrono::steady_clock::time_point now)
+{
+    if (fallbackAt && now >= *fallbackAt) {
+        baudRate = fallbackBaudRate;
+        fallbackAt.reset();
+    }
+}
+
+uint32_t Device::lineRate() const noexcept { return baudRate; }
+
+bool Device::booted() const noexcept { return isBooted; }
+
+uint16_t Device::leds() const noexcept { return ledState; }
+
+const std::vector<uint8_t> &Device::flash() const noexcept
+{
+    return flashImage;
+}
+
+size_t Device::processFrame(const uint8_t *frame, size_t available,
+                            std::vector<uint8_t> &output)
+{
+    if (available < sizeof(header)) {
+        return 0;
+    }
+    auto frameHeader = readAt<header>(frame);
+    if (frameHeader.packetLength < sizeof(header) ||
+        frameHeader.packetLength > config.packetSize) {
+        return 1; // not a frame start
+    }
+    if (available < frameHeader.packetLength) {
+        return 0;
+    }
+    const uint32_t length = frameHeader.packetLength;
+    const uint16_t frameAction = frameHeader.flags & 0xFF;
+
+    if (config.frameDelay.count()) {
+        std::this_thread::sleep_for(config.frameDelay);
+    }
+
+    // negotiation is djb2 whatever the session uses
+    auto kind = frameAction == action::capabilities ? HashKind::djb2
+                                                    : hashKind();
+    auto intact = frameHash(kind, frame, length) == frameHeader.hash;
+    if (!intact && frameAction == action::loading) {
+        if (auto *fixed = repair(frame, length)) {
+            frame = fixed;
+            intact = true;
+        }
+    }
+    if (!intact) {
+        if (frameAction == action::loading && length >= sizeof(LoadHeader)) {
+            // id may be broken too, sender matches it or waits for timeout
+            loadAnswer(output, StatusCode::HashBroken,
+                       readAt<LoadMsg>(frame + sizeof(header)).packetId);
+        } else {
+            answer(output, frameAction, StatusCode::HashBroken);
+        }
+        return 1; // length may be the broken part, resync inside
+    }
+    if (frameHeader.connectionId != config.id) {
+        answer(output, frameAction, StatusCode::InvalidId);
+        return length;
+    }
+
+    switch (frameAction) {
+    case action::peripheral:
+        peripheral(frame, length, output);
+        break;
+    case action::capabilities:
+        capabilities(frame, length, output);
+        break;
+    case action::startLoad:
+        startLoad(frame, length, output);
+        break;
+    case action::loading:
+        load(frame, length, output);
+        break;
+    case action::boot:
+        boot(output);
+        break;
+    case action::flashHashes:
+        if (!(sessionFeatures & capability::deltaLoad)) {
+            answer(output, frameAction, StatusCode::NoSuchCommand);
+            break;
+        }
+        flashHashes(frame, length, output);
+        break;
+    case action::endLoad:
+        if (!(sessionFeatures & capability::deltaLoad)) {
+            answer(output, frameAction, StatusCode::NoSuchCommand);
+            break;
+        }
+        endLoad(output);
+        break;
+    case action::setBaud:
+    case action::linkTest:
+        if (!(sessionFeatures & capability::baudSwitch)) {
+            answer(output, frameAction, StatusCode::NoSuchCommand);
+        } else if (frameAction == action::setBaud) {
+            setBaud(frame, length, output);
+        } else {
+            linkTest(frame, length, output);
+        }
+        break;
+    case action::resumeLoad:
+        if (!(sessionFeatures & capability::resumableLoad)) {
+            answer(output, frameAction, StatusCode::NoSuchCommand);
+            break;
+        }
+        resumeLoad(frame, length, output);
+        break;
+    case action::goodbye:
+        connected = false;
+        break;
+    default:
+        answer(output, frameAction, StatusCode::NoSuchCommand);
+        break;
+    }
+    return length;
+}
+
+const uint8_t *Device::repair(const uint8_t *frame, uint32_t length)
+{
+    // parity covers payload only, header and LoadExMsg have to be intact
+    if (!loading || !(loadOptions & loadOption::fecPayload) ||
+        length <= sizeof(LoadExHeader)) {
+        return nullptr;
+    }
+    repaired.assign(frame, frame + length);
+    auto fixed = fec::correct(
+        {repaired.data() + sizeof(LoadExHeader), length - sizeof(LoadExHeader)});
+    if (!fixed || *fixed == 0 ||
+        frameHash(hashKind(), repaired.data(), length) !=
+            readAt<header>(frame).hash) {
+        return nullptr;
+    }
+    return repaired.data();
+}
+
+void Device::answer(std::vector<uint8_t> &output, uint16_t answerAction,
+                    StatusCode code, const void *extra,
+                    uint16_t extraSize) const
+{
+    auto begin = output.size();
+    header answerHeader{
+        .startWord = config.startWord,
+        .packetLength = static_cast<uint32_t>(sizeof(header) +
+                                              sizeof(StatusCode) + extraSize),
+        .connectionId = config.id,
+        .flags = static_cast<uint16_t>(answerAction | 0x8000),
+        .hash = 0};
+    append(output, answerHeader);
+    append(output, code);
+    auto extraBytes = static_cast<const uint8_t *>(extra);
+    output.insert(output.end(), extraBytes, extraBytes + extraSize);
+
+    auto *frame = output.data() + begin;
+    auto kind = answerAction == action::capabilities ? HashKind::djb2
+                                                     : hashKind();
+    auto hash = checksum(kind, frame, sizeBeforeHashField);
+    hash = checksum(kind, frame + sizeof(header),
+                    answerHeader.packetLength -
+                        static_cast<uint32_t>(sizeof(header)),
+                    hash);
+    std::memcpy(frame + sizeBeforeHashField, &hash, sizeof(hash));
+}
+
+void Device::loadAnswer(std::vector<uint8_t> &output, StatusCode code,
+                        uint32_t packetId, uint16_t retryAfterMs) const
+{
+    const bool busy =
+        code == StatusCode::DeviceBusy || code == StatusCode::WaitLoad;
+    if ((sessionFeatures & capability::windowedLoad) &&
+        (sessionFeatures & capability::busyHint) && busy) {
+        std::array<uint8_t, sizeof(packetId) + sizeof(retryAfterMs)> extra{};
+        std::memcpy(extra.data(), &packetId, sizeof(packetId));
+        std::memcpy(extra.data() + sizeof(packetId), &retryAfterMs,
+                    sizeof(retryAfterMs));
+        answer(output, action::loading, code, extra.data(), extra.size());
+    } else if (sessionFeatures & capability::windowedLoad) {
+        answer(output, action::loading, code, &packetId, sizeof(packetId));
+    } else {
+        answer(output, action::loading, code);
+    }
+}
+
+void Device::peripheral(const uint8_t *frame, uint32_t length,
+                        std::vector<uint8_t> &output)
+{
+    if (length != sizeof(LedPacket)) {
+        answer(output, action::peripheral, StatusCode::WrongMsgSize);
+        return;
+    }
+    auto packet = readAt<LedPacket>(frame);
+    if (packet.dev != peripheral_devices::LED) {
+        answer(output, action::peripheral, StatusCode::NoSuchDevice);
+        return;
+    }
+    uint16_t mask = packet.msg.ledDevice == 0xF
+                        ? uint16_t{0xFFFF}
+                        : static_cast<uint16_t>(1u << packet.msg.ledDevice);
+    switch (packet.msg.op) {
+    case led_ops::ON:
+        ledState |= mask;
+        break;
+    case led_ops::OFF:
+        ledState &= static_cast<uint16_t>(~mask);
+        break;
+    case led_ops::TOGGLE:
+        ledState ^= mask;
+        break;
+    default:
+        answer(output, action::peripheral, StatusCode::NoSuchCommand);
+        return;
+    }
+    answer(output, action::peripheral, StatusCode::Ok);
+}
+
+void Device::capabilities(const uint8_t *frame, uint32_t length,
+                          std::vector<uint8_t> &output)
+{
+    if (length != sizeof(CapabilitiesHeader)) {
+        answer(output, action::capabilities, StatusCode::WrongMsgSize);
+        return;
+    }
+    auto request = readAt<CapabilitiesMsg>(frame + sizeof(header));
+    sessionFeatures = request.features & config.features;
+    sessionWindow = 1;
+    if (sessionFeatures & capability::windowedLoad) {
+        sessionWindow = std::clamp<uint16_t>(request.windowSize, 1,
+                                             config.windowSize);
+    }
+    CapabilitiesMsg accepted{.features = sessionFeatures,
+                             .windowSize = sessionWindow,
+                             .reserved = 0};
+    answer(output, action::capabilities, StatusCode::Ok, &accepted,
+           sizeof(accepted));
+}
+
+void Device::startLoad(const uint8_t *frame, uint32_t length,
+                       std::vector<uint8_t> &output)
+{
+    // extended message only with an option that needs it
+    StartLoadExMsg request{};
+    if (length == sizeof(StartLoadHeader)) {
+        auto legacy = readAt<StartLoadMsg>(frame + sizeof(header));
+        request = {.wholeMsgSize = legacy.wholeMsgSize,
+                   .wholeMsgHash = legacy.wholeMsgHash,
+                   .options = 0,
+                   .wireSize = legacy.wholeMsgSize};
+    } else if (length == sizeof(StartLoadExHeader) &&
+               (sessionFeatures &
+                (capability::deltaLoad | capability::compressedLoad |
+                 capability::offsetLoad))) {
+        request = readAt<StartLoadExMsg>(frame + sizeof(header));
+    } else {
+        answer(output, action::startLoad, StatusCode::WrongMsgSize);
+        return;
+    }
+    uint32_t supported = 0;
+    if (sessionFeatures & capability::deltaLoad) {
+        supported |= loadOption::deltaImage;
+    }
+    if (sessionFeatures & capability::compressedLoad) {
+        supported |= loadOption::compressed;
+    }
+    if (sessionFeatures & capability::offsetLoad) {
+        supported |= loadOption::offsetFrames;
+    }
+    if (sessionFeatures & capability::fecLoad) {
+        supported |= loadOption::fecPayload;
+    }
+    if (sessionFeatures & capability::sparseLoad) {
+        supported |= loadOption::fillFrames;
+    }
+    // parity and fill ranges are only framed by offset frames
+    if ((request.options & ~supported) ||
+        ((request.options &
+          (loadOption::fecPayload | loadOption::fillFrames)) &&
+         !(request.options & loadOption::offsetFrames))) {
+        answer(output, action::startLoad, StatusCode::NoSuchCommand);
+        return;
+    }
+    if (request.wholeMsgSize > config.flashSize) {
+        answer(output, action::startLoad, StatusCode::NoMemory);
+        return;
+    }
+    staging.assign(request.wholeMsgSize, 0xFF);
+    loadOptions = request.options;
+    if (loadOptions & loadOption::deltaImage) {
+        std::copy_n(flashImage.cbegin(),
+                    std::min(flashImage.size(), staging.size()),
+                    staging.begin());
+    }
+    imageHash = request.wholeMsgHash;
+    // offset frames are counted in bytes, ids grow as frames come
+    receivedPackets.assign(
+        loadOptions & loadOption::offsetFrames ? 0 : packetCount(), false);
+    receivedBytes.assign(
+        loadOptions & loadOption::offsetFrames ? staging.size() : 0, false);
+    receivedCount = 0;
+    firstMissing = 0;
+    erasedPages.assign(config.erasePageSize
+                           ? (staging.size() + config.erasePageSize - 1) /
+                                 config.erasePageSize
+                           : 0,
+                       false);
+    loading = true;
+    answer(output, action::startLoad, StatusCode::Ok);
+    if (staging.empty() && !(loadOptions & loadOption::deltaImage)) {
+        finishLoad(output);
+    }
+}
+
+// staging outlives the connection, lost only on startLoad or commit
+void Device::resumeLoad(const uint8_t *frame, uint32_t length,
+                        std::vector<uint8_t> &output)
+{
+    if (length != sizeof(StartLoadExHeader)) {
+        answer(output, action::resumeLoad, StatusCode::WrongMsgSize);
+        return;
+    }
+    auto request = readAt<StartLoadExMsg>(frame + sizeof(header));
+    if (!loading || request.wholeMsgSize != staging.size() ||
+        request.wholeMsgHash != imageHash || request.options != loadOptions) {
+        answer(output, action::resumeLoad, StatusCode::WaitStartLoad);
+        return;
+    }
+    ResumeInfo info{};
+    if (loadOptions & loadOption::offsetFrames) {
+        // earlier ids may name acked frames, retransmit of those is ignored
+        info.nextPacketId = static_cast<uint32_t>(receivedPackets.size());
+        info.offset = static_cast<uint32_t>(
+            std::find(receivedBytes.cbegin(), receivedBytes.cend(), false) -
+            receivedBytes.cbegin());
+    } else {
+        info.nextPacketId = firstMissing;
+        info.offset = static_cast<uint32_t>(std::min<size_t>(
+            size_t{firstMissing} * chunkSize(), staging.size()));
+    }
+    answer(output, action::resumeLoad, StatusCode::Ok, &info, sizeof(info));
+}
+
+void Device::load(const uint8_t *frame, uint32_t length,
+                  std::vector<uint8_t> &output)
+{
+    const bool offsetFrames = loadOptions & loadOption::offsetFrames;
+    const size_t headerSize =
+        offsetFrames ? sizeof(LoadExHeader) : sizeof(LoadHeader);
+    if (length < headerSize) {
+        answer(output, action::loading, StatusCode::WrongMsgSize);
+        return;
+    }
+    auto msg = readAt<LoadMsg>(frame + sizeof(header)); // LoadExMsg prefix
+    if (!loading) {
+        loadAnswer(output, StatusCode::WaitStartLoad, msg.packetId);
+        return;
+    }
+    if (msg.msgHash != imageHash) {
+        loadAnswer(output, StatusCode::LoadWrongPacket, msg.packetId);
+        return;
+    }
+    size_t offset;
+    size_t size;
+    if (offsetFrames) {
+        auto at = readAt<LoadExMsg>(frame + sizeof(header));
+        // each frame brings a byte at least, so ids stay below image size
+        if (at.size == 0 || at.offset > staging.size() ||
+            at.size > staging.size() - at.offset ||
+            at.packetId >= staging.size()) {
+            loadAnswer(output, StatusCode::LoadExtraSize, msg.packetId);
+            return;
+        }
+        offset = at.offset;
+        size = at.size;
+        if (at.packetId >= receivedPackets.size()) {
+            receivedPackets.resize(at.packetId + 1, false);
+        }
+    } else {
+        if (msg.packetId >= receivedPackets.size()) {
+            loadAnswer(output, StatusCode::LoadExtraSize, msg.packetId);
+            return;
+        }
+        offset = msg.packetId * chunkSize();
+        size = std::min<size_t>(chunkSize(), staging.size() - offset);
+    }
+    // stop-and-wait firmware accepts only the next packet
+    if (!(sessionFeatures & capability::windowedLoad) &&
+        !(loadOptions & loadOption::deltaImage) &&
+        msg.packetId != firstMissing) {
+        loadAnswer(output, StatusCode::LoadWrongPacket, msg.packetId);
+        return;
+    }
+    std::span<const uint8_t> payload{frame + headerSize, length - headerSize};
+    if (loadOptions & loadOption::fecPayload) {
+        if (!fec::decodedSize(static_cast<uint32_t>(payload.size()))) {
+            loadAnswer(output, StatusCode::WrongMsgSize, msg.packetId);
+            return;
+        }
+        stripped.clear();
+        fec::strip(payload, stripped);
+        payload = stripped;
+    }
+    const auto flags = readAt<header>(frame).flags;
+    const bool compressed = flags & compressedPayloadFlag;
+    const bool filled = flags & fillPayloadFlag;
+    if ((compressed && !(loadOptions & loadOption::compressed)) ||
+        (filled && !(loadOptions & loadOption::fillFrames))) {
+        loadAnswer(output, StatusCode::NoSuchCommand, msg.packetId);
+        return;
+    }
+    if ((filled && (compressed || payload.size() != 1)) ||
+        (!compressed && !filled && payload.size() != size)) {
+        loadAnswer(output, StatusCode::WrongMsgSize, msg.packetId);
+        return;
+    }
+
+    if (!receivedPackets[msg.packetId]) { // retransmit of acked is just acked
+        // erasing flash takes nothing new, sender comes back when told
+        auto now = std::chrono::steady_clock::now();
+        if (now < busyUntil) {
+            auto left = std::chrono::ceil<std::chrono::milliseconds>(
+                busyUntil - now);
+            loadAnswer(output, StatusCode::DeviceBusy, msg.packetId,
+                       static_cast<uint16_t>(
+                           std::min<int64_t>(left.count(), 0xFFFF)));
+            return;
+        }
+        if (config.flashWriteDelay.count()) {
+            std::this_thread::sleep_for(config.flashWriteDelay);
+        }
+        std::span<uint8_t> packet{staging.data() + offset, size};
+        if (filled) {
+            std::fill(packet.begin(), packet.end(), payload.front());
+        } else if (!compressed) {
+            std::copy(payload.begin(), payload.end(), packet.begin());
+        } else if (!lz4Decompress(payload, packet)) {
+            loadAnswer(output, StatusCode::WrongMsgSize, msg.packetId);
+            return;
+        }
+        erasePages(offset, size);
+        receivedPackets[msg.packetId] = true;
+        if (!offsetFrames) {
+            receivedCount += 1;
+        }
+        for (auto byte = offset; offsetFrames && byte < offset + size; ++byte) {
+            receivedCount += receivedBytes[byte] ? 0 : 1;
+            receivedBytes[byte] = true;
+        }
+        while (firstMissing < receivedPackets.size() &&
+               receivedPackets[firstMissing]) {
+            firstMissing += 1;
+        }
+    }
+    loadAnswer(output, StatusCode::Ok, msg.packetId);
+
+    auto expected = offsetFrames ? staging.size() : receivedPackets.size();
+    if (receivedCount == expected && !(loadOptions & loadOption::deltaImage)) {
+        finishLoad(output);
+    }
+}
+
+void Device::erasePages(size_t offset, size_t size)
+{
+    if (!config.erasePageSize || size == 0) {
+        return;
+    }
+    auto now = std::chrono::steady_clock::now();
+    for (auto page = offset / config.erasePageSize;
+         page <= (offset + size - 1) / config.erasePageSize; ++page) {
+        if (!erasedPages[page]) {
+            erasedPages[page] = true;
+            busyUntil = std::max(busyUntil, now) + config.pageEraseTime;
+        }
+    }
+}
+
+void Device::flashHashes(const uint8_t *frame, uint32_t length,
+                         std::vector<uint8_t> &output)
+{
+    if (length != sizeof(FlashHashesHeader)) {
+        answer(output, action::flashHashes, StatusCode::WrongMsgSize);
+        return;
+    }
+    auto request = readAt<FlashHashesMsg>(frame + sizeof(header));
+    if (request.blockSize == 0) {
+        answer(output, action::flashHashes, StatusCode::WrongMsgSize);
+        return;
+    }
+    const size_t blocks =
+        (flashImage.size() + request.blockSize - 1) / request.blockSize;
+    const size_t fit = (config.packetSize - sizeof(FlashHashesAnswer)) /
+                       sizeof(uint32_t);
+    const auto count = static_cast<uint16_t>(std::min<size_t>(
+        {request.blockCount, fit,
+         blocks > request.firstBlock ? blocks - request.firstBlock : 0}));
+
+    FlashHashesInfo info{
+        .imageSize = static_cast<uint32_t>(flashImage.size()),
+        .imageHash = checksum(hashKind(), flashImage.data(),
+                              static_cast<uint32_t>(flashImage.size())),
+        .firstBlock = request.firstBlock,
+        .blockCount = count,
+        .reserved = 0};
+    std::vector<uint8_t> extra;
+    append(extra, info);
+    for (size_t block = request.firstBlock; block < request.firstBlock + count;
+         ++block) {
+        auto offset = block * request.blockSize;
+        auto size = std::min<size_t>(request.blockSize,
+                                     flashImage.size() - offset);
+        append(extra, checksum(hashKind(), flashImage.data() + offset,
+                               static_cast<uint32_t>(size)));
+    }
+    answer(output, action::flashHashes, StatusCode::Ok, extra.data(),
+           static_cast<uint16_t>(extra.size()));
+}
+
+void Device::endLoad(std::vector<uint8_t> &output)
+{
+    if (!loading || !(loadOptions & loadOption::deltaImage)) {
+        answer(output, action::endLoad, StatusCode::WaitStartLoad);
+        return;
+    }
+    answer(output, action::endLoad, commitLoad());
+}
+
+void Device::setBaud(const uint8_t *frame, uint32_t length,
+                     std::vector<uint8_t> &output)
+{
+    if (length != sizeof(BaudHeader)) {
+        answer(output, action::setBaud, StatusCode::WrongMsgSize);
+        return;
+    }
+    auto request = readAt<BaudMsg>(frame + sizeof(header));
+    // 16x oversampling needs divider of 16 at least
+    if (request.baudRate < 1200 || request.baudRate > config.maxBaudRate ||
+        (config.usartClock && config.usartClock / request.baudRate < 16)) {
+        answer(output, action::setBaud, StatusCode::BaudUnsupported);
+        return;
+    }
+    answer(output, action::setBaud, StatusCode::Ok); // still at old rate
+    if (!fallbackAt) {
+        fallbackBaudRate = baudRate; // unconfirmed rate is never fallback
+    }
+    baudRate = request.baudRate;
+    if (config.usartClock) {
+        auto divider = (config.usartClock + baudRate / 2) / baudRate;
+        baudRate = config.usartClock / divider;
+    }
+    fallbackAt = std::chrono::steady_clock::now() +
+                 std::chrono::milliseconds{request.confirmTimeoutMs};
+}
+
+void Device::linkTest(const uint8_t *frame, uint32_t length,
+                      std::vector<uint8_t> &output)
+{
+    auto payloadSize = length - static_cast<uint32_t>(sizeof(header));
+    if (payloadSize > config.packetSize - sizeof(Answer)) {
+        answer(output, action::linkTest, StatusCode::WrongMsgSize);
+        return;
+    }
+    fallbackAt.reset();
+    answer(output, action::linkTest, StatusCode::Ok, frame + sizeof(header),
+           static_cast<uint16_t>(payloadSize));
+}
+
+void Device::finishLoad(std::vector<uint8_t> &output)
+{
+    loadAnswer(output, commitLoad(), loadCompletePacketId);
+}
+
+StatusCode Device::commitLoad()
+{
+    auto hash = checksum(hashKind(), staging.data(),
+                         static_cast<uint32_t>(staging.size()));
+    loading = false;
+    loadOptions = 0;
+    auto code = StatusCode::HashBroken;
+    if (hash == imageHash) {
+        flashImage = std::move(staging);
+        imageLoaded = true;
+        code = StatusCode::Ok;
+    }
+    staging.clear();
+    return code;
+}
+
+void Device::boot(std::vector<uint8_t> &output)
+{
+    if (imageLoaded) {
+        // jump to application, no answer, host sees silence
+        isBooted = true;
+        connected = false;
+    } else {
+        answer(output, action::boot, StatusCode::NothingToBoot);
+    }
+}
+
+HashKind Device::hashKind() const noexcept
+{
+    return sessionFeatures & capability::crc32cHash ? HashKind::crc32c
+                                                    : HashKind::djb2;
+}
+
+uint32_t Device::chunkSize() const noexcept
+{
+    return config.packetSize - static_cast<uint32_t>(sizeof(LoadHeader));
+}
+
+uint32_t Device::packetCount() const noexcept
+{
+    return static_cast<uint32_t>((staging.size() + chunkSize() - 1) /
+                                 chunkSize());
+}
+
+} // namespace smp::sim
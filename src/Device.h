@@ -0,0 +1,122 @@
+#pragma once
+
+#include "Checksum.h"
+#include "Msg.h"
+#include "Protocol.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+// device side of stm32_manage_protocol, used by simulator and benchmarks
+namespace smp::sim {
+
+struct DeviceConfig final {
+    uint32_t startWord = 0xFCD1A612;
+    uint16_t packetSize = 256; // max frame length announced in handshake
+    uint16_t id = 1;
+    uint32_t features = capability::windowedLoad | capability::crc32cHash |
+                        capability::deltaLoad | capability::compressedLoad |
+                        capability::baudSwitch | capability::offsetLoad |
+                        capability::resumableLoad | capability::busyHint |
+                        capability::fecLoad | capability::sparseLoad;
+    uint16_t windowSize = 16;
+    uint32_t flashSize = 1024 * 1024;
+    uint32_t baudRate = 0; // line rate at start, 0 -> not tracked
+    uint32_t maxBaudRate = 3000000;
+    uint32_t usartClock = 0; // rate is clock / divider, 0 -> any rate exact
+    std::chrono::microseconds frameDelay{0};      // processing of each frame
+    std::chrono::microseconds flashWriteDelay{0}; // each loading frame
+    // first write into each page erases it, loading frames meanwhile are
+    // answered DeviceBusy, 0 -> no erase
+    uint32_t erasePageSize = 0;
+    std::chrono::microseconds pageEraseTime{0};
+};
+
+class Device final {
+public:
+    explicit Device(const DeviceConfig &config);
+
+    // consumes received bytes, answers are appended to output
+    void receive(const uint8_t *data, size_t size,
+                 std::vector<uint8_t> &output);
+
+    // falls back to previous rate if switch wasn't confirmed in time
+    void tick(std::chrono::steady_clock::time_point now);
+
+    [[nodiscard]] uint32_t lineRate() const noexcept; // 0 -> not tracked
+    [[nodiscard]] bool booted() const noexcept;
+    [[nodiscard]] uint16_t leds() const noexcept;
+    [[nodiscard]] const std::vector<uint8_t> &flash() const noexcept;
+
+private:
+    DeviceConfig config;
+    std::vector<uint8_t> input;
+    bool connected;
+    bool isBooted;
+    uint16_t ledState;
+    uint32_t sessionFeatures;
+    uint16_t sessionWindow;
+
+    // line rate switch, confirmed by linkTest before fallbackAt
+    uint32_t baudRate;
+    uint32_t fallbackBaudRate;
+    std::optional<std::chrono::steady_clock::time_point> fallbackAt;
+
+    // loading session
+    bool loading;
+    uint32_t loadOptions; // of startLoad, see loadOption
+    bool imageLoaded;
+    std::vector<uint8_t> staging;
+    std::vector<bool> receivedPackets;
+    std::vector<bool> receivedBytes; // offset frames may be split on resend
+    uint32_t receivedCount; // packets, bytes for offset frames
+    uint32_t firstMissing;
+    uint32_t imageHash;
+    std::vector<bool> erasedPages;
+    std::chrono::steady_clock::time_point busyUntil; // page erase ends
+    std::vector<uint8_t> flashImage;
+    std::vector<uint8_t> repaired; // loading frame after fec repair
+    std::vector<uint8_t> stripped; // loading payload without parity
+
+    // bytes consumed, 0 -> wait for more input
+    size_t processFrame(const uint8_t *frame, size_t available,
+                        std::vector<uint8_t> &output);
+    // fec repair of a loading frame whose hash fails, nullptr if it can't
+    // be repaired, else the repaired copy
+    const uint8_t *repair(const uint8_t *frame, uint32_t length);
+    void answer(std::vector<uint8_t> &output, uint16_t action,
+                StatusCode code, const void *extra = nullptr,
+                uint16_t extraSize = 0) const;
+    void loadAnswer(std::vector<uint8_t> &output, StatusCode code,
+                    uint32_t packetId, uint16_t retryAfterMs = 0) const;
+    // starts erase of pages first written by [offset, offset + size)
+    void erasePages(size_t offset, size_t size);
+    void peripheral(const uint8_t *frame, uint32_t length,
+                    std::vector<uint8_t> &output);
+    void capabilities(const uint8_t *frame, uint32_t length,
+                      std::vector<uint8_t> &output);
+    void startLoad(const uint8_t *frame, uint32_t length,
+                   std::vector<uint8_t> &output);
+    void resumeLoad(const uint8_t *frame, uint32_t length,
+                    std::vector<uint8_t> &output);
+    void load(const uint8_t *frame, uint32_t length,
+              std::vector<uint8_t> &output);
+    void flashHashes(const uint8_t *frame, uint32_t length,
+                     std::vector<uint8_t> &output);
+    void endLoad(std::vector<uint8_t> &output);
+    void setBaud(const uint8_t *frame, uint32_t length,
+                 std::vector<uint8_t> &output);
+    void linkTest(const uint8_t *frame, uint32_t length,
+                  std::vector<uint8_t> &output);
+    void finishLoad(std::vector<uint8_t> &output);
+    StatusCode commitLoad(); // whole image check, staging -> flash
+    void boot(std::vector<uint8_t> &output);
+    [[nodiscard]] HashKind hashKind() const noexcept;
+    [[nodiscard]] uint32_t chunkSize() const noexcept;
+    [[nodiscard]] uint32_t packetCount() const noexcept;
+};
+
+} // namespace smp::sim
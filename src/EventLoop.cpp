@@ -0,0 +1,242 @@
+#include "EventLoop.h"
+#include "ErrnoException.h"
+#include <algorithm>
+#include <array>
+#include <thread>
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <unistd.h>
+#elif !defined(_WIN32)
+#include <poll.h>
+#endif
+
+namespace smp {
+
+namespace {
+
+using clock = std::chrono::steady_clock;
+
+// whole milliseconds, rounded up so deadline has passed on wake up
+int timeoutMs(EventLoop::Deadline deadline, EventLoop::Deadline now)
+{
+    if (deadline == EventLoop::Deadline::max()) {
+        return -1;
+    }
+    auto left = std::chrono::ceil<std::chrono::milliseconds>(deadline - now);
+    return static_cast<int>(std::clamp<int64_t>(left.count(), 0, 1 << 30));
+}
+
+} // namespace
+
+EventLoop::Wait::Wait(EventLoop &loop, Handle handle, events interest,
+                      Deadline deadline) noexcept
+    : loop{loop}, handle{handle}, interest{interest}, deadline{deadline},
+      awaiting{}, ready{}
+{}
+
+bool EventLoop::Wait::await_ready() const noexcept
+{
+#ifdef _WIN32
+    return interest != none; // blocking io does the waiting
+#else
+    return false;
+#endif
+}
+
+void EventLoop::Wait::await_suspend(std::coroutine_handle<> coroutine)
+{
+    awaiting = coroutine;
+    loop.add(*this);
+}
+
+#if defined(__linux__)
+
+EventLoop::EventLoop() : waits{}, spawned{}, epoll{-1}, registered{}
+{
+    epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll == -1) {
+        throw ErrnoException("Can't create epoll");
+    }
+}
+
+EventLoop::~EventLoop() { close(epoll); }
+
+void EventLoop::updateInterest(Handle handle)
+{
+    uint32_t mask = 0;
+    for (const auto *wait : waits) {
+        if (wait->handle == handle) {
+            mask |= (wait->interest & Wait::input ? EPOLLIN : 0u) |
+                    (wait->interest & Wait::output ? EPOLLOUT : 0u);
+        }
+    }
+    auto entry =
+        std::find_if(registered.begin(), registered.end(),
+                     [&](auto &&pair) { return pair.first == handle; });
+    epoll_event event{.events = mask, .data = {.fd = handle}};
+    int res = 0;
+    if (entry == registered.end()) {
+        if (mask) {
+            res = epoll_ctl(epoll, EPOLL_CTL_ADD, handle, &event);
+            registered.emplace_back(handle, mask);
+        }
+    } else if (mask == 0) {
+        // hang up is reported whatever the mask, so unused ones go away
+        res = epoll_ctl(epoll, EPOLL_CTL_DEL, handle, nullptr);
+        registered.erase(entry);
+    } else if (mask != entry->second) {
+        res = epoll_ctl(epoll, EPOLL_CTL_MOD, handle, &event);
+        entry->second = mask;
+    }
+    if (res == -1) {
+        throw ErrnoException("Can't update epoll interest");
+    }
+}
+
+void EventLoop::add(Wait &wait)
+{
+    waits.push_back(&wait);
+    if (wait.interest != Wait::none) {
+        updateInterest(wait.handle);
+    }
+}
+
+#else
+
+EventLoop::EventLoop() : waits{}, spawned{} {}
+
+EventLoop::~EventLoop() = default;
+
+void EventLoop::add(Wait &wait) { waits.push_back(&wait); }
+
+#endif
+
+EventLoop::Wait EventLoop::readable(Handle handle, Deadline deadline) noexcept
+{
+    return {*this, handle, Wait::input, deadline};
+}
+
+EventLoop::Wait EventLoop::writable(Handle handle, Deadline deadline) noexcept
+{
+    return {*this, handle, Wait::output, deadline};
+}
+
+EventLoop::Wait EventLoop::sleepUntil(Deadline deadline) noexcept
+{
+    return {*this, Handle{}, Wait::none, deadline};
+}
+
+void EventLoop::spawn(Task<void> task)
+{
+    task.start();
+    spawned.push_back(std::move(task));
+}
+
+void EventLoop::run()
+{
+    for (;;) {
+        auto finished = std::partition(
+            spawned.begin(), spawned.end(),
+            [](const Task<void> &task) { return !task.done(); });
+        std::vector<Task<void>> results;
+        std::move(finished, spawned.end(), std::back_inserter(results));
+        spawned.erase(finished, spawned.end());
+        for (auto &task : results) {
+            task.result(); // rethrows
+        }
+        if (spawned.empty()) {
+            return;
+        }
+        if (waits.empty()) {
+            throw std::logic_error("Task waits on nothing");
+        }
+        step();
+    }
+}
+
+void EventLoop::step()
+{
+    auto deadline = Deadline::max();
+    for (const auto *wait : waits) {
+        deadline = std::min(deadline, wait->deadline);
+    }
+
+#if defined(__linux__)
+    std::array<epoll_event, 32> events{};
+    int count =
+        epoll_wait(epoll, events.data(), static_cast<int>(events.size()),
+                   timeoutMs(deadline, clock::now()));
+    if (count == -1 && errno != EINTR) {
+        throw ErrnoException("Can't wait on epoll");
+    }
+    for (int i = 0; i < count; ++i) {
+        for (auto *wait : waits) {
+            // hang up without data wakes readers up as not ready
+            if (wait->handle == events[i].data.fd &&
+                (((wait->interest & Wait::input) &&
+                  (events[i].events & EPOLLIN)) ||
+                 ((wait->interest & Wait::output) &&
+                  (events[i].events & (EPOLLOUT | EPOLLERR))))) {
+                wait->ready = true;
+            } else if (wait->handle == events[i].data.fd &&
+                       (events[i].events & (EPOLLHUP | EPOLLERR))) {
+                wait->deadline = Deadline::min();
+            }
+        }
+    }
+#elif !defined(_WIN32)
+    std::vector<pollfd> descriptors;
+    std::vector<Wait *> polled;
+    for (auto *wait : waits) {
+        if (wait->interest != Wait::none) {
+            descriptors.push_back(
+                {.fd = wait->handle,
+                 .events = static_cast<short>(
+                     (wait->interest & Wait::input ? POLLIN : 0) |
+                     (wait->interest & Wait::output ? POLLOUT : 0)),
+                 .revents = 0});
+            polled.push_back(wait);
+        }
+    }
+    int count = poll(descriptors.data(), descriptors.size(),
+                     timeoutMs(deadline, clock::now()));
+    if (count == -1 && errno != EINTR) {
+        throw ErrnoException("Can't poll");
+    }
+    for (size_t i = 0; count > 0 && i < descriptors.size(); ++i) {
+        if (descriptors[i].revents & (POLLIN | POLLOUT)) {
+            polled[i]->ready = true;
+        } else if (descriptors[i].revents & (POLLHUP | POLLERR)) {
+            polled[i]->deadline = Deadline::min();
+        }
+    }
+#else
+    if (deadline != Deadline::max()) {
+        std::this_thread::sleep_until(deadline);
+    }
+#endif
+
+    // resumed ones may wait again, so ready list is taken out first
+    auto now = clock::now();
+    std::vector<Wait *> resumable;
+    std::erase_if(waits, [&](Wait *wait) {
+        if (wait->ready || wait->deadline <= now) {
+            resumable.push_back(wait);
+            return true;
+        }
+        return false;
+    });
+#if defined(__linux__)
+    for (auto *wait : resumable) {
+        if (wait->interest != Wait::none) {
+            updateInterest(wait->handle);
+        }
+    }
+#endif
+    for (auto *wait : resumable) {
+        wait->awaiting.resume();
+    }
+}
+
+} // namespace smp
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "Task.h"
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+namespace smp {
+
+/*
+ * Single thread loop resuming coroutines when their descriptor gets ready
+ * or their deadline passes. epoll on linux, poll on other posix systems.
+ * Windows handles can't be polled, there waits on them are ready at once
+ * and the following io blocks as it did before.
+ */
+class EventLoop final {
+public:
+#ifdef _WIN32
+    using Handle = void *;
+#else
+    using Handle = int;
+#endif
+    using Deadline = std::chrono::steady_clock::time_point;
+
+    // co_await -> true if handle got ready, false on deadline or hang up
+    class Wait final {
+    public:
+        [[nodiscard]] bool await_ready() const noexcept;
+        void await_suspend(std::coroutine_handle<> awaiting);
+        [[nodiscard]] bool await_resume() const noexcept { return ready; }
+
+    private:
+        friend class EventLoop;
+        enum events : uint8_t { none = 0, input = 1 << 0, output = 1 << 1 };
+
+        Wait(EventLoop &loop, Handle handle, events interest,
+             Deadline deadline) noexcept;
+
+        EventLoop &loop;
+        Handle handle;
+        events interest; // none -> plain timer
+        Deadline deadline;
+        std::coroutine_handle<> awaiting;
+        bool ready;
+    };
+
+    EventLoop();
+    EventLoop(const EventLoop &) = delete;
+    EventLoop &operator=(const EventLoop &) = delete;
+
+    [[nodiscard]] Wait readable(Handle handle, Deadline deadline) noexcept;
+    [[nodiscard]] Wait writable(Handle handle, Deadline deadline) noexcept;
+    [[nodiscard]] Wait sleepUntil(Deadline deadline) noexcept;
+
+    // runs concurrently with the rest, till completion in run()
+    void spawn(Task<void> task);
+    // until every spawned task completes, first failure is rethrown
+    void run();
+    // drives the loop until task completes, for synchronous wrappers
+    template <typename T> T wait(Task<T> task);
+
+    ~EventLoop();
+
+private:
+    std::vector<Wait *> waits;
+    std::vector<Task<void>> spawned;
+#if defined(__linux__)
+    int epoll;
+    // registered interest by descriptor, kept in sync with waits
+    std::vector<std::pair<Handle, uint32_t>> registered;
+
+    void updateInterest(Handle handle);
+#endif
+
+    void add(Wait &wait);
+    void step(); // one wait for events, resumes whatever got ready
+};
+
+template <typename T> T EventLoop::wait(Task<T> task)
+{
+    task.start();
+    while (!task.done()) {
+        if (waits.empty()) {
+            throw std::logic_error("Task waits on nothing");
+        }
+        step();
+    }
+    return task.result();
+}
+
+} // namespace smp
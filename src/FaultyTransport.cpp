@@ -0,0 +1,263 @@
+#include "FaultyTransport.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+namespace smp::sim {
+
+namespace {
+
+void checkRate(double rate)
+{
+    if (rate < 0 || rate >= 1) {
+        throw std::logic_error("Fault rate out of [0, 1)");
+    }
+}
+
+} // namespace
+
+FaultInjector::FaultInjector(const FaultProfile &profile, uint32_t seed)
+    : noise{seed}, flips{profile.bitErrorRate, 0},
+      drops{profile.dropRate, 0}, duplicates{profile.duplicateRate, 0},
+      bursts{profile.burstRate, 0}, burstLength{profile.burstLength},
+      burstLeft{}, counters{}
+{
+    for (auto *gap : {&flips, &drops, &duplicates, &bursts}) {
+        checkRate(gap->rate);
+        draw(*gap);
+    }
+}
+
+void FaultInjector::draw(Gap &gap)
+{
+    gap.left = gap.rate > 0
+                   ? std::geometric_distribution<uint64_t>{gap.rate}(noise)
+                   : std::numeric_limits<uint64_t>::max();
+}
+
+bool FaultInjector::hit(Gap &gap)
+{
+    if (gap.left != 0) {
+        gap.left -= 1;
+        return false;
+    }
+    draw(gap);
+    return true;
+}
+
+void FaultInjector::apply(std::span<const uint8_t> bytes,
+                          std::vector<uint8_t> &out)
+{
+    for (auto byte : bytes) {
+        // several flips may hit one byte
+        uint64_t bit = 0;
+        while (flips.left < 8 - bit) {
+            bit += flips.left;
+            byte ^= static_cast<uint8_t>(1u << bit);
+            bit += 1;
+            counters.flippedBits += 1;
+            draw(flips);
+        }
+        flips.left -= 8 - bit;
+
+        if (hit(bursts)) {
+            burstLeft = std::max(burstLeft, burstLength);
+        }
+        if (burstLeft) {
+            byte = static_cast<uint8_t>(noise());
+            burstLeft -= 1;
+            counters.burstBytes += 1;
+        }
+        if (hit(drops)) {
+            counters.droppedBytes += 1;
+            continue;
+        }
+        out.push_back(byte);
+        if (hit(duplicates)) {
+            out.push_back(byte);
+            counters.duplicatedBytes += 1;
+        }
+    }
+}
+
+const FaultStats &FaultInjector::stats() const noexcept { return counters; }
+
+// directions get seeds of their own, faults of one don't shift the other
+FaultyTransport::FaultyTransport(std::unique_ptr<Transport> inner,
+                                 const FaultProfile &profile)
+    : inner{std::move(inner)}, tx{profile, profile.seed},
+      rx{profile, profile.seed ^ 0x5A5A5A5Au}, outgoing{}, outgoingOffset{},
+      incoming{}, incomingOffset{}, lastRelease{}, jitter{profile.jitter},
+      delays{profile.seed}, scratch{}
+{}
+
+bool FaultyTransport::flush()
+{
+    while (outgoingOffset != outgoing.size()) {
+        auto taken = inner->write(outgoing.data() + outgoingOffset,
+                                  static_cast<uint32_t>(outgoing.size() -
+                                                        outgoingOffset));
+        if (taken == 0) {
+            return false;
+        }
+        outgoingOffset += taken;
+    }
+    outgoing.clear();
+    outgoingOffset = 0;
+    return true;
+}
+
+void FaultyTransport::receive()
+{
+    std::array<uint8_t, 4096> buffer{};
+    for (;;) {
+        auto size = inner->read(buffer.data(), buffer.size());
+        if (size == 0) {
+            return;
+        }
+        scratch.clear();
+        rx.apply({buffer.data(), size}, scratch);
+        if (scratch.empty()) {
+            continue;
+        }
+        auto at = clock::now();
+        if (jitter.count()) {
+            at += std::chrono::microseconds{
+                std::uniform_int_distribution<int64_t>{0, jitter.count()}(
+                    delays)};
+        }
+        // a line delays bytes but never reorders them
+        lastRelease = std::max(lastRelease, at);
+        incoming.push_back({lastRelease, scratch});
+    }
+}
+
+bool FaultyTransport::released(clock::time_point now) const noexcept
+{
+    return !incoming.empty() && incoming.front().at <= now;
+}
+
+uint32_t FaultyTransport::read(void *buffer, uint32_t size)
+{
+    receive();
+    auto now = clock::now();
+    uint32_t received = 0;
+    while (received != size && released(now)) {
+        auto &bytes = incoming.front().bytes;
+        auto taken =
+            std::min<size_t>(size - received, bytes.size() - incomingOffset);
+        std::memcpy(static_cast<uint8_t *>(buffer) + received,
+                    bytes.data() + incomingOffset, taken);
+        received += static_cast<uint32_t>(taken);
+        incomingOffset += taken;
+        if (incomingOffset == bytes.size()) {
+            incoming.pop_front();
+            incomingOffset = 0;
+        }
+    }
+    return received;
+}
+
+uint32_t FaultyTransport::write(const void *buffer, uint32_t size)
+{
+    ConstBuffer whole{buffer, size};
+    std::span<ConstBuffer> pending{&whole, 1};
+    return writeSome(pending);
+}
+
+uint32_t FaultyTransport::writeSome(std::span<ConstBuffer> &pending)
+{
+    if (!flush()) {
+        return 0;
+    }
+    uint32_t taken = 0;
+    for (const auto &buffer : pending) {
+        tx.apply({static_cast<const uint8_t *>(buffer.data), buffer.size},
+                 outgoing);
+        taken += buffer.size;
+    }
+    pending = {};
+    flush();
+    return taken;
+}
+
+void FaultyTransport::writeAll(std::initializer_list<ConstBuffer> buffers)
+{
+    for (const auto &buffer : buffers) {
+        tx.apply({static_cast<const uint8_t *>(buffer.data), buffer.size},
+                 outgoing);
+    }
+    inner->writeAll({{outgoing.data() + outgoingOffset,
+                      static_cast<uint32_t>(outgoing.size() -
+                                            outgoingOffset)}});
+    outgoing.clear();
+    outgoingOffset = 0;
+}
+
+Task<bool> FaultyTransport::readable(EventLoop &loop, Deadline deadline)
+{
+    for (;;) {
+        // held back bytes of a request go out before its answer is awaited
+        auto room = co_await writable(loop, deadline);
+        if (!room) {
+            co_return false;
+        }
+        receive();
+        auto now = clock::now();
+        if (released(now)) {
+            co_return true;
+        }
+        if (now >= deadline) {
+            co_return false;
+        }
+        if (!incoming.empty()) {
+            co_await loop.sleepUntil(std::min(incoming.front().at, deadline));
+            continue;
+        }
+        auto ready = co_await inner->readable(loop, deadline);
+        if (!ready) {
+            co_return false;
+        }
+    }
+}
+
+Task<bool> FaultyTransport::writable(EventLoop &loop, Deadline deadline)
+{
+    for (;;) {
+        if (flush()) {
+            co_return true;
+        }
+        auto room = co_await inner->writable(loop, deadline);
+        if (!room) {
+            co_return false;
+        }
+    }
+}
+
+void FaultyTransport::setBaudRate(uint32_t baudRate)
+{
+    if (!flush()) {
+        writeAll({}); // held bytes leave at the old rate
+    }
+    inner->setBaudRate(baudRate);
+}
+
+uint32_t FaultyTransport::traceTrack() const noexcept
+{
+    return inner->traceTrack();
+}
+
+const FaultStats &FaultyTransport::sent() const noexcept
+{
+    return tx.stats();
+}
+
+const FaultStats &FaultyTransport::received() const noexcept
+{
+    return rx.stats();
+}
+
+} // namespace smp::sim
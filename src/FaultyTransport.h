@@ -0,0 +1,118 @@
+#pragma once
+
+#include "EventLoop.h"
+#include "Task.h"
+#include "Transport.h"
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <initializer_list>
+#include <memory>
+#include <random>
+#include <span>
+#include <vector>
+
+namespace smp::sim {
+
+// rates are per byte (bit for bitErrorRate), 0 -> fault is off
+struct FaultProfile final {
+    double bitErrorRate = 0;
+    double dropRate = 0;
+    double duplicateRate = 0;
+    double burstRate = 0;    // bursts starting
+    uint32_t burstLength = 8; // bytes replaced by noise in a burst
+    // received bytes are held up to this long, order is kept
+    std::chrono::microseconds jitter{0};
+    uint32_t seed = 1;
+};
+
+struct FaultStats final {
+    uint64_t flippedBits;
+    uint64_t droppedBytes;
+    uint64_t duplicatedBytes;
+    uint64_t burstBytes;
+};
+
+// faults of one direction, decided per byte of the stream, so the same
+// seed gives the same faults however the stream is split into writes
+class FaultInjector final {
+public:
+    FaultInjector(const FaultProfile &profile, uint32_t seed);
+
+    // appends what survives of bytes to out
+    void apply(std::span<const uint8_t> bytes, std::vector<uint8_t> &out);
+    [[nodiscard]] const FaultStats &stats() const noexcept;
+
+private:
+    // bytes (bits) until the next fault, geometric so not drawn per byte
+    struct Gap {
+        double rate;
+        uint64_t left;
+    };
+
+    void draw(Gap &gap);
+    // true if the fault happens at this byte, counts gap down
+    bool hit(Gap &gap);
+
+    std::mt19937 noise;
+    Gap flips;
+    Gap drops;
+    Gap duplicates;
+    Gap bursts;
+    uint32_t burstLength;
+    uint32_t burstLeft; // bytes of running burst
+    FaultStats counters;
+};
+
+/*
+ * Decorator injecting seeded faults into both directions of another
+ * transport: bit flips, dropped and duplicated bytes, bursts of noise and
+ * jitter of received bytes. Written bytes are taken whole and sent on by
+ * later writes and waits, as a uart's fifo would.
+ */
+class FaultyTransport final : public Transport {
+public:
+    FaultyTransport(std::unique_ptr<Transport> inner,
+                    const FaultProfile &profile);
+
+    uint32_t read(void *buffer, uint32_t size) override;
+    uint32_t write(const void *buffer, uint32_t size) override;
+    uint32_t writeSome(std::span<ConstBuffer> &pending) override;
+    void writeAll(std::initializer_list<ConstBuffer> buffers) override;
+    Task<bool> readable(EventLoop &loop, Deadline deadline) override;
+    Task<bool> writable(EventLoop &loop, Deadline deadline) override;
+    void setBaudRate(uint32_t baudRate) override;
+    [[nodiscard]] uint32_t traceTrack() const noexcept override;
+
+    [[nodiscard]] const FaultStats &sent() const noexcept;
+    [[nodiscard]] const FaultStats &received() const noexcept;
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    // received bytes released to read at `at`
+    struct Held {
+        clock::time_point at;
+        std::vector<uint8_t> bytes;
+    };
+
+    // true if nothing is left to send
+    bool flush();
+    // takes what inner has, faults applied and release time set
+    void receive();
+    [[nodiscard]] bool released(clock::time_point now) const noexcept;
+
+    std::unique_ptr<Transport> inner;
+    FaultInjector tx;
+    FaultInjector rx;
+    std::vector<uint8_t> outgoing; // faulted, not yet taken by inner
+    size_t outgoingOffset;
+    std::deque<Held> incoming;
+    size_t incomingOffset; // into incoming.front()
+    clock::time_point lastRelease;
+    std::chrono::microseconds jitter;
+    std::mt19937 delays;
+    std::vector<uint8_t> scratch;
+};
+
+} // namespace smp::sim
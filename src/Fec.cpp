@@ -0,0 +1,232 @@
+#include "Fec.h"
+#include <algorithm>
+#include <array>
+
+namespace smp::fec {
+
+namespace {
+
+// GF(256) of x^8 + x^4 + x^3 + x^2 + 1, generator 2
+struct Field {
+    std::array<uint8_t, 512> exp; // doubled, products skip the modulo
+    std::array<uint8_t, 256> log;
+};
+
+constexpr Field makeField() noexcept
+{
+    Field field{};
+    uint32_t value = 1;
+    for (size_t i = 0; i < 255; ++i) {
+        field.exp[i] = static_cast<uint8_t>(value);
+        field.log[value] = static_cast<uint8_t>(i);
+        value <<= 1;
+        if (value & 0x100) {
+            value ^= 0x11D;
+        }
+    }
+    for (size_t i = 255; i < field.exp.size(); ++i) {
+        field.exp[i] = field.exp[i - 255];
+    }
+    return field;
+}
+
+constexpr auto field = makeField();
+
+constexpr uint8_t mul(uint8_t a, uint8_t b) noexcept
+{
+    return a && b ? field.exp[field.log[a] + field.log[b]] : 0;
+}
+
+constexpr uint8_t div(uint8_t a, uint8_t b) noexcept
+{
+    return a ? field.exp[field.log[a] + 255 - field.log[b]] : 0;
+}
+
+// alpha^power, negative powers are inverses
+constexpr uint8_t alpha(int power) noexcept
+{
+    return field.exp[static_cast<size_t>((power % 255 + 255) % 255)];
+}
+
+// (x - a^0)(x - a^1)...(x - a^(parity - 1)), highest power first
+constexpr std::array<uint8_t, parityBytes + 1> makeGenerator() noexcept
+{
+    std::array<uint8_t, parityBytes + 1> generator{1};
+    for (size_t root = 0; root < parityBytes; ++root) {
+        auto factor = alpha(static_cast<int>(root));
+        for (size_t i = root + 1; i > 0; --i) {
+            generator[i] ^= mul(generator[i - 1], factor);
+        }
+    }
+    return generator;
+}
+
+constexpr auto generator = makeGenerator();
+
+// codeword is a polynomial with its first byte as the highest power
+uint8_t evaluate(std::span<const uint8_t> codeword, uint8_t x) noexcept
+{
+    uint8_t value = 0;
+    for (auto byte : codeword) {
+        value = mul(value, x) ^ byte;
+    }
+    return value;
+}
+
+// lowest power first from here on
+uint8_t evaluateAscending(std::span<const uint8_t> poly, uint8_t x) noexcept
+{
+    uint8_t value = 0;
+    for (auto it = poly.rbegin(); it != poly.rend(); ++it) {
+        value = mul(value, x) ^ *it;
+    }
+    return value;
+}
+
+// repairs one codeword, returns bytes repaired
+std::optional<uint32_t> correctBlock(std::span<uint8_t> codeword)
+{
+    std::array<uint8_t, parityBytes> syndromes{};
+    bool clean = true;
+    for (size_t i = 0; i < parityBytes; ++i) {
+        syndromes[i] = evaluate(codeword, alpha(static_cast<int>(i)));
+        clean = clean && syndromes[i] == 0;
+    }
+    if (clean) {
+        return 0;
+    }
+
+    // Berlekamp-Massey, locator has roots at inverses of error positions
+    std::array<uint8_t, parityBytes + 1> locator{1};
+    std::array<uint8_t, parityBytes + 1> previous{1};
+    size_t errors = 0;
+    size_t shift = 1;
+    uint8_t previousDiscrepancy = 1;
+    for (size_t n = 0; n < parityBytes; ++n) {
+        uint8_t discrepancy = syndromes[n];
+        for (size_t i = 1; i <= errors; ++i) {
+            discrepancy ^= mul(locator[i], syndromes[n - i]);
+        }
+        if (discrepancy == 0) {
+            shift += 1;
+            continue;
+        }
+        auto scale = div(discrepancy, previousDiscrepancy);
+        auto last = locator;
+        for (size_t i = 0; i + shift < locator.size(); ++i) {
+            locator[i + shift] ^= mul(scale, previous[i]);
+        }
+        if (2 * errors <= n) {
+            errors = n + 1 - errors;
+            previous = last;
+            previousDiscrepancy = discrepancy;
+            shift = 1;
+        } else {
+            shift += 1;
+        }
+    }
+    if (2 * errors > parityBytes) {
+        return std::nullopt;
+    }
+
+    // Chien search over positions of this (maybe shortened) codeword
+    std::array<size_t, parityBytes> positions{};
+    size_t found = 0;
+    const auto length = codeword.size();
+    for (size_t power = 0; power < length && found <= errors; ++power) {
+        if (evaluateAscending({locator.data(), errors + 1},
+                              alpha(-static_cast<int>(power))) == 0) {
+            if (found == errors) {
+                return std::nullopt;
+            }
+            positions[found++] = power;
+        }
+    }
+    if (found != errors) {
+        return std::nullopt;
+    }
+
+    // Forney, evaluator is syndromes * locator mod x^parity
+    std::array<uint8_t, parityBytes> evaluator{};
+    for (size_t i = 0; i < parityBytes; ++i) {
+        for (size_t j = 0; j <= std::min(i, errors); ++j) {
+            evaluator[i] ^= mul(syndromes[i - j], locator[j]);
+        }
+    }
+    for (size_t k = 0; k < found; ++k) {
+        auto inverse = alpha(-static_cast<int>(positions[k]));
+        // formal derivative keeps odd powers only
+        uint8_t derivative = 0;
+        for (size_t i = 1; i <= errors; i += 2) {
+            derivative ^= mul(locator[i],
+                              alpha(-static_cast<int>(positions[k] * (i - 1))));
+        }
+        if (derivative == 0) {
+            return std::nullopt;
+        }
+        auto magnitude =
+            mul(alpha(static_cast<int>(positions[k])),
+                div(evaluateAscending(evaluator, inverse), derivative));
+        codeword[length - 1 - positions[k]] ^= magnitude;
+    }
+
+    for (size_t i = 0; i < parityBytes; ++i) {
+        if (evaluate(codeword, alpha(static_cast<int>(i))) != 0) {
+            return std::nullopt;
+        }
+    }
+    return static_cast<uint32_t>(found);
+}
+
+} // namespace
+
+void encode(std::span<const uint8_t> data, std::vector<uint8_t> &out)
+{
+    out.reserve(out.size() + encodedSize(static_cast<uint32_t>(data.size())));
+    while (!data.empty()) {
+        auto block = data.first(std::min<size_t>(data.size(), blockData));
+        data = data.subspan(block.size());
+        // remainder of block * x^parity divided by generator
+        std::array<uint8_t, parityBytes> parity{};
+        for (auto byte : block) {
+            auto feedback = static_cast<uint8_t>(byte ^ parity[0]);
+            for (size_t i = 0; i + 1 < parityBytes; ++i) {
+                parity[i] = parity[i + 1] ^ mul(feedback, generator[i + 1]);
+            }
+            parity[parityBytes - 1] = mul(feedback, generator[parityBytes]);
+        }
+        out.insert(out.end(), block.begin(), block.end());
+        out.insert(out.end(), parity.begin(), parity.end());
+    }
+}
+
+std::optional<uint32_t> correct(std::span<uint8_t> wire)
+{
+    if (!decodedSize(static_cast<uint32_t>(wire.size()))) {
+        return std::nullopt;
+    }
+    uint32_t repaired = 0;
+    while (!wire.empty()) {
+        auto block = wire.first(
+            std::min<size_t>(wire.size(), blockData + parityBytes));
+        wire = wire.subspan(block.size());
+        auto fixed = correctBlock(block);
+        if (!fixed) {
+            return std::nullopt;
+        }
+        repaired += *fixed;
+    }
+    return repaired;
+}
+
+void strip(std::span<const uint8_t> wire, std::vector<uint8_t> &out)
+{
+    while (wire.size() > parityBytes) {
+        auto block = wire.first(
+            std::min<size_t>(wire.size(), blockData + parityBytes));
+        wire = wire.subspan(block.size());
+        out.insert(out.end(), block.begin(), block.end() - parityBytes);
+    }
+}
+
+} // namespace smp::fec
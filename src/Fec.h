@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace smp::fec {
+
+/*
+ * Reed-Solomon over GF(256) for loading payloads. Payload is cut into blocks
+ * of blockData bytes (the last one shorter), each followed by parityBytes
+ * of parity, which repair up to parityBytes / 2 broken bytes per block
+ * wherever they are. Frame hash covers the encoded bytes, so a repaired
+ * frame passes the same check as an intact one.
+ */
+
+constexpr uint32_t parityBytes = 8;
+constexpr uint32_t blockData = 255 - parityBytes;
+
+[[nodiscard]] constexpr uint32_t encodedSize(uint32_t size) noexcept
+{
+    return size + (size + blockData - 1) / blockData * parityBytes;
+}
+
+// biggest payload whose encoding fits into wire bytes
+[[nodiscard]] constexpr uint32_t capacity(uint32_t wire) noexcept
+{
+    auto rest = wire % (blockData + parityBytes);
+    return wire / (blockData + parityBytes) * blockData +
+           (rest > parityBytes ? rest - parityBytes : 0);
+}
+
+// payload bytes of an encoding wire bytes long, nullopt if there is none
+[[nodiscard]] constexpr std::optional<uint32_t>
+decodedSize(uint32_t wire) noexcept
+{
+    auto rest = wire % (blockData + parityBytes);
+    if (rest != 0 && rest <= parityBytes) {
+        return std::nullopt;
+    }
+    return capacity(wire);
+}
+
+// appends blocks of data followed by their parity to out
+void encode(std::span<const uint8_t> data, std::vector<uint8_t> &out);
+
+// repairs blocks of wire in place, returns bytes repaired, nullopt if some
+// block has more broken bytes than parity can find
+std::optional<uint32_t> correct(std::span<uint8_t> wire);
+
+// appends payload bytes of wire to out, parity is dropped unchecked
+void strip(std::span<const uint8_t> wire, std::vector<uint8_t> &out);
+
+static_assert(encodedSize(blockData) == 255);
+static_assert(capacity(encodedSize(1000)) == 1000);
+static_assert(capacity(encodedSize(blockData + 1)) == blockData + 1);
+static_assert(capacity(255 + parityBytes) == blockData);
+static_assert(!decodedSize(255 + parityBytes));
+
+} // namespace smp::fec
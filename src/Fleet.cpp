@@ -0,0 +1,111 @@
+#include "Fleet.h"
+#include "AsyncChannel.h"
+#include "EventLoop.h"
+#include "Frame.h"
+#include "StatusText.h"
+#include <algorithm>
+
+namespace {
+
+smp::Task<FlashResult> flashOne(smp::EventLoop &loop, const std::string &port,
+                                uint32_t baudRate, smp::BinMsg msg)
+{
+    using clock = std::chrono::steady_clock;
+    FlashResult flash{.port = port,
+                      .result = {},
+                      .succeeded = false,
+                      .elapsed = {}};
+    auto begin = clock::now();
+    try {
+        smp::AsyncChannel channel{loop, port, baudRate};
+        auto localCode = co_await channel.handshake();
+        if (localCode == LocalStatusCode::Ok) {
+            localCode = co_await channel.negotiate();
+        }
+        // opened at the safe rate, upload runs at the fastest one passing
+        if (localCode == LocalStatusCode::Ok) {
+            localCode = co_await channel.negotiateBaud();
+        }
+        smp::WireBuffer<smp::Answer> answer{};
+        // board with this image already is only booted
+        bool upToDate = false;
+        if (localCode == LocalStatusCode::Ok) {
+            auto plan = co_await channel.planDelta(msg);
+            localCode = plan.localCode;
+            upToDate = plan.upToDate;
+        }
+        if (localCode == LocalStatusCode::Ok && !upToDate) {
+            co_await channel.startLoad(msg);
+            auto read = co_await channel.readFrame(answer.data(),
+                                                   answer.size(),
+                                                   smp::action::startLoad);
+            localCode = read.localCode;
+            auto code = smp::decode<smp::Answer>(answer.data()).code;
+            if (localCode == LocalStatusCode::Ok &&
+                code != smp::StatusCode::Ok) {
+                flash.result = codeToStr(code);
+            }
+        }
+        if (localCode == LocalStatusCode::Ok && flash.result.empty() &&
+            !upToDate) {
+            auto [uploadCode, deviceCode] = co_await channel.upload(msg);
+            localCode = uploadCode;
+            if (localCode == LocalStatusCode::Ok &&
+                deviceCode != smp::StatusCode::Ok) {
+                flash.result = codeToStr(deviceCode);
+            }
+        }
+        if (localCode == LocalStatusCode::Ok && flash.result.empty()) {
+            co_await channel.boot();
+            auto read = co_await channel.readFrame(
+                answer.data(), answer.size(), smp::action::boot,
+                clock::now() + smp::bootAnswerTimeout);
+            if (read.localCode == LocalStatusCode::Timeout &&
+                !read.answerSize) {
+                flash.result = "Booted!";
+                flash.succeeded = true;
+            } else if (read.localCode == LocalStatusCode::Ok) {
+                flash.result =
+                    codeToStr(smp::decode<smp::Answer>(answer.data()).code);
+            } else {
+                localCode = read.localCode;
+            }
+        }
+        if (localCode != LocalStatusCode::Ok) {
+            flash.result = localCodeToStr(localCode);
+        }
+    } catch (const std::exception &error) {
+        flash.result = error.what();
+    }
+    flash.elapsed = clock::now() - begin;
+    co_return flash;
+}
+
+} // namespace
+
+std::vector<FlashResult> flashFleet(const std::vector<std::string> &ports,
+                                    uint32_t baudRate, smp::BinMsg &image,
+                                    size_t sessions)
+{
+    image.precomputeHashes();
+
+    // all sessions on one thread, each suspends while its device answers
+    smp::EventLoop loop;
+    std::vector<FlashResult> results(ports.size());
+    size_t nextPort = 0;
+    auto session = [&]() -> smp::Task<void> {
+        while (nextPort < ports.size()) {
+            auto index = nextPort++;
+            results[index] = co_await flashOne(loop, ports[index], baudRate,
+                                               image.share());
+        }
+    };
+
+    sessions = std::clamp<size_t>(sessions, 1, ports.size());
+    for (size_t i = 0; i < sessions; ++i) {
+        loop.spawn(session());
+    }
+    loop.run();
+    image.saveManifest(); // block hashes of sessions included
+    return results;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "BinMsg.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct FlashResult final {
+    std::string port;
+    std::string result;
+    bool succeeded;
+    std::chrono::duration<double> elapsed;
+};
+
+// handshake -> startLoad -> load -> boot on every port, up to sessions
+// ports at once on the calling thread, sessions share one image and its
+// precomputed hashes
+std::vector<FlashResult> flashFleet(const std::vector<std::string> &ports,
+                                    uint32_t baudRate, smp::BinMsg &image,
+                                    size_t sessions);
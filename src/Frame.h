@@ -0,0 +1,262 @@
+#pragma once
+
+#include "Checksum.h"
+#include "Protocol.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <tuple>
+#include <type_traits>
+
+namespace smp {
+
+/*
+ * Frames built and parsed field by field, little endian whatever the host
+ * and without relying on struct packing. Sizes are compile time constants,
+ * so every frame is a fixed array the compiler sees through. A new message
+ * only needs its fields listed in fieldsOf.
+ */
+
+// wire order of message fields, specialised for every message struct
+template <typename T> inline constexpr std::tuple<> fieldsOf{};
+
+template <>
+inline constexpr auto fieldsOf<header> =
+    std::tuple{&header::startWord, &header::packetLength,
+               &header::connectionId, &header::flags, &header::hash};
+template <>
+inline constexpr auto fieldsOf<HandshakeInfo> =
+    std::tuple{&HandshakeInfo::startWord, &HandshakeInfo::packetSize,
+               &HandshakeInfo::id};
+template <>
+inline constexpr auto fieldsOf<LoadMsg> =
+    std::tuple{&LoadMsg::packetId, &LoadMsg::msgHash};
+template <>
+inline constexpr auto fieldsOf<LoadExMsg> =
+    std::tuple{&LoadExMsg::packetId, &LoadExMsg::msgHash, &LoadExMsg::offset,
+               &LoadExMsg::size};
+template <>
+inline constexpr auto fieldsOf<StartLoadMsg> =
+    std::tuple{&StartLoadMsg::wholeMsgSize, &StartLoadMsg::wholeMsgHash};
+template <>
+inline constexpr auto fieldsOf<StartLoadExMsg> =
+    std::tuple{&StartLoadExMsg::wholeMsgSize, &StartLoadExMsg::wholeMsgHash,
+               &StartLoadExMsg::options, &StartLoadExMsg::wireSize};
+template <>
+inline constexpr auto fieldsOf<CapabilitiesMsg> =
+    std::tuple{&CapabilitiesMsg::features, &CapabilitiesMsg::windowSize,
+               &CapabilitiesMsg::reserved};
+template <>
+inline constexpr auto fieldsOf<ResumeInfo> =
+    std::tuple{&ResumeInfo::nextPacketId, &ResumeInfo::offset};
+template <>
+inline constexpr auto fieldsOf<FlashHashesMsg> =
+    std::tuple{&FlashHashesMsg::firstBlock, &FlashHashesMsg::blockCount,
+               &FlashHashesMsg::blockSize};
+template <>
+inline constexpr auto fieldsOf<FlashHashesInfo> =
+    std::tuple{&FlashHashesInfo::imageSize, &FlashHashesInfo::imageHash,
+               &FlashHashesInfo::firstBlock, &FlashHashesInfo::blockCount,
+               &FlashHashesInfo::reserved};
+template <>
+inline constexpr auto fieldsOf<BaudMsg> =
+    std::tuple{&BaudMsg::baudRate, &BaudMsg::confirmTimeoutMs,
+               &BaudMsg::reserved};
+
+template <>
+inline constexpr auto fieldsOf<Answer> =
+    std::tuple{&Answer::header, &Answer::code};
+template <>
+inline constexpr auto fieldsOf<LoadAnswer> =
+    std::tuple{&LoadAnswer::header, &LoadAnswer::code, &LoadAnswer::packetId};
+template <>
+inline constexpr auto fieldsOf<BusyLoadAnswer> =
+    std::tuple{&BusyLoadAnswer::header, &BusyLoadAnswer::code,
+               &BusyLoadAnswer::packetId, &BusyLoadAnswer::retryAfterMs};
+template <>
+inline constexpr auto fieldsOf<CapabilitiesAnswer> =
+    std::tuple{&CapabilitiesAnswer::header, &CapabilitiesAnswer::code,
+               &CapabilitiesAnswer::msg};
+template <>
+inline constexpr auto fieldsOf<FlashHashesAnswer> =
+    std::tuple{&FlashHashesAnswer::header, &FlashHashesAnswer::code,
+               &FlashHashesAnswer::info};
+template <>
+inline constexpr auto fieldsOf<ResumeLoadAnswer> =
+    std::tuple{&ResumeLoadAnswer::header, &ResumeLoadAnswer::code,
+               &ResumeLoadAnswer::info};
+
+template <typename T> struct Codec;
+
+// integers and enums
+template <typename T>
+    requires std::is_integral_v<T> || std::is_enum_v<T>
+struct Codec<T> {
+    using Raw = std::make_unsigned_t<
+        typename std::conditional_t<std::is_enum_v<T>, std::underlying_type<T>,
+                                    std::type_identity<T>>::type>;
+    static constexpr size_t size = sizeof(T);
+
+    static constexpr void write(uint8_t *out, T value) noexcept
+    {
+        auto raw = static_cast<Raw>(value);
+        for (size_t i = 0; i < size; ++i) {
+            out[i] = static_cast<uint8_t>(raw >> (8 * i));
+        }
+    }
+    static constexpr T read(const uint8_t *in) noexcept
+    {
+        Raw raw = 0;
+        for (size_t i = 0; i < size; ++i) {
+            raw |= static_cast<Raw>(static_cast<Raw>(in[i]) << (8 * i));
+        }
+        return static_cast<T>(raw);
+    }
+};
+
+namespace detail {
+
+template <typename Member> struct MemberOf;
+template <typename Class, typename Value> struct MemberOf<Value Class::*> {
+    using type = Value;
+};
+
+template <typename Member>
+using MemberType = typename MemberOf<std::remove_cv_t<Member>>::type;
+
+} // namespace detail
+
+// messages, fields one after another without padding
+template <typename T>
+    requires std::is_class_v<T>
+struct Codec<T> {
+    static_assert(std::tuple_size_v<std::remove_cv_t<decltype(fieldsOf<T>)>> >
+                      0,
+                  "fieldsOf is not specialised for the message");
+
+    static constexpr size_t size = std::apply(
+        [](auto... members) {
+            return (Codec<detail::MemberType<decltype(members)>>::size + ...);
+        },
+        fieldsOf<T>);
+
+    static constexpr void write(uint8_t *out, const T &value) noexcept
+    {
+        std::apply(
+            [&](auto... members) {
+                ((Codec<detail::MemberType<decltype(members)>>::write(
+                      out, value.*members),
+                  out += Codec<detail::MemberType<decltype(members)>>::size),
+                 ...);
+            },
+            fieldsOf<T>);
+    }
+    static constexpr T read(const uint8_t *in) noexcept
+    {
+        T value{};
+        std::apply(
+            [&](auto... members) {
+                ((value.*members =
+                      Codec<detail::MemberType<decltype(members)>>::read(in),
+                  in += Codec<detail::MemberType<decltype(members)>>::size),
+                 ...);
+            },
+            fieldsOf<T>);
+        return value;
+    }
+};
+
+// bit fields have no member pointers, device nibble is the low one
+template <> struct Codec<LedMsg> {
+    static constexpr size_t size = 1;
+
+    static constexpr void write(uint8_t *out, const LedMsg &value) noexcept
+    {
+        out[0] = static_cast<uint8_t>((value.ledDevice & 0xF) |
+                                      (value.op & 0xF) << 4);
+    }
+    static constexpr LedMsg read(const uint8_t *in) noexcept
+    {
+        return {.ledDevice = static_cast<uint8_t>(in[0] & 0xF),
+                .op = static_cast<uint8_t>(in[0] >> 4)};
+    }
+};
+
+template <typename T> inline constexpr uint32_t wireSize = Codec<T>::size;
+
+// header followed by body fields, a payload may follow
+template <typename... Body>
+inline constexpr uint32_t frameSize = (wireSize<header> + ... +
+                                       wireSize<Body>);
+
+template <typename T> using WireBuffer = std::array<uint8_t, wireSize<T>>;
+template <typename... Body>
+using FrameBuffer = std::array<uint8_t, frameSize<Body...>>;
+
+template <typename T> constexpr T decode(const uint8_t *bytes) noexcept
+{
+    return Codec<T>::read(bytes);
+}
+
+/*
+ * Encodes frame into out, packetLength and hash are filled in and cover
+ * payload, which is sent after out without being copied. Hash of header
+ * before its hash field chains over body and payload as the receiver
+ * checks it.
+ */
+template <typename... Body>
+constexpr void writeFrame(std::span<uint8_t, frameSize<Body...>> out,
+                          HashKind kind, header frameHeader,
+                          std::span<const uint8_t> payload,
+                          const Body &...body) noexcept
+{
+    frameHeader.packetLength =
+        frameSize<Body...> + static_cast<uint32_t>(payload.size());
+    frameHeader.hash = 0;
+    auto *at = out.data();
+    Codec<header>::write(at, frameHeader);
+    at += wireSize<header>;
+    ((Codec<Body>::write(at, body), at += wireSize<Body>), ...);
+
+    auto hash = checksum(kind, out.data(), sizeBeforeHashField);
+    hash = checksum(kind, out.data() + wireSize<header>,
+                    frameSize<Body...> - wireSize<header>, hash);
+    if (!payload.empty()) {
+        hash = checksum(kind, payload.data(),
+                        static_cast<uint32_t>(payload.size()), hash);
+    }
+    Codec<uint32_t>::write(out.data() + sizeBeforeHashField, hash);
+}
+
+template <typename... Body>
+constexpr FrameBuffer<Body...> makeFrame(HashKind kind, header frameHeader,
+                                         const Body &...body) noexcept
+{
+    FrameBuffer<Body...> frame{};
+    writeFrame<Body...>(frame, kind, frameHeader, {}, body...);
+    return frame;
+}
+
+// in place layouts of Protocol.h, read so by the simulated firmware
+static_assert(wireSize<header> == sizeof(header));
+static_assert(frameSize<peripheral_devices, LedMsg> == sizeof(LedPacket));
+static_assert(frameSize<LoadMsg> == sizeof(LoadHeader));
+static_assert(frameSize<LoadExMsg> == sizeof(LoadExHeader));
+static_assert(frameSize<StartLoadMsg> == sizeof(StartLoadHeader));
+static_assert(frameSize<StartLoadExMsg> == sizeof(StartLoadExHeader));
+static_assert(frameSize<CapabilitiesMsg> == sizeof(CapabilitiesHeader));
+static_assert(frameSize<FlashHashesMsg> == sizeof(FlashHashesHeader));
+static_assert(frameSize<BaudMsg> == sizeof(BaudHeader));
+static_assert(wireSize<Answer> == sizeof(Answer));
+static_assert(wireSize<LoadAnswer> == sizeof(LoadAnswer));
+static_assert(wireSize<BusyLoadAnswer> == sizeof(BusyLoadAnswer));
+static_assert(wireSize<CapabilitiesAnswer> == sizeof(CapabilitiesAnswer));
+static_assert(wireSize<FlashHashesAnswer> == sizeof(FlashHashesAnswer));
+static_assert(wireSize<ResumeLoadAnswer> == sizeof(ResumeLoadAnswer));
+
+// least significant byte first
+static_assert(decode<uint32_t>(std::array<uint8_t, 4>{1, 2, 3, 4}.data()) ==
+              0x04030201);
+
+} // namespace smp
@@ -0,0 +1,107 @@
+#include "FrameReceiver.h"
+#include "Frame.h"
+#include "Trace.h"
+#include <cstring>
+#include <stdexcept>
+
+namespace smp {
+
+FrameReceiver::FrameReceiver(Transport &port, EventLoop &loop,
+                             size_t capacity)
+    : port{port}, loop{loop}, storage(capacity), begin{}, end{}
+{}
+
+Task<bool> FrameReceiver::seek(uint32_t word, Transport::Deadline deadline)
+{
+    uint8_t pattern[sizeof(word)];
+    Codec<uint32_t>::write(pattern, word); // little endian on the wire
+
+    for (;;) {
+        // memchr is vectorised in libc, candidates are rare in noise
+        auto *cursor = storage.data() + begin;
+        auto *last = storage.data() + end;
+        while (cursor != last) {
+            auto *found = static_cast<uint8_t *>(std::memchr(
+                cursor, pattern[0], static_cast<size_t>(last - cursor)));
+            if (found == nullptr) {
+                cursor = last;
+                break;
+            }
+            if (static_cast<size_t>(last - found) < sizeof(word)) {
+                cursor = found; // may be a split word, keep the tail
+                break;
+            }
+            if (std::memcmp(found, pattern, sizeof(word)) == 0) {
+                begin = static_cast<size_t>(found - storage.data());
+                co_return true;
+            }
+            cursor = found + 1;
+        }
+        begin = static_cast<size_t>(cursor - storage.data());
+        auto received = co_await receive(deadline);
+        if (!received) {
+            co_return false;
+        }
+    }
+}
+
+Task<bool> FrameReceiver::fill(size_t size, Transport::Deadline deadline)
+{
+    if (size > storage.size()) {
+        throw std::logic_error("Frame is bigger than receive buffer");
+    }
+    while (end - begin < size) {
+        if (storage.size() - begin < size) {
+            std::memmove(storage.data(), storage.data() + begin, end - begin);
+            end -= begin;
+            begin = 0;
+        }
+        auto received = co_await receive(deadline);
+        if (!received) {
+            co_return false;
+        }
+    }
+    co_return true;
+}
+
+std::span<const uint8_t> FrameReceiver::data() const noexcept
+{
+    return {storage.data() + begin, end - begin};
+}
+
+void FrameReceiver::consume(size_t size) noexcept
+{
+    begin += size;
+    if (begin == end) {
+        begin = end = 0;
+    }
+}
+
+size_t FrameReceiver::capacity() const noexcept { return storage.size(); }
+
+Task<bool> FrameReceiver::receive(Transport::Deadline deadline)
+{
+    if (begin == end) {
+        begin = end = 0;
+    } else if (end == storage.size()) {
+        std::memmove(storage.data(), storage.data() + begin, end - begin);
+        end -= begin;
+        begin = 0;
+    }
+    // buffered bytes are taken even past deadline
+    for (;;) {
+        auto received = port.read(storage.data() + end,
+                                  static_cast<uint32_t>(storage.size() - end));
+        if (received) {
+            end += received;
+            co_return true;
+        }
+        trace::Span span{"rx wait", port.traceTrack()};
+        auto ready = co_await port.readable(loop, deadline);
+        if (!ready) {
+            co_return false;
+        }
+    }
+}
+
+} // namespace smp
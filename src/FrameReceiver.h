@@ -0,0 +1,41 @@
+#pragma once
+
+#include "EventLoop.h"
+#include "Task.h"
+#include "Transport.h"
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace smp {
+
+/*
+ * Receive buffer over a Transport. Reads whatever is available in big chunks,
+ * buffered bytes stay contiguous so frames are parsed in place. Space is
+ * reclaimed by moving the unparsed tail (usually a partial frame) to front.
+ * Waiting for bytes suspends on the event loop instead of blocking.
+ */
+class FrameReceiver final {
+public:
+    FrameReceiver(Transport &port, EventLoop &loop, size_t capacity);
+
+    // drops bytes until buffer starts with word, false on deadline
+    Task<bool> seek(uint32_t word, Transport::Deadline deadline);
+    // at least size bytes buffered, false on deadline
+    Task<bool> fill(size_t size, Transport::Deadline deadline);
+    [[nodiscard]] std::span<const uint8_t> data() const noexcept;
+    void consume(size_t size) noexcept;
+    [[nodiscard]] size_t capacity() const noexcept;
+
+private:
+    Transport &port;
+    EventLoop &loop;
+    std::vector<uint8_t> storage;
+    size_t begin;
+    size_t end;
+
+    Task<bool> receive(Transport::Deadline deadline);
+};
+
+} // namespace smp
@@ -0,0 +1,309 @@
+#include "ImageFormat.h"
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace smp {
+
+namespace {
+
+// more than any flash the protocol addresses, likely a ram segment
+constexpr uint64_t maxImageSpan = 256 * 1024 * 1024;
+
+constexpr std::array<char, 4> elfMagic{0x7F, 'E', 'L', 'F'};
+
+// contiguous records grow one segment
+class SegmentList final {
+public:
+    void add(uint32_t address, std::span<const uint8_t> bytes)
+    {
+        if (bytes.empty()) {
+            return;
+        }
+        if (segments.empty() ||
+            segments.back().address + uint64_t{segments.back().bytes.size()} !=
+                address) {
+            segments.push_back({address, {}});
+        }
+        auto &last = segments.back().bytes;
+        last.insert(last.end(), bytes.begin(), bytes.end());
+    }
+
+    std::vector<Segment> take() noexcept { return std::move(segments); }
+
+private:
+    std::vector<Segment> segments;
+};
+
+// calls onLine with each line stripped of spaces and its 1 based number,
+// blank lines are skipped
+template <typename OnLine>
+void forEachLine(std::span<const char> content, OnLine &&onLine)
+{
+    std::string_view text{content.data(), content.size()};
+    size_t number = 0;
+    while (!text.empty()) {
+        auto end = text.find('\n');
+        auto line = text.substr(0, end);
+        text = end == std::string_view::npos ? std::string_view{}
+                                             : text.substr(end + 1);
+        number += 1;
+        while (!line.empty() &&
+               std::isspace(static_cast<unsigned char>(line.back()))) {
+            line.remove_suffix(1);
+        }
+        while (!line.empty() &&
+               std::isspace(static_cast<unsigned char>(line.front()))) {
+            line.remove_prefix(1);
+        }
+        if (!line.empty() && !onLine(line, number)) {
+            return;
+        }
+    }
+}
+
+std::optional<uint8_t> hexDigit(char digit) noexcept
+{
+    if (digit >= '0' && digit <= '9') {
+        return static_cast<uint8_t>(digit - '0');
+    }
+    digit = static_cast<char>(std::toupper(static_cast<unsigned char>(digit)));
+    if (digit >= 'A' && digit <= 'F') {
+        return static_cast<uint8_t>(digit - 'A' + 10);
+    }
+    return std::nullopt;
+}
+
+// "0AFF" -> {0x0A, 0xFF}, nullopt if it isn't whole hex bytes
+std::optional<std::vector<uint8_t>> hexBytes(std::string_view text)
+{
+    if (text.size() % 2) {
+        return std::nullopt;
+    }
+    std::vector<uint8_t> bytes;
+    bytes.reserve(text.size() / 2);
+    for (size_t i = 0; i < text.size(); i += 2) {
+        auto high = hexDigit(text[i]);
+        auto low = hexDigit(text[i + 1]);
+        if (!high || !low) {
+            return std::nullopt;
+        }
+        bytes.push_back(static_cast<uint8_t>(*high << 4 | *low));
+    }
+    return bytes;
+}
+
+uint8_t byteSum(std::span<const uint8_t> bytes) noexcept
+{
+    uint8_t sum = 0;
+    for (auto byte : bytes) {
+        sum = static_cast<uint8_t>(sum + byte);
+    }
+    return sum;
+}
+
+// ":LLAAAATT<data>CC", bytes sum to 0 with the checksum
+std::vector<Segment> readIntelHex(std::span<const char> content)
+{
+    SegmentList segments;
+    uint32_t base = 0; // of extended segment or linear address records
+    forEachLine(content, [&](std::string_view line, size_t number) {
+        auto broken = [&] {
+            return std::logic_error("Broken Intel HEX record at line " +
+                                    std::to_string(number));
+        };
+        auto record = line.front() == ':' ? hexBytes(line.substr(1))
+                                          : std::nullopt;
+        if (!record || record->size() < 5 ||
+            record->size() != (*record)[0] + 5u || byteSum(*record) != 0) {
+            throw broken();
+        }
+        const auto &bytes = *record;
+        const uint32_t address = bytes[1] << 8 | bytes[2];
+        std::span<const uint8_t> data{bytes.data() + 4, bytes[0]};
+        switch (bytes[3]) {
+        case 0x00:
+            segments.add(base + address, data);
+            return true;
+        case 0x01: // end of file
+            return false;
+        case 0x02:
+        case 0x04:
+            if (data.size() != 2) {
+                throw broken();
+            }
+            base = static_cast<uint32_t>(data[0] << 8 | data[1])
+                   << (bytes[3] == 0x02 ? 4 : 16);
+            return true;
+        case 0x03:
+        case 0x05: // start address, nothing to flash
+            return true;
+        default:
+            throw broken();
+        }
+    });
+    return segments.take();
+}
+
+// "S<type><count><address><data><checksum>", count covers what follows it,
+// bytes from count on sum to 0xFF with the checksum
+std::vector<Segment> readSRecord(std::span<const char> content)
+{
+    SegmentList segments;
+    forEachLine(content, [&](std::string_view line, size_t number) {
+        auto broken = [&] {
+            return std::logic_error("Broken S-record at line " +
+                                    std::to_string(number));
+        };
+        if (line.size() < 4 || line[0] != 'S' || line[1] < '0' ||
+            line[1] > '9') {
+            throw broken();
+        }
+        const int type = line[1] - '0';
+        static constexpr std::array<size_t, 10> addressSizes{2, 2, 3, 4, 0,
+                                                             2, 3, 4, 3, 2};
+        const auto addressSize = addressSizes[type];
+        auto record = hexBytes(line.substr(2));
+        if (type == 4 || !record || record->size() != (*record)[0] + 1u ||
+            (*record)[0] < addressSize + 1 || byteSum(*record) != 0xFF) {
+            throw broken();
+        }
+        if (type < 1 || type > 3) {
+            return true; // header, count or start address
+        }
+        const auto &bytes = *record;
+        uint32_t address = 0;
+        for (size_t i = 1; i <= addressSize; ++i) {
+            address = address << 8 | bytes[i];
+        }
+        segments.add(address, {bytes.data() + 1 + addressSize,
+                               bytes[0] - addressSize - 1});
+        return true;
+    });
+    return segments.take();
+}
+
+template <typename T>
+T readAt(std::span<const char> content, size_t offset) noexcept
+{
+    T value;
+    std::memcpy(&value, content.data() + offset, sizeof(T));
+    return value;
+}
+
+// loadable program segments by physical address, where initial values of
+// data live in flash, little endian host assumed
+std::vector<Segment> readElf(std::span<const char> content)
+{
+    constexpr size_t headerSize = 52;
+    constexpr size_t programHeaderSize = 32;
+    constexpr uint32_t loadable = 1;
+    if (content.size() < headerSize || content[4] != 1 || content[5] != 1) {
+        throw std::logic_error("Only 32 bit little endian ELF is supported");
+    }
+    const auto headersOffset = readAt<uint32_t>(content, 28);
+    const auto headerStride = readAt<uint16_t>(content, 42);
+    const auto headerCount = readAt<uint16_t>(content, 44);
+    if (headerStride < programHeaderSize ||
+        headersOffset + uint64_t{headerStride} * headerCount >
+            content.size()) {
+        throw std::logic_error("Broken ELF program headers");
+    }
+
+    SegmentList segments;
+    for (size_t i = 0; i < headerCount; ++i) {
+        const size_t header = headersOffset + i * headerStride;
+        const auto offset = readAt<uint32_t>(content, header + 4);
+        const auto address = readAt<uint32_t>(content, header + 12);
+        const auto size = readAt<uint32_t>(content, header + 16);
+        if (readAt<uint32_t>(content, header) != loadable || size == 0) {
+            continue; // bss and the like take no flash
+        }
+        if (offset + uint64_t{size} > content.size()) {
+            throw std::logic_error("Broken ELF program header " +
+                                   std::to_string(i));
+        }
+        segments.add(address,
+                     {reinterpret_cast<const uint8_t *>(content.data()) +
+                          offset,
+                      size});
+    }
+    return segments.take();
+}
+
+} // namespace
+
+ImageFormat imageFormat(const std::filesystem::path &path,
+                        std::span<const char> content) noexcept
+{
+    if (content.size() >= elfMagic.size() &&
+        std::equal(elfMagic.cbegin(), elfMagic.cend(), content.begin())) {
+        return ImageFormat::elf;
+    }
+    auto extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    if (extension == ".hex" || extension == ".ihex" || extension == ".ihx") {
+        return ImageFormat::intelHex;
+    }
+    if (extension == ".srec" || extension == ".s19" || extension == ".s28" ||
+        extension == ".s37" || extension == ".mot") {
+        return ImageFormat::sRecord;
+    }
+    return ImageFormat::binary;
+}
+
+std::vector<Segment> readSegments(ImageFormat format,
+                                  std::span<const char> content)
+{
+    switch (format) {
+    case ImageFormat::intelHex:
+        return readIntelHex(content);
+    case ImageFormat::sRecord:
+        return readSRecord(content);
+    case ImageFormat::elf:
+        return readElf(content);
+    case ImageFormat::binary:
+        break;
+    }
+    return {};
+}
+
+FlatImage flatten(std::vector<Segment> segments)
+{
+    if (segments.empty()) {
+        return {};
+    }
+    std::sort(segments.begin(), segments.end(),
+              [](const Segment &lhs, const Segment &rhs) {
+                  return lhs.address < rhs.address;
+              });
+    uint64_t end = 0;
+    for (const auto &segment : segments) {
+        if (segment.address < end) {
+            throw std::logic_error("Image segments overlap at address " +
+                                   std::to_string(segment.address));
+        }
+        end = segment.address + uint64_t{segment.bytes.size()};
+    }
+    const auto base = segments.front().address;
+    if (end - base > maxImageSpan) {
+        throw std::logic_error("Image segments span too much to flash");
+    }
+
+    FlatImage flat{.baseAddress = base,
+                   .bytes = std::vector<char>(end - base,
+                                              static_cast<char>(erasedByte))};
+    for (const auto &segment : segments) {
+        std::copy(segment.bytes.cbegin(), segment.bytes.cend(),
+                  flat.bytes.begin() + (segment.address - base));
+    }
+    return flat;
+}
+
+} // namespace smp
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <vector>
+
+namespace smp {
+
+enum class ImageFormat { binary, intelHex, sRecord, elf };
+
+// bytes placed at address by an image file
+struct Segment final {
+    uint32_t address;
+    std::vector<uint8_t> bytes;
+};
+
+// image as flashed, from the lowest segment address to the end of the
+// highest segment, bytes no segment covers are erased
+struct FlatImage final {
+    uint32_t baseAddress;
+    std::vector<char> bytes;
+};
+
+// flash holds this in bytes nothing was written to
+constexpr uint8_t erasedByte = 0xFF;
+
+// ELF by its magic, hex and S-record files by extension, binary otherwise
+[[nodiscard]] ImageFormat imageFormat(const std::filesystem::path &path,
+                                      std::span<const char> content) noexcept;
+
+// throws logic_error naming the broken record, binary has no segments
+std::vector<Segment> readSegments(ImageFormat format,
+                                  std::span<const char> content);
+
+// throws logic_error if segments overlap or span too much to hold
+FlatImage flatten(std::vector<Segment> segments);
+
+} // namespace smp
@@ -0,0 +1,123 @@
+#include "ImageManifest.h"
+#include <fstream>
+#include <string>
+#include <system_error>
+
+namespace smp {
+
+namespace {
+
+constexpr std::string_view magic = "smp-manifest-2";
+
+std::filesystem::path manifestPath(const std::filesystem::path &image)
+{
+    auto path = image;
+    path += ".manifest";
+    return path;
+}
+
+} // namespace
+
+std::optional<ImageManifest>
+ImageManifest::of(const std::filesystem::path &image)
+{
+    ImageManifest manifest{};
+    std::error_code error;
+    manifest.size = std::filesystem::file_size(image, error);
+    if (error) {
+        return std::nullopt;
+    }
+    auto modified = std::filesystem::last_write_time(image, error);
+    if (error) {
+        return std::nullopt;
+    }
+    manifest.modified = modified.time_since_epoch().count();
+
+    std::ifstream in(manifestPath(image));
+    std::string word;
+    uint64_t size{};
+    int64_t keptModified{};
+    uint64_t imageSize{};
+    if (!(in >> word >> size >> keptModified >> imageSize) || word != magic ||
+        size != manifest.size || keptModified != manifest.modified) {
+        return manifest;
+    }
+
+    // "hash <kind> <hex>" and "blocks <kind> <size> <count> <hex>..." lines,
+    // a broken tail only loses what follows it
+    ImageManifest kept{manifest};
+    kept.imageSize = imageSize;
+    unsigned kind{};
+    while (in >> word >> kind && kind < kept.hashes.size()) {
+        if (word == "hash") {
+            uint32_t hash{};
+            if (!(in >> std::hex >> hash >> std::dec)) {
+                break;
+            }
+            kept.hashes[kind] = hash;
+        } else if (word == "blocks") {
+            Blocks blocks{.kind = static_cast<HashKind>(kind),
+                          .blockSize = 0,
+                          .hashes = {}};
+            uint32_t count{};
+            if (!(in >> blocks.blockSize >> count) || blocks.blockSize == 0 ||
+                count != (imageSize + blocks.blockSize - 1) /
+                             blocks.blockSize) {
+                break;
+            }
+            blocks.hashes.resize(count);
+            in >> std::hex;
+            for (auto &hash : blocks.hashes) {
+                in >> hash;
+            }
+            in >> std::dec;
+            if (!in) {
+                break;
+            }
+            kept.blocks.push_back(std::move(blocks));
+        } else {
+            break;
+        }
+    }
+    return kept;
+}
+
+bool ImageManifest::write(const std::filesystem::path &image) const noexcept
+{
+    try {
+        auto path = manifestPath(image);
+        auto temp = path;
+        temp += ".tmp";
+        {
+            std::ofstream out(temp, std::ios::trunc);
+            out << magic << ' ' << size << ' ' << modified << ' '
+                << imageSize << '\n';
+            for (size_t kind = 0; kind < hashes.size(); ++kind) {
+                if (hashes[kind]) {
+                    out << "hash " << kind << ' ' << std::hex << *hashes[kind]
+                        << std::dec << '\n';
+                }
+            }
+            for (const auto &entry : blocks) {
+                out << "blocks " << static_cast<unsigned>(entry.kind) << ' '
+                    << entry.blockSize << ' ' << entry.hashes.size()
+                    << std::hex;
+                for (auto hash : entry.hashes) {
+                    out << ' ' << hash;
+                }
+                out << std::dec << '\n';
+            }
+            out.flush();
+            if (!out) {
+                return false;
+            }
+        }
+        std::error_code error;
+        std::filesystem::rename(temp, path, error);
+        return !error;
+    } catch (const std::exception &) {
+        return false;
+    }
+}
+
+} // namespace smp
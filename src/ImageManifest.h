@@ -0,0 +1,41 @@
+#pragma once
+
+#include "Checksum.h"
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <vector>
+
+namespace smp {
+
+/*
+ * Hashes of an image file kept next to it as <image>.manifest, so loading
+ * the same file again needs no hash pass over it. Valid while file size and
+ * modification time match, anything else is dropped and recomputed.
+ * Hashes cover the image as uploaded, for segment formats that is the
+ * flattened buffer, whose length is kept as imageSize.
+ */
+struct ImageManifest final {
+    // per block hashes of the image, as flashHashes compares them
+    struct Blocks final {
+        HashKind kind;
+        uint32_t blockSize;
+        std::vector<uint32_t> hashes;
+    };
+
+    uint64_t size;
+    int64_t modified; // last write time ticks of the file
+    uint64_t imageSize; // bytes hashed, 0 until the image was read
+    std::array<std::optional<uint32_t>, 2> hashes; // by HashKind
+    std::vector<Blocks> blocks;
+
+    // manifest of the file in its current state, without hashes if none
+    // was kept, nullopt if the file can't be inspected
+    static std::optional<ImageManifest>
+    of(const std::filesystem::path &image);
+    // best effort, false if it wasn't written
+    bool write(const std::filesystem::path &image) const noexcept;
+};
+
+} // namespace smp
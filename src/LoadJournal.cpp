@@ -0,0 +1,51 @@
+#include "LoadJournal.h"
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <utility>
+
+LoadJournal::LoadJournal(std::filesystem::path path) : path{std::move(path)}
+{}
+
+std::optional<JournalEntry> LoadJournal::read() const
+{
+    std::ifstream in(path);
+    JournalEntry entry{};
+    // port on its own line, names may hold spaces
+    if (std::getline(in, entry.port) && !entry.port.empty() &&
+        in >> entry.imageSize >> std::hex >> entry.imageHash >> std::dec >>
+            entry.ackedBytes) {
+        return entry;
+    }
+    return std::nullopt;
+}
+
+bool LoadJournal::write(const JournalEntry &entry) const noexcept
+{
+    try {
+        auto temp = path;
+        temp += ".tmp";
+        {
+            std::ofstream out(temp, std::ios::trunc);
+            out << entry.port << '\n'
+                << entry.imageSize << '\n'
+                << std::hex << entry.imageHash << '\n'
+                << std::dec << entry.ackedBytes << '\n';
+            out.flush();
+            if (!out) {
+                return false;
+            }
+        }
+        std::error_code error;
+        std::filesystem::rename(temp, path, error);
+        return !error;
+    } catch (const std::exception &) {
+        return false;
+    }
+}
+
+void LoadJournal::remove() const noexcept
+{
+    std::error_code error;
+    std::filesystem::remove(path, error);
+}
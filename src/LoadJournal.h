@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+
+// progress of an unfinished load, enough to ask the device to resume it
+struct JournalEntry final {
+    std::string port;
+    uint32_t imageSize;
+    uint32_t imageHash; // of the negotiated hash kind, as startLoad sent it
+    uint32_t ackedBytes;
+};
+
+// one small text file next to the image, rewritten through a temp file so
+// a crash leaves either the old entry or the new one
+class LoadJournal final {
+public:
+    explicit LoadJournal(std::filesystem::path path);
+
+    // nullopt if there is none or it can't be parsed
+    [[nodiscard]] std::optional<JournalEntry> read() const;
+    // best effort, false if it wasn't written
+    bool write(const JournalEntry &entry) const noexcept;
+    void remove() const noexcept;
+
+private:
+    std::filesystem::path path;
+};
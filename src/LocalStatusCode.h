@@ -11,4 +11,7 @@ enum class LocalStatusCode {
     NothingToWrite,
     LoadAnswerNotEqual,
     Timeout,
+    WrongLength,
+    BaudRejected,
+    LinkTestFailed,
 };
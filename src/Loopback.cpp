@@ -0,0 +1,130 @@
+#include "Loopback.h"
+#include "Trace.h"
+#include <algorithm>
+#include <cstring>
+
+namespace smp::sim {
+
+Loopback::Loopback(const DeviceConfig &config, LinkModel link)
+    : simulated{config}, link{link}, toDevice{}, toHost{}, readOffset{},
+      txEnd{}, rxEnd{}, answers{}, track{trace::track("loopback")}
+{}
+
+Loopback::clock::time_point Loopback::transfer(clock::time_point &end,
+                                               clock::time_point sent,
+                                               size_t size) const noexcept
+{
+    end = std::max(end, sent);
+    if (link.bytesPerSecond) {
+        end += std::chrono::duration_cast<clock::duration>(
+            std::chrono::nanoseconds{size * 1'000'000'000ull /
+                                     link.bytesPerSecond});
+    }
+    return end + link.latency;
+}
+
+void Loopback::deliver(clock::time_point now)
+{
+    simulated.tick(now);
+    while (!toDevice.empty() && toDevice.front().at <= now) {
+        auto arrived = toDevice.front().at;
+        answers.clear();
+        simulated.receive(toDevice.front().bytes.data(),
+                          toDevice.front().bytes.size(), answers);
+        toDevice.pop_front();
+        if (!answers.empty()) {
+            // answered on arrival, however late this is called
+            toHost.push_back(
+                {transfer(rxEnd, arrived, answers.size()), answers});
+        }
+    }
+}
+
+uint32_t Loopback::read(void *buffer, uint32_t size)
+{
+    auto now = clock::now();
+    deliver(now);
+    uint32_t received = 0;
+    while (received != size && !toHost.empty() && toHost.front().at <= now) {
+        auto &bytes = toHost.front().bytes;
+        auto taken = std::min<size_t>(size - received,
+                                      bytes.size() - readOffset);
+        std::memcpy(static_cast<uint8_t *>(buffer) + received,
+                    bytes.data() + readOffset, taken);
+        received += static_cast<uint32_t>(taken);
+        readOffset += taken;
+        if (readOffset == bytes.size()) {
+            toHost.pop_front();
+            readOffset = 0;
+        }
+    }
+    return received;
+}
+
+uint32_t Loopback::write(const void *buffer, uint32_t size)
+{
+    ConstBuffer whole{buffer, size};
+    std::span<ConstBuffer> pending{&whole, 1};
+    return writeSome(pending);
+}
+
+uint32_t Loopback::writeSome(std::span<ConstBuffer> &pending)
+{
+    std::vector<uint8_t> bytes;
+    for (const auto &buffer : pending) {
+        auto *data = static_cast<const uint8_t *>(buffer.data);
+        bytes.insert(bytes.end(), data, data + buffer.size);
+    }
+    pending = {};
+    if (bytes.empty()) {
+        return 0;
+    }
+    auto size = static_cast<uint32_t>(bytes.size());
+    auto now = clock::now();
+    toDevice.push_back({transfer(txEnd, now, bytes.size()), std::move(bytes)});
+    deliver(now);
+    return size;
+}
+
+void Loopback::writeAll(std::initializer_list<ConstBuffer> buffers)
+{
+    std::vector<ConstBuffer> copy{buffers};
+    std::span<ConstBuffer> pending{copy};
+    writeSome(pending);
+}
+
+Task<bool> Loopback::readable(EventLoop &loop, Deadline deadline)
+{
+    for (;;) {
+        auto now = clock::now();
+        deliver(now);
+        if (!toHost.empty() && toHost.front().at <= now) {
+            co_return true;
+        }
+        auto wakeUp = deadline;
+        if (!toDevice.empty()) {
+            wakeUp = std::min(wakeUp, toDevice.front().at);
+        }
+        if (!toHost.empty()) {
+            wakeUp = std::min(wakeUp, toHost.front().at);
+        }
+        // device only talks when talked to, nothing on the way -> silence
+        if (now >= deadline || wakeUp == Deadline::max()) {
+            co_return false;
+        }
+        co_await loop.sleepUntil(wakeUp);
+    }
+}
+
+Task<bool> Loopback::writable(EventLoop &, Deadline) { co_return true; }
+
+void Loopback::setBaudRate(uint32_t baudRate)
+{
+    trace::instant("set baud", track, "rate", baudRate);
+}
+
+uint32_t Loopback::traceTrack() const noexcept { return track; }
+
+const Device &Loopback::device() const noexcept { return simulated; }
+
+} // namespace smp::sim
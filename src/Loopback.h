@@ -0,0 +1,73 @@
+#pragma once
+
+#include "Device.h"
+#include "EventLoop.h"
+#include "Task.h"
+#include "Transport.h"
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <initializer_list>
+#include <span>
+#include <vector>
+
+namespace smp::sim {
+
+// both ways alike
+struct LinkModel final {
+    uint32_t bytesPerSecond = 0; // 0 -> unlimited
+    std::chrono::nanoseconds latency{0};
+};
+
+/*
+ * Device in the client's own process. Written bytes reach it when they
+ * would have crossed the link, answers come back the same way. There are
+ * no descriptors and no threads: waiting for the link is a timer on the
+ * channel's loop, on an unlimited link with no latency nothing waits and
+ * no system call is made, what is left to profile is the protocol itself.
+ */
+class Loopback final : public Transport {
+public:
+    Loopback(const DeviceConfig &config, LinkModel link);
+
+    uint32_t read(void *buffer, uint32_t size) override;
+    uint32_t write(const void *buffer, uint32_t size) override;
+    // takes everything, link has no buffer limit
+    uint32_t writeSome(std::span<ConstBuffer> &pending) override;
+    void writeAll(std::initializer_list<ConstBuffer> buffers) override;
+    Task<bool> readable(EventLoop &loop, Deadline deadline) override;
+    Task<bool> writable(EventLoop &loop, Deadline deadline) override;
+    // link speed is set by LinkModel, rate is only traced
+    void setBaudRate(uint32_t baudRate) override;
+    [[nodiscard]] uint32_t traceTrack() const noexcept override;
+
+    [[nodiscard]] const Device &device() const noexcept;
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    // bytes on the link, arriving at `at`
+    struct Chunk {
+        clock::time_point at;
+        std::vector<uint8_t> bytes;
+    };
+
+    // link busy till end, returns arrival time of size bytes sent now
+    [[nodiscard]] clock::time_point transfer(clock::time_point &end,
+                                             clock::time_point sent,
+                                             size_t size) const noexcept;
+    // hands arrived bytes to device, schedules its answers
+    void deliver(clock::time_point now);
+
+    Device simulated;
+    LinkModel link;
+    std::deque<Chunk> toDevice;
+    std::deque<Chunk> toHost;
+    size_t readOffset; // into toHost.front()
+    clock::time_point txEnd;
+    clock::time_point rxEnd;
+    std::vector<uint8_t> answers;
+    uint32_t track;
+};
+
+} // namespace smp::sim
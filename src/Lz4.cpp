@@ -0,0 +1,187 @@
+#include "Lz4.h"
+#include <array>
+#include <cstring>
+
+namespace smp {
+
+namespace {
+
+constexpr size_t minMatch = 4;
+constexpr size_t lastLiterals = 5;     // block always ends with literals
+constexpr size_t matchStartLimit = 12; // no match starts closer to the end
+constexpr size_t maxOffset = 0xFFFF;
+constexpr int hashBits = 12;
+
+uint32_t load32(const uint8_t *data) noexcept
+{
+    uint32_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+uint32_t hashOf(uint32_t sequence) noexcept
+{
+    return (sequence * 2654435761u) >> (32 - hashBits);
+}
+
+class Writer final {
+public:
+    explicit Writer(std::span<uint8_t> dst) noexcept
+        : dst{dst}, size{}, overflow{}
+    {}
+
+    void byte(uint8_t value) noexcept
+    {
+        if (size == dst.size()) {
+            overflow = true;
+            return;
+        }
+        dst[size++] = value;
+    }
+
+    void bytes(const uint8_t *data, size_t count) noexcept
+    {
+        if (count > dst.size() - size) {
+            overflow = true;
+            return;
+        }
+        std::memcpy(dst.data() + size, data, count);
+        size += count;
+    }
+
+    // continuation of a length that didn't fit in the token nibble
+    void length(size_t value) noexcept
+    {
+        if (value < 15) {
+            return;
+        }
+        for (value -= 15; value >= 255; value -= 255) {
+            byte(255);
+        }
+        byte(static_cast<uint8_t>(value));
+    }
+
+    [[nodiscard]] size_t written() const noexcept
+    {
+        return overflow ? 0 : size;
+    }
+
+private:
+    std::span<uint8_t> dst;
+    size_t size;
+    bool overflow;
+};
+
+uint8_t nibble(size_t value) noexcept
+{
+    return static_cast<uint8_t>(value < 15 ? value : 15);
+}
+
+bool readLength(std::span<const uint8_t> src, size_t &in,
+                size_t &value) noexcept
+{
+    if (value != 15) {
+        return true;
+    }
+    uint8_t extra;
+    do {
+        if (in == src.size()) {
+            return false;
+        }
+        extra = src[in++];
+        value += extra;
+    } while (extra == 255);
+    return true;
+}
+
+} // namespace
+
+size_t lz4Compress(std::span<const uint8_t> src,
+                   std::span<uint8_t> dst) noexcept
+{
+    std::array<uint32_t, 1 << hashBits> table{};
+    Writer out{dst};
+    const uint8_t *data = src.data();
+    size_t anchor = 0;
+
+    for (size_t position = 0; position + matchStartLimit <= src.size();) {
+        auto sequence = load32(data + position);
+        auto &slot = table[hashOf(sequence)];
+        size_t candidate = slot;
+        slot = static_cast<uint32_t>(position);
+        if (candidate >= position || position - candidate > maxOffset ||
+            load32(data + candidate) != sequence) {
+            position += 1;
+            continue;
+        }
+
+        size_t matchLength = minMatch;
+        while (position + matchLength < src.size() - lastLiterals &&
+               data[candidate + matchLength] == data[position + matchLength]) {
+            matchLength += 1;
+        }
+
+        size_t literals = position - anchor;
+        out.byte(static_cast<uint8_t>(nibble(literals) << 4 |
+                                      nibble(matchLength - minMatch)));
+        out.length(literals);
+        out.bytes(data + anchor, literals);
+        auto offset = static_cast<uint16_t>(position - candidate);
+        out.byte(static_cast<uint8_t>(offset & 0xFF));
+        out.byte(static_cast<uint8_t>(offset >> 8));
+        out.length(matchLength - minMatch);
+
+        position += matchLength;
+        anchor = position;
+    }
+
+    size_t literals = src.size() - anchor;
+    out.byte(static_cast<uint8_t>(nibble(literals) << 4));
+    out.length(literals);
+    out.bytes(data + anchor, literals);
+    return out.written();
+}
+
+bool lz4Decompress(std::span<const uint8_t> src,
+                   std::span<uint8_t> dst) noexcept
+{
+    size_t in = 0;
+    size_t out = 0;
+    while (in < src.size()) {
+        auto token = src[in++];
+
+        size_t literals = token >> 4;
+        if (!readLength(src, in, literals) || literals > src.size() - in ||
+            literals > dst.size() - out) {
+            return false;
+        }
+        std::memcpy(dst.data() + out, src.data() + in, literals);
+        in += literals;
+        out += literals;
+        if (in == src.size()) {
+            return out == dst.size(); // last sequence has no match
+        }
+
+        if (src.size() - in < 2) {
+            return false;
+        }
+        size_t offset = src[in] | static_cast<size_t>(src[in + 1]) << 8;
+        in += 2;
+        size_t matchLength = token & 0xF;
+        if (offset == 0 || offset > out ||
+            !readLength(src, in, matchLength)) {
+            return false;
+        }
+        matchLength += minMatch;
+        if (matchLength > dst.size() - out) {
+            return false;
+        }
+        // byte by byte, match may overlap its own output
+        for (size_t i = 0; i < matchLength; ++i, ++out) {
+            dst[out] = dst[out - offset];
+        }
+    }
+    return false;
+}
+
+} // namespace smp
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+// LZ4 block format, no frame header, decoder needs no memory but output
+namespace smp {
+
+// 0 if output doesn't fit in dst
+size_t lz4Compress(std::span<const uint8_t> src,
+                   std::span<uint8_t> dst) noexcept;
+// false on malformed input or if it doesn't decode to exactly dst.size()
+bool lz4Decompress(std::span<const uint8_t> src,
+                   std::span<uint8_t> dst) noexcept;
+
+} // namespace smp
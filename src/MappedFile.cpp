@@ -0,0 +1,75 @@
+#include "MappedFile.h"
+#include "ErrnoException.h"
+#include <utility>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile() noexcept : address{nullptr}, size{} {}
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::filesystem::path &)
+    : address{nullptr}, size{}
+{
+    throw std::logic_error("File mapping not implemented");
+}
+
+MappedFile::~MappedFile() = default;
+
+#else
+
+MappedFile::MappedFile(const std::filesystem::path &path)
+    : address{nullptr}, size{}
+{
+    int descriptor = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (descriptor == -1) {
+        throw ErrnoException("Can't open file for mapping");
+    }
+    struct stat status {};
+    if (fstat(descriptor, &status) == -1 || status.st_size <= 0) {
+        close(descriptor);
+        throw std::logic_error("Can't map empty or unknown sized file");
+    }
+    auto length = static_cast<size_t>(status.st_size);
+    void *mapping =
+        mmap(nullptr, length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    close(descriptor); // mapping keeps file referenced
+    if (mapping == MAP_FAILED) {
+        throw ErrnoException("Can't map file");
+    }
+    // frames are sent front to back, let kernel read ahead aggressively
+    madvise(mapping, length, MADV_SEQUENTIAL);
+    address = mapping;
+    size = length;
+}
+
+MappedFile::~MappedFile()
+{
+    if (address != nullptr) {
+        munmap(address, size);
+    }
+}
+
+#endif
+
+MappedFile::MappedFile(MappedFile &&rhs) noexcept
+    : address{std::exchange(rhs.address, nullptr)},
+      size{std::exchange(rhs.size, 0)}
+{}
+
+MappedFile &MappedFile::operator=(MappedFile &&rhs) noexcept
+{
+    std::swap(address, rhs.address);
+    std::swap(size, rhs.size);
+    return *this;
+}
+
+std::span<const char> MappedFile::view() const noexcept
+{
+    return {static_cast<const char *>(address), size};
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <span>
+
+// read-only file mapping, pages are faulted in sequentially on access
+class MappedFile final {
+public:
+    MappedFile() noexcept;
+    // throws if file can't be mapped, empty files included
+    explicit MappedFile(const std::filesystem::path &path);
+    MappedFile(MappedFile &&rhs) noexcept;
+    MappedFile &operator=(MappedFile &&rhs) noexcept;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    [[nodiscard]] std::span<const char> view() const noexcept;
+
+    ~MappedFile();
+
+private:
+    void *address;
+    size_t size;
+};
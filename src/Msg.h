@@ -10,11 +10,26 @@ enum led_ops : uint8_t { ON, OFF, TOGGLE };
  * Led msg: uint8_t number (0xFF -> all), led_ops
  */
 
+// handshake answer, follows the echoed handshake bytes
+struct HandshakeInfo {
+    uint32_t startWord;   // of every following frame
+    uint16_t packetSize;  // biggest frame device takes
+    uint16_t id;          // connectionId of following frames
+};
+
 struct LoadMsg {
     uint32_t packetId;
     uint32_t msgHash;
 };
 
+// loading frame of offsetFrames load, payload covers [offset, offset + size)
+struct LoadExMsg {
+    uint32_t packetId; // sequential, acks and retransmits refer to it
+    uint32_t msgHash;
+    uint32_t offset; // from image start, the lowest address of its segments
+    uint32_t size;   // raw bytes, payload may be compressed
+};
+
 struct LedMsg {
     uint8_t ledDevice : 4;
     uint8_t op : 4;
@@ -25,8 +40,108 @@ struct StartLoadMsg{
     uint32_t wholeMsgHash;
 };
 
+/*
+ * Optional features, client asks for a set, device answers with the subset it
+ * supports. Firmware without capabilities action answers NoSuchCommand.
+ */
+enum capability : uint32_t {
+    windowedLoad = 1 << 0,   // several loading frames in flight, acks with id
+    crc32cHash = 1 << 1,     // crc32c instead of djb2 after capabilities
+    deltaLoad = 1 << 2,      // flashHashes, extended startLoad and endLoad
+    compressedLoad = 1 << 3, // loading payload may be lz4 block, see flags
+    baudSwitch = 1 << 4,     // setBaud and linkTest
+    offsetLoad = 1 << 5,     // loading frames carry offset, any payload size
+    resumableLoad = 1 << 6,  // resumeLoad, unfinished load survives reconnect
+    busyHint = 1 << 7,       // busy loading answers say when to retry
+    fecLoad = 1 << 8,        // loading payloads may carry reed-solomon parity
+    sparseLoad = 1 << 9,     // fill frames stand for runs of one byte
+};
+
+struct CapabilitiesMsg {
+    uint32_t features;
+    uint16_t windowSize; // loading frames in flight, 1 -> stop-and-wait
+    uint16_t reserved;
+};
+
+/*
+ * Extended startLoad, sent instead of StartLoadMsg only if an option needs it.
+ * deltaImage -> staging starts as a copy of current flash, only changed
+ * packets are sent and endLoad asks for the whole image check.
+ * compressed -> some loading payloads are lz4 blocks of their packet bytes.
+ * offsetFrames -> loading frames are LoadExMsg, packetId only names a frame.
+ * fecPayload -> offsetFrames only, every loading payload is followed by
+ * parity as in fec::encode, device repairs a frame whose hash fails.
+ * fillFrames -> offsetFrames only, loading frames may be fill frames, whose
+ * one byte payload fills [offset, offset + size), so gaps between image
+ * segments and erased runs cost a frame each.
+ */
+enum loadOption : uint32_t {
+    deltaImage = 1 << 0,
+    compressed = 1 << 1,
+    offsetFrames = 1 << 2,
+    fecPayload = 1 << 3,
+    fillFrames = 1 << 4,
+};
+
+struct StartLoadExMsg {
+    uint32_t wholeMsgSize; // raw image
+    uint32_t wholeMsgHash; // of raw image
+    uint32_t options;
+    uint32_t wireSize; // loading payloads to be sent, compressed or raw,
+                       // parity not counted
+};
+
+/*
+ * Answer to resumeLoad, whose request is StartLoadExMsg of the unfinished
+ * load. Ok only if device still stages an image of the same size, hash and
+ * options, loading goes on from here and bytes before offset are kept.
+ * Otherwise WaitStartLoad and a new startLoad is needed.
+ */
+struct ResumeInfo {
+    uint32_t nextPacketId; // first missing packet, next new id of offsetFrames
+    uint32_t offset;       // bytes before it have all arrived
+};
+
+/*
+ * Hashes of current flash content by blocks of blockSize bytes, block i
+ * covers the same bytes as loading packet i when blockSize is packet payload.
+ * Answer is FlashHashesInfo followed by blockCount uint32_t hashes, count is
+ * cut at the end of flash and by device packet size.
+ */
+struct FlashHashesMsg {
+    uint32_t firstBlock;
+    uint16_t blockCount;
+    uint16_t blockSize;
+};
+
+struct FlashHashesInfo {
+    uint32_t imageSize; // 0 -> nothing loaded
+    uint32_t imageHash;
+    uint32_t firstBlock;
+    uint16_t blockCount;
+    uint16_t reserved;
+};
+
+/*
+ * Device answers at the current rate and switches to baudRate. Unless a
+ * linkTest frame arrives at the new rate within confirmTimeoutMs, it falls
+ * back to the previous rate. linkTest payload is echoed after the status.
+ */
+struct BaudMsg {
+    uint32_t baudRate;
+    uint16_t confirmTimeoutMs;
+    uint16_t reserved;
+};
+
 static_assert(sizeof(LoadMsg) == 8);
+static_assert(sizeof(LoadExMsg) == 16);
 static_assert(sizeof(LedMsg) == 1);
 static_assert(sizeof(StartLoadMsg) == 8);
+static_assert(sizeof(CapabilitiesMsg) == 8);
+static_assert(sizeof(StartLoadExMsg) == 16);
+static_assert(sizeof(FlashHashesMsg) == 8);
+static_assert(sizeof(FlashHashesInfo) == 16);
+static_assert(sizeof(BaudMsg) == 8);
+static_assert(sizeof(ResumeInfo) == 8);
 
 } // namespace smp
@@ -0,0 +1,62 @@
+#include "PayloadSizer.h"
+#include <algorithm>
+#include <cmath>
+
+namespace smp {
+
+namespace {
+
+constexpr double decay = 0.98; // about last 50 frames count
+constexpr uint32_t sizeStep = 16;
+
+} // namespace
+
+PayloadSizer::PayloadSizer(uint32_t minPayload, uint32_t maxPayload,
+                           uint32_t overhead) noexcept
+    : minPayload{std::min(minPayload, maxPayload)}, maxPayload{maxPayload},
+      overhead{overhead}, errors{}, bits{}
+{}
+
+void PayloadSizer::delivered(uint32_t frameBytes) noexcept
+{
+    errors *= decay;
+    bits = bits * decay + 8.0 * frameBytes;
+}
+
+void PayloadSizer::failed(uint32_t frameBytes) noexcept
+{
+    errors = errors * decay + 1;
+    bits = bits * decay + 8.0 * frameBytes;
+}
+
+double PayloadSizer::bitErrorRate() const noexcept
+{
+    return bits > 0 ? std::min(errors / bits, 1.0) : 0;
+}
+
+uint32_t PayloadSizer::payload(double roundTrip) const noexcept
+{
+    auto ber = bitErrorRate();
+    if (ber <= 0) {
+        return maxPayload;
+    }
+    auto goodput = [&](uint32_t size) {
+        double frame = size + overhead;
+        return size * std::pow(1 - ber, 8 * frame) / (frame + roundTrip);
+    };
+    auto best = maxPayload;
+    auto bestGoodput = goodput(maxPayload);
+    if (bestGoodput <= 0) {
+        return minPayload; // nothing gets through, smallest loses least
+    }
+    for (auto size = minPayload; size < maxPayload; size += sizeStep) {
+        auto candidate = goodput(size);
+        if (candidate > bestGoodput) {
+            best = size;
+            bestGoodput = candidate;
+        }
+    }
+    return best;
+}
+
+} // namespace smp
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+
+namespace smp {
+
+/*
+ * Loading payload size from observed link quality. Bit error rate is
+ * estimated from recent frame outcomes, size maximises expected goodput
+ * payload * (1 - ber)^bits / (frame + roundTrip), so clean links get the
+ * biggest frames and noisy ones smaller frames that are cheaper to resend.
+ */
+class PayloadSizer final {
+public:
+    PayloadSizer(uint32_t minPayload, uint32_t maxPayload,
+                 uint32_t overhead) noexcept;
+
+    void delivered(uint32_t frameBytes) noexcept; // acked on first send
+    void failed(uint32_t frameBytes) noexcept;    // broken by noise
+
+    // roundTrip in byte times not covered by frame itself, 0 if pipelined
+    [[nodiscard]] uint32_t payload(double roundTrip) const noexcept;
+    [[nodiscard]] double bitErrorRate() const noexcept;
+
+private:
+    uint32_t minPayload;
+    uint32_t maxPayload;
+    uint32_t overhead; // frame bytes besides payload, ack included
+    double errors;     // decayed, old outcomes fade out
+    double bits;
+};
+
+} // namespace smp
@@ -13,7 +13,13 @@ enum action : uint8_t {
     startLoad,
     loading,
     goodbye,
-	boot
+	boot,
+    capabilities, // negotiate optional features, see capability
+    flashHashes,  // per block hashes of current flash, deltaLoad only
+    endLoad,      // whole image check of delta load, deltaLoad only
+    setBaud,      // switch line rate, baudSwitch only
+    linkTest,     // echo, confirms new line rate, baudSwitch only
+    resumeLoad    // continue unfinished load, resumableLoad only
 };
 
 // on success send header only
@@ -29,6 +35,11 @@ struct header {
 
 static_assert(sizeof(header) == 16, "No packing required");
 
+// loading flags, payload is lz4 block of the packet, compressedLoad only
+constexpr uint16_t compressedPayloadFlag = 0x4000;
+// payload is one byte filling the whole frame range, sparseLoad only
+constexpr uint16_t fillPayloadFlag = 0x2000;
+
 constexpr auto sizeBeforeHashField = sizeof(header) - sizeof(uint32_t);
 
 // template?
@@ -56,7 +67,8 @@ enum StatusCode : uint16_t {
 	WaitStartLoad,
 	DeviceBusy,
 	FailedWrite,
-    NothingToBoot
+    NothingToBoot,
+    BaudUnsupported
 };
 
 #pragma pack(push, 2)
@@ -77,6 +89,12 @@ struct LoadHeader {
 
 static_assert(sizeof(LoadHeader) == sizeof(header) + sizeof(LoadMsg));
 
+struct LoadExHeader {
+    header baseHeader;
+    LoadExMsg msg;
+};
+
+static_assert(sizeof(LoadExHeader) == sizeof(header) + sizeof(LoadExMsg));
 
 struct StartLoadHeader{
     header baseHeader;
@@ -85,26 +103,37 @@ struct StartLoadHeader{
 
 static_assert(sizeof(StartLoadHeader) == sizeof(header) + sizeof(StartLoadMsg));
 
-union BufferedHeader {
-    smp::header header;
-    std::array<uint8_t, sizeof(header)> buffer;
+struct StartLoadExHeader {
+    header baseHeader;
+    StartLoadExMsg msg;
 };
 
-union BufferedLedPacket {
-    LedPacket packet;
-    std::array<uint8_t, sizeof(LedPacket)> buffer;
+static_assert(sizeof(StartLoadExHeader) ==
+              sizeof(header) + sizeof(StartLoadExMsg));
+
+struct FlashHashesHeader {
+    header baseHeader;
+    FlashHashesMsg msg;
 };
 
-union BufferedLoadHeader {
-    LoadHeader header;
-    std::array<uint8_t, sizeof(LoadHeader)> buffer;
+static_assert(sizeof(FlashHashesHeader) ==
+              sizeof(header) + sizeof(FlashHashesMsg));
+
+struct BaudHeader {
+    header baseHeader;
+    BaudMsg msg;
 };
 
-union BufferedStartLoadHeader{
-    StartLoadHeader content;
-    std::array<uint8_t, sizeof(content)> buffer;
+static_assert(sizeof(BaudHeader) == sizeof(header) + sizeof(BaudMsg));
+
+struct CapabilitiesHeader {
+    header baseHeader;
+    CapabilitiesMsg msg;
 };
 
+static_assert(sizeof(CapabilitiesHeader) ==
+              sizeof(header) + sizeof(CapabilitiesMsg));
+
 #pragma pack(push,2)
 struct Answer{
 	smp::header header;
@@ -114,9 +143,63 @@ struct Answer{
 
 static_assert(sizeof(Answer) == sizeof(smp::header) + sizeof(smp::StatusCode));
 
-union BufferedAnswer{
-	Answer answer;
-	std::array<uint8_t, sizeof(answer)> buffer;
+#pragma pack(push, 2)
+struct CapabilitiesAnswer {
+    smp::header header;
+    smp::StatusCode code;
+    CapabilitiesMsg msg;
+};
+
+// answer on loading frame when windowedLoad negotiated
+struct LoadAnswer {
+    smp::header header;
+    smp::StatusCode code;
+    uint32_t packetId;
+};
+#pragma pack(pop)
+
+// followed by info.blockCount uint32_t hashes
+#pragma pack(push, 2)
+struct FlashHashesAnswer {
+    smp::header header;
+    smp::StatusCode code;
+    FlashHashesInfo info;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(FlashHashesAnswer) ==
+              sizeof(Answer) + sizeof(FlashHashesInfo));
+static_assert(sizeof(CapabilitiesAnswer) ==
+              sizeof(Answer) + sizeof(CapabilitiesMsg));
+static_assert(sizeof(LoadAnswer) == sizeof(Answer) + sizeof(uint32_t));
+
+#pragma pack(push, 2)
+struct ResumeLoadAnswer {
+    smp::header header;
+    smp::StatusCode code;
+    ResumeInfo info;
 };
+#pragma pack(pop)
+
+static_assert(sizeof(ResumeLoadAnswer) == sizeof(Answer) + sizeof(ResumeInfo));
+
+/*
+ * DeviceBusy or WaitLoad answer on loading frame when windowedLoad and
+ * busyHint negotiated. Frame wasn't taken, it is resent unchanged after
+ * retryAfterMs. Other codes keep LoadAnswer.
+ */
+#pragma pack(push, 2)
+struct BusyLoadAnswer {
+    smp::header header;
+    smp::StatusCode code;
+    uint32_t packetId;
+    uint16_t retryAfterMs;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(BusyLoadAnswer) == sizeof(LoadAnswer) + sizeof(uint16_t));
+
+// packetId of the last loading answer, carries whole image check result
+constexpr uint32_t loadCompletePacketId = 0xFFFFFFFF;
 
 } // namespace smp
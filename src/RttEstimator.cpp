@@ -0,0 +1,48 @@
+#include "RttEstimator.h"
+#include <algorithm>
+
+namespace smp {
+
+namespace {
+
+// timers don't fire sooner than the loop wakes up
+constexpr std::chrono::milliseconds granularity{1};
+
+} // namespace
+
+RttEstimator::RttEstimator(duration initial, duration min,
+                           duration max) noexcept
+    : min{min}, max{max}, average{}, deviation{},
+      current{std::clamp(initial, min, max)}
+{}
+
+void RttEstimator::sample(duration roundTrip) noexcept
+{
+    std::chrono::duration<double> measured = roundTrip;
+    if (average.count() == 0) {
+        average = measured;
+        deviation = measured / 2;
+    } else {
+        deviation =
+            deviation * 0.75 + std::chrono::abs(average - measured) * 0.25;
+        average = average * 0.875 + measured * 0.125;
+    }
+    auto timeout = average + std::max<std::chrono::duration<double>>(
+                                 granularity, deviation * 4);
+    current = std::clamp(std::chrono::duration_cast<duration>(timeout), min,
+                         max);
+}
+
+void RttEstimator::backOff() noexcept { current = std::min(current * 2, max); }
+
+RttEstimator::duration RttEstimator::timeout() const noexcept
+{
+    return current;
+}
+
+RttEstimator::duration RttEstimator::smoothed() const noexcept
+{
+    return std::chrono::duration_cast<duration>(average);
+}
+
+} // namespace smp
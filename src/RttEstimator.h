@@ -0,0 +1,35 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+namespace smp {
+
+/*
+ * Retransmit timeout from measured round trips, as TCP does: smoothed round
+ * trip plus four times its mean deviation. Only answers to frames sent once
+ * are measured, an answer after a resend can't tell which copy it is for.
+ * Each expired timer doubles the timeout until the next measurement.
+ */
+class RttEstimator final {
+public:
+    using duration = std::chrono::steady_clock::duration;
+
+    // initial is used until the first measurement
+    RttEstimator(duration initial, duration min, duration max) noexcept;
+
+    void sample(duration roundTrip) noexcept;
+    void backOff() noexcept;
+
+    [[nodiscard]] duration timeout() const noexcept;
+    [[nodiscard]] duration smoothed() const noexcept; // 0 -> not measured
+
+private:
+    duration min;
+    duration max;
+    std::chrono::duration<double> average; // of round trips
+    std::chrono::duration<double> deviation;
+    duration current;
+};
+
+} // namespace smp
@@ -1,12 +1,18 @@
 #include "SerialPort.h"
 #include "ErrnoException.h"
+#include "Trace.h"
+
+uint32_t SerialPort::traceTrack() const noexcept { return track; }
 
 #ifdef _WIN32
 
+#include <algorithm>
+
 SerialPort::SerialPort(std::string_view port, uint32_t baudRate)
     : portDescriptor(CreateFile(port.data(), GENERIC_READ | GENERIC_WRITE, 0,
                                 nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
-                                nullptr))
+                                nullptr)),
+      track{smp::trace::track(port)}
 {
     if (portDescriptor == INVALID_HANDLE_VALUE) {
         throw ErrnoException("Can't open port, WinAPI error", GetLastError());
@@ -42,6 +48,22 @@ SerialPort::SerialPort(std::string_view port, uint32_t baudRate)
     PurgeComm(portDescriptor, PURGE_RXCLEAR| PURGE_RXABORT | PURGE_TXABORT | PURGE_TXCLEAR);
 }
 
+void SerialPort::setBaudRate(uint32_t baudRate)
+{
+    smp::trace::Span span{"set baud", track, "rate", baudRate};
+    FlushFileBuffers(portDescriptor); // pending bytes leave at old rate
+    DCB portParams{};
+    if (!GetCommState(portDescriptor, &portParams)) {
+        throw ErrnoException("Can't get port params, WinAPI error",
+                             GetLastError());
+    }
+    portParams.BaudRate = baudRate;
+    if (!SetCommState(portDescriptor, &portParams)) {
+        throw ErrnoException("Can't set port params, WinAPI error",
+                             GetLastError());
+    }
+}
+
 SerialPort::~SerialPort()
 {
     if (portDescriptor != INVALID_HANDLE_VALUE)
@@ -56,27 +78,138 @@ uint32_t SerialPort::write(const void *buffer, uint32_t size)
     return static_cast<uint32_t>(result);
 }
 
-uint32_t SerialPort::read(void *buffer, uint32_t size)
+void SerialPort::writeAll(std::initializer_list<ConstBuffer> buffers)
+{
+    for (const auto &buffer : buffers) {
+        uint32_t offset = 0;
+        while (offset != buffer.size) {
+            offset += write(static_cast<const char *>(buffer.data) + offset,
+                            buffer.size - offset);
+        }
+    }
+}
+
+// no overlapped io, WriteFile blocks till the buffer is taken
+uint32_t SerialPort::writeSome(std::span<ConstBuffer> &pending)
+{
+    smp::trace::Span span{"port write", track};
+    auto &buffer = pending.front();
+    auto written = write(buffer.data, buffer.size);
+    buffer.data = static_cast<const char *>(buffer.data) + written;
+    buffer.size -= written;
+    if (buffer.size == 0) {
+        pending = pending.subspan(1);
+    }
+    return written;
+}
+
+namespace {
+
+uint32_t readFile(HANDLE port, void *buffer, uint32_t size)
 {
     DWORD result{};
-    if (!ReadFile(portDescriptor, buffer, size, &result, nullptr))
+    if (!ReadFile(port, buffer, size, &result, nullptr))
         throw ErrnoException("Port read error, WinAPI error");
     return static_cast<uint32_t>(result);
 }
 
+// bytes in driver input queue
+uint32_t queued(HANDLE port)
+{
+    COMSTAT status{};
+    DWORD errors{};
+    if (!ClearCommError(port, &errors, &status))
+        throw ErrnoException("Can't get port status, WinAPI error",
+                             GetLastError());
+    return static_cast<uint32_t>(status.cbInQue);
+}
+
+} // namespace
+
+// only what is queued, ReadFile returns it without waiting
+uint32_t SerialPort::read(void *buffer, uint32_t size)
+{
+    size = std::min(size, queued(portDescriptor));
+    return size ? readFile(portDescriptor, buffer, size) : 0;
+}
+
+// handle can't be waited on, input queue is polled till deadline
+smp::Task<bool> SerialPort::readable(smp::EventLoop &loop, Deadline deadline)
+{
+    for (;;) {
+        if (queued(portDescriptor)) {
+            co_return true;
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (now >= deadline) {
+            co_return false;
+        }
+        co_await loop.sleepUntil(
+            std::min(deadline, now + std::chrono::milliseconds{1}));
+    }
+}
+
+// WriteFile blocks till the buffer is taken
+smp::Task<bool> SerialPort::writable(smp::EventLoop &, Deadline)
+{
+    co_return true;
+}
+
 #else
 
+#include "CustomBaud.h"
+#include <algorithm>
+#include <array>
+#include <optional>
 #include <fcntl.h>
+#include <poll.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
 #include <termios.h>
 #include <unistd.h>
 
 namespace {
 
-speed_t speedCheck(size_t baudRate)
+// nullopt -> no Bxxx constant, rate is set with setCustomBaudRate
+std::optional<speed_t> speedCheck(size_t baudRate)
 {
     speed_t speed;
     switch (baudRate) {
+#ifdef B4000000
+    case 4000000:
+        speed = B4000000;
+        break;
+#endif
+#ifdef B3000000
+    case 3000000:
+        speed = B3000000;
+        break;
+#endif
+#ifdef B2000000
+    case 2000000:
+        speed = B2000000;
+        break;
+#endif
+#ifdef B1500000
+    case 1500000:
+        speed = B1500000;
+        break;
+#endif
+#ifdef B1000000
+    case 1000000:
+        speed = B1000000;
+        break;
+#endif
+#ifdef B921600
+    case 921600:
+        speed = B921600;
+        break;
+#endif
+#ifdef B460800
+    case 460800:
+        speed = B460800;
+        break;
+#endif
     case 230400:
         speed = B230400;
         break;
@@ -125,11 +258,29 @@ speed_t speedCheck(size_t baudRate)
         speed = B300;
         break;
     default:
-        throw std::logic_error("No such baud rate");
+        return std::nullopt;
     }
     return speed;
 }
 
+void setSpeed(int descriptor, termios &options, uint32_t baudRate)
+{
+    auto speed = speedCheck(baudRate);
+    // custom rate is applied over the termios of placeholder speed
+    auto res = cfsetspeed(&options, speed ? *speed : B38400);
+    if (res == -1)
+        throw ErrnoException("Can't set output speed");
+    res = cfsetispeed(&options, speed ? *speed : B38400);
+    if (res == -1)
+        throw ErrnoException("Can't set input speed");
+    res = tcsetattr(descriptor, TCSANOW, &options);
+    if (res == -1)
+        throw ErrnoException("Can't set options");
+    if (!speed) {
+        setCustomBaudRate(descriptor, baudRate);
+    }
+}
+
 void turnOffSpecialCharacters(termios &termiosStruct)
 {
     termiosStruct.c_cc[VEOF] = _POSIX_VDISABLE;
@@ -142,27 +293,29 @@ void turnOffSpecialCharacters(termios &termiosStruct)
     termiosStruct.c_cc[VINTR] = _POSIX_VDISABLE;
     termiosStruct.c_cc[VQUIT] = _POSIX_VDISABLE;
     termiosStruct.c_cc[VSUSP] = _POSIX_VDISABLE;
+#ifdef VDSUSP
     termiosStruct.c_cc[VDSUSP] = _POSIX_VDISABLE;
+#endif
     termiosStruct.c_cc[VSTART] = _POSIX_VDISABLE;
     termiosStruct.c_cc[VSTOP] = _POSIX_VDISABLE;
     termiosStruct.c_cc[VLNEXT] = _POSIX_VDISABLE;
     termiosStruct.c_cc[VDISCARD] = _POSIX_VDISABLE;
+#ifdef VSTATUS
     termiosStruct.c_cc[VSTATUS] = _POSIX_VDISABLE;
+#endif
 }
 
 } // namespace
 
 SerialPort::SerialPort(std::string_view port, uint32_t baudRate)
-    : portDescriptor(-1)
+    : portDescriptor(-1), track{smp::trace::track(port)}
 {
-    // rd/wr, no control tty for process, blocking
-    int descriptor = open(port.data(), O_RDWR | O_NOCTTY | O_NDELAY);
+    // rd/wr, no control tty for process, non-blocking so one thread can
+    // serve many ports, sync writes wait with poll
+    int descriptor = open(port.data(), O_RDWR | O_NOCTTY | O_NONBLOCK);
 
     if (descriptor != -1) {
-        auto res = fcntl(descriptor, F_SETFL, 0); // blocking read
-        if (res == -1)
-            throw ErrnoException("Can't set blocking read");
-        res = ioctl(descriptor, TIOCEXCL);
+        auto res = ioctl(descriptor, TIOCEXCL);
         if (res == -1)
             throw ErrnoException("Can't set exclusive use");
         termios options{};
@@ -171,21 +324,13 @@ SerialPort::SerialPort(std::string_view port, uint32_t baudRate)
         options.c_cflag &= ~CSTOPB;
         options.c_cflag &= ~CSIZE;
         options.c_cflag |= CS8;
-        speed_t speed = speedCheck(baudRate);
-        res = cfsetspeed(&options, speed);
-        if (res == -1)
-            throw ErrnoException("Can't set output speed");
-        res = cfsetispeed(&options, speed);
-        if (res == -1)
-            throw ErrnoException("Can't set input speed");
         options.c_lflag &= ~(ICANON | ECHO | ECHOE | ISIG);
         options.c_oflag &= ~OPOST;
         turnOffSpecialCharacters(options);
-        options.c_cc[VMIN] = 0;  // set to header size?
-        options.c_cc[VTIME] = 0; // timeout in 0.1 sec
-        res = tcsetattr(descriptor, TCSANOW, &options);
-        if (res == -1)
-            throw ErrnoException("Can't set options");
+        // read never blocks, waiting is done with poll and deadline
+        options.c_cc[VMIN] = 0;
+        options.c_cc[VTIME] = 0;
+        setSpeed(descriptor, options, baudRate);
         res = tcflush(descriptor, TCIOFLUSH);
         if (res == -1)
             throw ErrnoException("Can't flush");
@@ -198,11 +343,61 @@ SerialPort::SerialPort(std::string_view port, uint32_t baudRate)
 
 uint32_t SerialPort::write(const void *buffer, uint32_t size)
 {
-    auto result = ::write(portDescriptor, buffer, size);
-    if (result != -1)
-        return static_cast<uint32_t>(result);
-    else
+    ConstBuffer whole{buffer, size};
+    std::span<ConstBuffer> pending{&whole, 1};
+    return writeSome(pending);
+}
+
+void SerialPort::writeAll(std::initializer_list<ConstBuffer> buffers)
+{
+    std::array<ConstBuffer, 8> copy{};
+    if (buffers.size() > copy.size()) {
+        throw std::logic_error("Too many buffers for one write");
+    }
+    std::copy(buffers.begin(), buffers.end(), copy.begin());
+    std::span<ConstBuffer> pending{copy.data(), buffers.size()};
+    while (!pending.empty()) {
+        if (writeSome(pending) != 0 || pending.empty()) {
+            continue;
+        }
+        pollfd descriptor{
+            .fd = portDescriptor, .events = POLLOUT, .revents = 0};
+        if (poll(&descriptor, 1, -1) == -1 && errno != EINTR) {
+            throw ErrnoException("Can't poll port");
+        }
+    }
+}
+
+uint32_t SerialPort::writeSome(std::span<ConstBuffer> &pending)
+{
+    smp::trace::Span span{"port write", track};
+    // empty parts are dropped, writev of nothing says nothing
+    while (!pending.empty() && pending.front().size == 0) {
+        pending = pending.subspan(1);
+    }
+    std::array<iovec, 8> vectors{};
+    size_t count = std::min(pending.size(), vectors.size());
+    for (size_t i = 0; i < count; ++i) {
+        vectors[i] = {const_cast<void *>(pending[i].data), pending[i].size};
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    ssize_t result;
+    do {
+        result = ::writev(portDescriptor, vectors.data(),
+                          static_cast<int>(count));
+    } while (result == -1 && errno == EINTR);
+    if (result == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return 0;
+        }
         throw ErrnoException("Can't write port");
+    }
+
+    smp::dropWritten(pending, static_cast<size_t>(result));
+    return static_cast<uint32_t>(result);
 }
 
 uint32_t SerialPort::read(void *buffer, uint32_t size)
@@ -210,8 +405,34 @@ uint32_t SerialPort::read(void *buffer, uint32_t size)
     auto result = ::read(portDescriptor, buffer, size);
     if (result != -1)
         return static_cast<uint32_t>(result);
-    else
-        throw ErrnoException("Can't write port");
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+        return 0;
+    throw ErrnoException("Can't read port");
+}
+
+smp::Task<bool> SerialPort::readable(smp::EventLoop &loop, Deadline deadline)
+{
+    auto ready = co_await loop.readable(portDescriptor, deadline);
+    co_return ready;
+}
+
+smp::Task<bool> SerialPort::writable(smp::EventLoop &loop, Deadline deadline)
+{
+    auto ready = co_await loop.writable(portDescriptor, deadline);
+    co_return ready;
+}
+
+void SerialPort::setBaudRate(uint32_t baudRate)
+{
+    smp::trace::Span span{"set baud", track, "rate", baudRate};
+    if (tcdrain(portDescriptor) == -1) {
+        throw ErrnoException("Can't drain port");
+    }
+    termios options{};
+    if (tcgetattr(portDescriptor, &options) == -1) {
+        throw ErrnoException("Can't get options");
+    }
+    setSpeed(portDescriptor, options, baudRate);
 }
 
 SerialPort::~SerialPort()
@@ -223,7 +444,7 @@ SerialPort::~SerialPort()
 }
 
 SerialPort::SerialPort(SerialPort &&rhs) noexcept
-    : portDescriptor(rhs.portDescriptor)
+    : portDescriptor(rhs.portDescriptor), track(rhs.track)
 {
     rhs.portDescriptor = -1;
 }
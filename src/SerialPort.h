@@ -1,14 +1,26 @@
 #pragma once
 
+#include "EventLoop.h"
+#include "Task.h"
+#include "Transport.h"
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
+#include <initializer_list>
+#include <span>
 #include <string_view>
 #ifdef _WIN32
 #include <windows.h>
 #endif
 
-class SerialPort final {
+class SerialPort final : public smp::Transport {
 public:
+#ifdef _WIN32
+    using Handle = HANDLE;
+#else
+    using Handle = int;
+#endif
+
     SerialPort(std::string_view port, uint32_t baudRate);
     SerialPort(SerialPort &&rhs) noexcept;
 
@@ -16,14 +28,19 @@ public:
     SerialPort(const SerialPort &) = delete;
     SerialPort &operator=(const SerialPort &) = delete;
 
-    uint32_t write(const void *buffer, uint32_t size);
-    uint32_t read(void *buffer, uint32_t size);
-    ~SerialPort();
+    uint32_t write(const void *buffer, uint32_t size) override;
+    // whole frame in one writev (one USB transfer), retried if partial
+    void writeAll(std::initializer_list<ConstBuffer> buffers) override;
+    uint32_t writeSome(std::span<ConstBuffer> &pending) override;
+    uint32_t read(void *buffer, uint32_t size) override;
+    smp::Task<bool> readable(smp::EventLoop &loop, Deadline deadline) override;
+    smp::Task<bool> writable(smp::EventLoop &loop, Deadline deadline) override;
+    // after pending output is sent, any rate on linux, mac and windows
+    void setBaudRate(uint32_t baudRate) override;
+    [[nodiscard]] uint32_t traceTrack() const noexcept override;
+    ~SerialPort() override;
 
 private:
-#ifdef _WIN32
-    HANDLE portDescriptor;
-#else
-    int portDescriptor;
-#endif
+    Handle portDescriptor;
+    uint32_t track;
 };
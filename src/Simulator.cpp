@@ -0,0 +1,312 @@
+#include "Simulator.h"
+#include "CustomBaud.h"
+#include "ErrnoException.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <deque>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <termios.h>
+#include <unistd.h>
+#ifdef __APPLE__
+#include <util.h>
+#else
+#include <pty.h>
+#endif
+
+namespace smp::sim {
+
+namespace {
+
+using clock = std::chrono::steady_clock;
+
+// bytes travelling on the emulated line, deliverable at `at`
+struct TimedChunk {
+    clock::time_point at;
+    std::vector<uint8_t> bytes;
+    uint32_t baudRate; // sender's, 0 -> unknown
+};
+
+// receiver off by more than 8N1 tolerates sees framing errors, bytes lost
+bool garbled(uint32_t sender, uint32_t receiver) noexcept
+{
+    auto difference = sender > receiver ? sender - receiver : receiver - sender;
+    return sender && receiver && difference * 50 > receiver; // 2 %
+}
+
+DeviceConfig withBaudRate(DeviceConfig config, uint32_t baudRate)
+{
+    config.baudRate = baudRate;
+    return config;
+}
+
+// bytes delivered to the device at once, about a uart fifo
+constexpr ssize_t lineChunk = 16;
+
+// 8N1 -> 10 bits per byte
+clock::duration lineTime(size_t bytes, uint32_t baudRate)
+{
+    if (baudRate == 0) {
+        return clock::duration::zero();
+    }
+    return std::chrono::duration_cast<clock::duration>(
+        std::chrono::nanoseconds{bytes * 10'000'000'000ull / baudRate});
+}
+
+} // namespace
+
+LineSimulator::LineSimulator(const DeviceConfig &config, uint32_t baudRate)
+    : name{}, simulated{withBaudRate(config, baudRate)}, baudRate{baudRate},
+      bitErrorRate{}, noise{}, cleanBits{}
+{}
+
+const std::string &LineSimulator::portName() const noexcept { return name; }
+
+const Device &LineSimulator::device() const noexcept { return simulated; }
+
+void LineSimulator::setBitErrorRate(double rate, uint32_t seed)
+{
+    if (rate < 0 || rate >= 1) {
+        throw std::logic_error("Bit error rate out of [0, 1)");
+    }
+    bitErrorRate = rate;
+    noise.seed(seed);
+    if (rate > 0) {
+        cleanBits = std::geometric_distribution<uint64_t>{rate}(noise);
+    }
+}
+
+void LineSimulator::corrupt(std::vector<uint8_t> &bytes)
+{
+    if (bitErrorRate == 0) {
+        return;
+    }
+    // gaps between flips are geometric, no draw per bit
+    const uint64_t bits = bytes.size() * 8;
+    uint64_t bit = 0;
+    while (bits - bit > cleanBits) {
+        bit += cleanBits;
+        bytes[bit / 8] ^= static_cast<uint8_t>(1u << bit % 8);
+        bit += 1;
+        cleanBits = std::geometric_distribution<uint64_t>{bitErrorRate}(noise);
+    }
+    cleanBits -= bits - bit;
+}
+
+void LineSimulator::run(const std::atomic<bool> &stop)
+{
+    std::deque<TimedChunk> toDevice;
+    std::deque<TimedChunk> toHost;
+    auto rxLine = clock::now();
+    auto txLine = clock::now();
+    std::array<uint8_t, 4096> readBuffer{};
+    std::vector<uint8_t> answers;
+
+    // pacing follows rate switches of device and client
+    auto rateOr = [this](uint32_t rate) { return rate ? rate : baudRate; };
+
+    while (!stop.load(std::memory_order_relaxed)) {
+        int host = endpoint();
+        if (host == -1) {
+            std::this_thread::sleep_for(std::chrono::milliseconds{20});
+            continue;
+        }
+        auto now = clock::now();
+        simulated.tick(now);
+        while (!toDevice.empty() && toDevice.front().at <= now) {
+            answers.clear();
+            auto txRate = simulated.lineRate(); // answers leave at this rate
+            if (!garbled(toDevice.front().baudRate, txRate)) {
+                corrupt(toDevice.front().bytes);
+                simulated.receive(toDevice.front().bytes.data(),
+                                  toDevice.front().bytes.size(), answers);
+            }
+            toDevice.pop_front();
+            if (!answers.empty()) {
+                txLine = std::max(txLine, clock::now()) +
+                         lineTime(answers.size(), rateOr(txRate));
+                toHost.push_back({txLine, answers, txRate});
+            }
+        }
+        now = clock::now();
+        while (!toHost.empty() && toHost.front().at <= now) {
+            if (garbled(toHost.front().baudRate, hostBaudRate())) {
+                toHost.pop_front();
+                continue;
+            }
+            auto &chunk = toHost.front().bytes;
+            corrupt(chunk);
+            size_t offset = 0;
+            while (offset != chunk.size()) {
+                auto res = ::write(host, chunk.data() + offset,
+                                   chunk.size() - offset);
+                if (res == -1 && (errno == EPIPE || errno == ECONNRESET)) {
+                    break; // hang up is seen by the next poll
+                }
+                if (res == -1) {
+                    throw ErrnoException("Can't write host side");
+                }
+                offset += static_cast<size_t>(res);
+            }
+            toHost.pop_front();
+        }
+
+        auto wakeUp = now + std::chrono::milliseconds{50};
+        if (!toDevice.empty()) {
+            wakeUp = std::min(wakeUp, toDevice.front().at);
+        }
+        if (!toHost.empty()) {
+            wakeUp = std::min(wakeUp, toHost.front().at);
+        }
+        auto timeout = std::chrono::ceil<std::chrono::milliseconds>(
+            wakeUp - clock::now());
+
+        pollfd descriptor{.fd = host, .events = POLLIN, .revents = 0};
+        auto res = poll(&descriptor, 1,
+                        static_cast<int>(std::max<int64_t>(timeout.count(), 0)));
+        if (res == -1 && errno != EINTR) {
+            throw ErrnoException("Can't poll host side");
+        }
+        if (res > 0 && (descriptor.revents & POLLIN)) {
+            auto size = ::read(host, readBuffer.data(), readBuffer.size());
+            if (size == 0) {
+                hangUp(); // end of stream
+            } else if (size > 0) {
+                // uart hands bytes over as they come, not a whole write at
+                // its end, frames at the start of a long write arrive first
+                auto hostRate = simulated.lineRate() ? hostBaudRate() : 0;
+                rxLine = std::max(rxLine, clock::now());
+                for (ssize_t begin = 0; begin < size; begin += lineChunk) {
+                    auto end = std::min<ssize_t>(begin + lineChunk, size);
+                    rxLine += lineTime(static_cast<size_t>(end - begin),
+                                       rateOr(hostRate));
+                    toDevice.push_back({rxLine,
+                                        {readBuffer.begin() + begin,
+                                         readBuffer.begin() + end},
+                                        hostRate});
+                }
+            }
+        } else if (res > 0 && (descriptor.revents & (POLLHUP | POLLERR))) {
+            hangUp();
+        }
+    }
+}
+
+PtySimulator::PtySimulator(const DeviceConfig &config, uint32_t baudRate)
+    : LineSimulator{config, baudRate}, master{-1}
+{
+    int slave = -1;
+    std::array<char, 128> slavePath{};
+    if (openpty(&master, &slave, slavePath.data(), nullptr, nullptr) == -1) {
+        throw ErrnoException("Can't open pty");
+    }
+    termios options{};
+    if (tcgetattr(slave, &options) == 0) {
+        cfmakeraw(&options);
+        tcsetattr(slave, TCSANOW, &options);
+    }
+    // slave reopened by client, closed here so exclusive mode is dropped
+    // with the client's last close
+    close(slave);
+    name = slavePath.data();
+}
+
+const std::string &PtySimulator::slaveName() const noexcept
+{
+    return portName();
+}
+
+int PtySimulator::endpoint() { return master; }
+
+// tty rate of the client, pty master reports slave settings
+uint32_t PtySimulator::hostBaudRate() { return lineBaudRate(master); }
+
+void PtySimulator::hangUp()
+{
+    // no client has slave opened
+    std::this_thread::sleep_for(std::chrono::milliseconds{20});
+}
+
+PtySimulator::~PtySimulator()
+{
+    if (master != -1) {
+        close(master);
+    }
+}
+
+SocketSimulator::SocketSimulator(const DeviceConfig &config,
+                                 uint32_t baudRate, std::string path)
+    : LineSimulator{config, baudRate}, path{std::move(path)}, listening{-1},
+      client{-1}
+{
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (this->path.size() >= sizeof(address.sun_path)) {
+        throw std::logic_error("Socket path is too long: " + this->path);
+    }
+    std::copy(this->path.begin(), this->path.end(), address.sun_path);
+
+    listening = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listening == -1) {
+        throw ErrnoException("Can't create socket");
+    }
+    unlink(this->path.c_str()); // left by a killed simulator
+    if (bind(listening, reinterpret_cast<const sockaddr *>(&address),
+             sizeof(address)) == -1 ||
+        listen(listening, 1) == -1 ||
+        fcntl(listening, F_SETFL, fcntl(listening, F_GETFL) | O_NONBLOCK) ==
+            -1) {
+        ErrnoException error{"Can't listen on socket"};
+        close(listening);
+        throw error;
+    }
+    name = "unix:" + this->path;
+}
+
+int SocketSimulator::endpoint()
+{
+    if (client == -1) {
+        client = accept(listening, nullptr, nullptr);
+        // accepted socket may inherit non-blocking mode, writes block here
+        if (client != -1) {
+            fcntl(client, F_SETFL, fcntl(client, F_GETFL) & ~O_NONBLOCK);
+#ifdef SO_NOSIGPIPE
+            int on = 1;
+            setsockopt(client, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+        } else if (errno != EAGAIN && errno != EWOULDBLOCK &&
+                   errno != EINTR) {
+            throw ErrnoException("Can't accept on socket");
+        }
+    }
+    return client;
+}
+
+uint32_t SocketSimulator::hostBaudRate() { return device().lineRate(); }
+
+void SocketSimulator::hangUp()
+{
+    close(client);
+    client = -1;
+}
+
+SocketSimulator::~SocketSimulator()
+{
+    if (client != -1) {
+        close(client);
+    }
+    if (listening != -1) {
+        close(listening);
+        unlink(path.c_str());
+    }
+}
+
+} // namespace smp::sim
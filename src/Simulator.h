@@ -0,0 +1,86 @@
+#pragma once
+
+#include "Device.h"
+#include <atomic>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace smp::sim {
+
+// Device behind an emulated serial line, bytes are paced at the line rate
+class LineSimulator {
+public:
+    LineSimulator(const LineSimulator &) = delete;
+    LineSimulator &operator=(const LineSimulator &) = delete;
+
+    // client opens this with openTransport
+    [[nodiscard]] const std::string &portName() const noexcept;
+    void run(const std::atomic<bool> &stop);
+    [[nodiscard]] const Device &device() const noexcept;
+    // flips random bits on the line both ways, 0 -> clean line
+    void setBitErrorRate(double rate, uint32_t seed);
+
+    virtual ~LineSimulator() = default;
+
+protected:
+    // baudRate == 0 -> no byte pacing
+    LineSimulator(const DeviceConfig &config, uint32_t baudRate);
+
+    // host side descriptor, -1 while no host is attached
+    virtual int endpoint() = 0;
+    // rate host side is set to, 0 -> unknown
+    virtual uint32_t hostBaudRate() = 0;
+    // host side went away
+    virtual void hangUp() = 0;
+
+    std::string name;
+
+private:
+    void corrupt(std::vector<uint8_t> &bytes);
+
+    Device simulated;
+    uint32_t baudRate;
+    double bitErrorRate;
+    std::mt19937 noise;
+    uint64_t cleanBits; // until the next flip
+};
+
+// serves Device on pty master, client opens slaveName() as serial port
+class PtySimulator final : public LineSimulator {
+public:
+    PtySimulator(const DeviceConfig &config, uint32_t baudRate);
+
+    [[nodiscard]] const std::string &slaveName() const noexcept;
+
+    ~PtySimulator() override;
+
+private:
+    int endpoint() override;
+    uint32_t hostBaudRate() override;
+    void hangUp() override;
+
+    int master;
+};
+
+// serves Device on a Unix socket at path, one client at a time, switches
+// rate along with the device as the client can't tell a socket its rate
+class SocketSimulator final : public LineSimulator {
+public:
+    SocketSimulator(const DeviceConfig &config, uint32_t baudRate,
+                    std::string path);
+
+    ~SocketSimulator() override;
+
+private:
+    int endpoint() override;
+    uint32_t hostBaudRate() override;
+    void hangUp() override;
+
+    std::string path;
+    int listening;
+    int client; // -1 -> none connected
+};
+
+} // namespace smp::sim
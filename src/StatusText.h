@@ -0,0 +1,64 @@
+#pragma once
+
+#include "LocalStatusCode.h"
+#include "Protocol.h"
+#include <algorithm>
+#include <array>
+#include <string_view>
+#include <utility>
+
+inline constexpr std::string_view localCodeToStr(LocalStatusCode code) noexcept
+{
+    using namespace std::string_view_literals;
+    constexpr std::array localStatusCodeToString{
+        std::pair{LocalStatusCode::WrongHash, "Wrong hash"sv},
+        std::pair{LocalStatusCode::BufferToSmall, "Buffer too small"sv},
+        std::pair{LocalStatusCode::WrongId, "Wrong response id"sv},
+        std::pair{LocalStatusCode::WrongStartWord, "Wrong start word"sv},
+        std::pair{LocalStatusCode::HandshakeAnswerHeaderNotEqual,
+         "Handshake answer header not equal"sv},
+        std::pair{LocalStatusCode::WrongFlags, "Header flags are different"sv},
+        std::pair{LocalStatusCode::Timeout, "Timeout"sv},
+        std::pair{LocalStatusCode::LoadAnswerNotEqual,
+         "Load answer size not equal"sv},
+        std::pair{LocalStatusCode::WrongLength, "Wrong answer length"sv},
+        std::pair{LocalStatusCode::BaudRejected, "Baud rate rejected"sv},
+        std::pair{LocalStatusCode::LinkTestFailed,
+         "Link test failed, previous baud rate restored"sv}
+    };
+    auto res = std::find_if(localStatusCodeToString.cbegin(), localStatusCodeToString.cend(), [=](auto&& codeAndStr){return codeAndStr.first == code;});
+    if(res != localStatusCodeToString.cend()){
+        return res->second;
+    } else {
+        return "Unkonwn error";
+    }
+}
+
+inline constexpr std::string_view codeToStr(smp::StatusCode code) noexcept
+{
+    using namespace std::string_view_literals;
+    constexpr std::array statusCodeToStr{
+        std::pair{smp::StatusCode::Invalid, "Invalid status code"sv},
+        std::pair{smp::StatusCode::Ok, "Success"sv},
+        std::pair{smp::StatusCode::InvalidId, "Invalid id"sv},
+        std::pair{smp::StatusCode::WrongMsgSize, "Wrong msg size"sv},
+        std::pair{smp::StatusCode::NoSuchCommand, "NO such command"sv},
+        std::pair{smp::StatusCode::NoSuchDevice, "No such device"sv},
+        std::pair{smp::StatusCode::HashBroken, "Hash broken"sv},
+        std::pair{smp::StatusCode::LoadExtraSize, "Load extra size"sv},
+        std::pair{smp::StatusCode::WaitLoad, "Wait for loading"sv},
+        std::pair{smp::StatusCode::NoMemory, "No memory"sv},
+        std::pair{smp::StatusCode::WaitStartLoad, "Wait for start loading"sv},
+        std::pair{smp::StatusCode::LoadWrongPacket, "Wrong packet id"sv},
+        std::pair{smp::StatusCode::DeviceBusy, "Device busy"sv},
+        std::pair{smp::StatusCode::FailedWrite, "Failed write"sv},
+        std::pair{smp::StatusCode::NothingToBoot, "Nothing to boot"sv},
+        std::pair{smp::StatusCode::BaudUnsupported, "Baud rate unsupported"sv},
+    };
+    auto res = std::find_if(statusCodeToStr.cbegin(), statusCodeToStr.cend(), [=](auto&& codeAndStr){return codeAndStr.first == code;});
+    if(res != statusCodeToStr.cend()){
+        return res->second;
+    } else {
+        return "Unkonwn smp error";
+    }
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+
+namespace smp {
+
+/*
+ * Lazy coroutine result. Body starts when awaited (or started by EventLoop)
+ * and resumes its awaiter on completion, exceptions rethrow in the awaiter.
+ * gcc 12 skips the body of coroutines awaiting in if or switch conditions,
+ * results are taken into locals first.
+ */
+template <typename T = void> class Task;
+
+namespace detail {
+
+struct PromiseBase {
+    std::coroutine_handle<> continuation;
+    std::exception_ptr error;
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+        template <typename Promise>
+        std::coroutine_handle<>
+        await_suspend(std::coroutine_handle<Promise> handle) noexcept
+        {
+            // symmetric transfer, deep await chains don't grow the stack
+            auto next = handle.promise().continuation;
+            return next ? next : std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+    };
+    FinalAwaiter final_suspend() noexcept { return {}; }
+
+    void unhandled_exception() noexcept { error = std::current_exception(); }
+    void rethrow() const
+    {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+};
+
+template <typename T> struct Promise : PromiseBase {
+    std::optional<T> value;
+
+    Task<T> get_return_object() noexcept;
+    void return_value(T result) { value.emplace(std::move(result)); }
+    T result()
+    {
+        rethrow();
+        return std::move(*value);
+    }
+};
+
+template <> struct Promise<void> : PromiseBase {
+    Task<void> get_return_object() noexcept;
+    void return_void() noexcept {}
+    void result() const { rethrow(); }
+};
+
+} // namespace detail
+
+template <typename T> class [[nodiscard]] Task final {
+public:
+    using promise_type = detail::Promise<T>;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    explicit Task(Handle handle) noexcept : handle{handle} {}
+    Task(Task &&rhs) noexcept : handle{std::exchange(rhs.handle, {})} {}
+    Task &operator=(Task &&rhs) noexcept
+    {
+        std::swap(handle, rhs.handle);
+        return *this;
+    }
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+
+    auto operator co_await() && noexcept
+    {
+        struct Awaiter {
+            Handle handle;
+            bool await_ready() const noexcept { return false; }
+            std::coroutine_handle<>
+            await_suspend(std::coroutine_handle<> awaiting) noexcept
+            {
+                handle.promise().continuation = awaiting;
+                return handle;
+            }
+            T await_resume() { return handle.promise().result(); }
+        };
+        return Awaiter{handle};
+    }
+
+    // for the loop driving root tasks, nobody awaits them
+    void start() { handle.resume(); }
+    [[nodiscard]] bool done() const noexcept { return handle.done(); }
+    T result() { return handle.promise().result(); }
+
+    ~Task()
+    {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+private:
+    Handle handle;
+};
+
+namespace detail {
+
+template <typename T> Task<T> Promise<T>::get_return_object() noexcept
+{
+    return Task<T>{Task<T>::Handle::from_promise(*this)};
+}
+
+inline Task<void> Promise<void>::get_return_object() noexcept
+{
+    return Task<void>{Task<void>::Handle::from_promise(*this)};
+}
+
+} // namespace detail
+
+} // namespace smp
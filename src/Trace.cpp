@@ -0,0 +1,143 @@
+#include "Trace.h"
+#include <algorithm>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace smp::trace {
+
+namespace {
+
+struct Event final {
+    const char *name;
+    const char *argName;
+    int64_t begin;
+    int64_t duration;
+    uint32_t track;
+    uint32_t arg;
+};
+
+struct Ring final {
+    std::unique_ptr<Event[]> events;
+    size_t capacity{};
+    std::atomic<uint64_t> next{0}; // total recorded, slot is next % capacity
+    int64_t epoch{};               // enable time, trace starts at 0
+};
+
+Ring ring;
+
+std::mutex tracksMutex;
+std::vector<std::string> tracks;
+
+// track names may hold anything, event names are literals of this repo
+void writeEscaped(std::ostream &out, std::string_view text)
+{
+    out << '"';
+    for (char symbol : text) {
+        if (symbol == '"' || symbol == '\\') {
+            out << '\\' << symbol;
+        } else if (static_cast<unsigned char>(symbol) < 0x20) {
+            out << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+                << static_cast<int>(symbol) << std::dec;
+        } else {
+            out << symbol;
+        }
+    }
+    out << '"';
+}
+
+} // namespace
+
+namespace detail {
+
+void record(const char *name, uint32_t track, const char *argName,
+            uint32_t arg, int64_t begin, int64_t duration) noexcept
+{
+    auto index = ring.next.fetch_add(1, std::memory_order_relaxed);
+    ring.events[index % ring.capacity] = {.name = name,
+                                          .argName = argName,
+                                          .begin = begin,
+                                          .duration = duration,
+                                          .track = track,
+                                          .arg = arg};
+}
+
+} // namespace detail
+
+void enable(size_t capacity)
+{
+    detail::active.store(false, std::memory_order_relaxed);
+    capacity = std::max<size_t>(capacity, 1);
+    if (ring.capacity != capacity) {
+        ring.events = std::make_unique<Event[]>(capacity);
+        ring.capacity = capacity;
+    }
+    ring.next.store(0, std::memory_order_relaxed);
+    ring.epoch = detail::now();
+    detail::active.store(true, std::memory_order_release);
+}
+
+void disable() noexcept
+{
+    detail::active.store(false, std::memory_order_release);
+}
+
+uint32_t track(std::string_view name)
+{
+    std::lock_guard lock{tracksMutex};
+    // ports reopened by long running fleets and benches keep their row
+    auto known = std::find(tracks.cbegin(), tracks.cend(), name);
+    if (known == tracks.cend()) {
+        known = tracks.emplace(tracks.cend(), name);
+    }
+    return static_cast<uint32_t>(known - tracks.cbegin()) + 1;
+}
+
+void writeChromeJson(std::ostream &out)
+{
+    auto recorded = ring.next.load(std::memory_order_acquire);
+    auto kept = std::min<uint64_t>(recorded, ring.capacity);
+
+    out << "{\"displayTimeUnit\":\"ns\",\"otherData\":{\"dropped\":"
+        << recorded - kept << "},\"traceEvents\":[";
+    bool first = true;
+    {
+        std::lock_guard lock{tracksMutex};
+        for (size_t i = 0; i < tracks.size(); ++i) {
+            out << (first ? "" : ",")
+                << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                   "\"tid\":"
+                << i + 1 << ",\"args\":{\"name\":";
+            writeEscaped(out, tracks[i]);
+            out << "}}";
+            first = false;
+        }
+    }
+
+    // ts and dur are microseconds, fractions keep nanoseconds
+    out << std::fixed << std::setprecision(3);
+    for (auto index = recorded - kept; index < recorded; ++index) {
+        const auto &event = ring.events[index % ring.capacity];
+        out << (first ? "" : ",") << "\n{\"name\":\"" << event.name
+            << "\",\"cat\":\"smp\",\"pid\":1,\"tid\":" << event.track
+            << ",\"ts\":"
+            << static_cast<double>(event.begin - ring.epoch) / 1000.0;
+        if (event.duration < 0) {
+            out << ",\"ph\":\"i\",\"s\":\"t\"";
+        } else {
+            out << ",\"ph\":\"X\",\"dur\":"
+                << static_cast<double>(event.duration) / 1000.0;
+        }
+        if (event.argName) {
+            out << ",\"args\":{\"" << event.argName << "\":" << event.arg
+                << '}';
+        }
+        out << '}';
+        first = false;
+    }
+    out << "\n]}\n";
+}
+
+} // namespace smp::trace
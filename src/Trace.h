@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+
+namespace smp::trace {
+
+/*
+ * Timestamped spans recorded into a preallocated ring, oldest events are
+ * overwritten when it is full. Writers only bump an atomic index, so any
+ * thread may record. Disabled tracing costs one relaxed load per span.
+ * Exported as Chrome trace json, opens in chrome://tracing and Perfetto.
+ */
+
+namespace detail {
+
+inline std::atomic<bool> active{false};
+
+inline int64_t now() noexcept
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+// duration < 0 -> instant event
+void record(const char *name, uint32_t track, const char *argName,
+            uint32_t arg, int64_t begin, int64_t duration) noexcept;
+
+} // namespace detail
+
+[[nodiscard]] inline bool enabled() noexcept
+{
+    return detail::active.load(std::memory_order_relaxed);
+}
+
+// drops recorded events, not to be called while others record
+void enable(size_t capacity = 1 << 16);
+void disable() noexcept;
+
+// row in the viewer, one per port name, registered even if tracing is off
+// so it can be turned on later; the same name gets the same row
+uint32_t track(std::string_view name);
+
+// names and argNames have to be string literals, only pointers are kept
+class Span final {
+public:
+    Span(const char *name, uint32_t track, const char *argName = nullptr,
+         uint32_t arg = 0) noexcept
+        : name{name}, argName{argName}, track{track}, arg{arg},
+          begin{enabled() ? detail::now() : -1}
+    {}
+    Span(const Span &) = delete;
+    Span &operator=(const Span &) = delete;
+
+    ~Span()
+    {
+        if (begin >= 0) {
+            detail::record(name, track, argName, arg, begin,
+                           detail::now() - begin);
+        }
+    }
+
+private:
+    const char *name;
+    const char *argName;
+    uint32_t track;
+    uint32_t arg;
+    int64_t begin; // -1 -> tracing was off
+};
+
+inline void instant(const char *name, uint32_t track,
+                    const char *argName = nullptr, uint32_t arg = 0) noexcept
+{
+    if (enabled()) {
+        detail::record(name, track, argName, arg, detail::now(), -1);
+    }
+}
+
+// events still in the ring, oldest first, while nobody records
+void writeChromeJson(std::ostream &out);
+
+} // namespace smp::trace
@@ -0,0 +1,21 @@
+#include "Transport.h"
+#include "SerialPort.h"
+#ifndef _WIN32
+#include "UnixSocket.h"
+#endif
+
+namespace smp {
+
+std::unique_ptr<Transport> openTransport(std::string_view name,
+                                         uint32_t baudRate)
+{
+#ifndef _WIN32
+    constexpr std::string_view unixPrefix{"unix:"};
+    if (name.starts_with(unixPrefix)) {
+        return std::make_unique<UnixSocket>(name.substr(unixPrefix.size()));
+    }
+#endif
+    return std::make_unique<SerialPort>(name, baudRate);
+}
+
+} // namespace smp
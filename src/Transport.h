@@ -0,0 +1,73 @@
+#pragma once
+
+#include "EventLoop.h"
+#include "Task.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <span>
+#include <string_view>
+
+struct ConstBuffer final {
+    const void *data;
+    uint32_t size;
+};
+
+namespace smp {
+
+/*
+ * Byte stream a channel talks over. Reads and writes never block, waiting
+ * for the other end is up to the backend: a descriptor registered on the
+ * loop for ports and sockets, a timer till the bytes of an in-process line
+ * are due for the loopback.
+ */
+class Transport {
+public:
+    using Deadline = std::chrono::steady_clock::time_point;
+
+    Transport() = default;
+    Transport(const Transport &) = delete;
+    Transport &operator=(const Transport &) = delete;
+    virtual ~Transport() = default;
+
+    // 0 if nothing is buffered, never blocks
+    virtual uint32_t read(void *buffer, uint32_t size) = 0;
+    // 0 if output buffer is full, never blocks
+    virtual uint32_t write(const void *buffer, uint32_t size) = 0;
+    // one vectored write without blocking, written part is dropped from
+    // pending, 0 if output buffer is full
+    virtual uint32_t writeSome(std::span<ConstBuffer> &pending) = 0;
+    // whole frame, waits for room, for writes outside of the loop
+    virtual void writeAll(std::initializer_list<ConstBuffer> buffers) = 0;
+    // co_await -> true if read may return bytes, false on deadline or
+    // hang up
+    virtual Task<bool> readable(EventLoop &loop, Deadline deadline) = 0;
+    // co_await -> true if write may take bytes, false on deadline
+    virtual Task<bool> writable(EventLoop &loop, Deadline deadline) = 0;
+    // after pending output is sent
+    virtual void setBaudRate(uint32_t baudRate) = 0;
+    // trace row named after the endpoint, shared with its channel
+    [[nodiscard]] virtual uint32_t traceTrack() const noexcept = 0;
+};
+
+// after a vectored write, drops what was written from the front of pending
+inline void dropWritten(std::span<ConstBuffer> &pending, size_t written)
+{
+    while (!pending.empty() && written >= pending.front().size) {
+        written -= pending.front().size;
+        pending = pending.subspan(1);
+    }
+    if (!pending.empty()) {
+        pending.front().data =
+            static_cast<const char *>(pending.front().data) + written;
+        pending.front().size -= static_cast<uint32_t>(written);
+    }
+}
+
+// "unix:<path>" -> socket bridge to a device emulator, serial port otherwise
+std::unique_ptr<Transport> openTransport(std::string_view name,
+                                         uint32_t baudRate);
+
+} // namespace smp
@@ -0,0 +1,154 @@
+#include "UnixSocket.h"
+#include "ErrnoException.h"
+#include "Trace.h"
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace smp {
+
+namespace {
+
+// closed peer fails the write instead of killing the process
+#ifdef MSG_NOSIGNAL
+constexpr int sendFlags = MSG_NOSIGNAL;
+#else
+constexpr int sendFlags = 0; // SO_NOSIGPIPE is set on the socket
+#endif
+
+} // namespace
+
+UnixSocket::UnixSocket(std::string_view path)
+    : descriptor{-1}, track{trace::track(path)}
+{
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        throw std::logic_error("Socket path is too long: " +
+                               std::string(path));
+    }
+    std::copy(path.begin(), path.end(), address.sun_path);
+
+    descriptor = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (descriptor == -1) {
+        throw ErrnoException("Can't create socket");
+    }
+#ifdef SO_NOSIGPIPE
+    int on = 1;
+    setsockopt(descriptor, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+    // connect blocks, everything after it doesn't
+    if (connect(descriptor, reinterpret_cast<const sockaddr *>(&address),
+                sizeof(address)) == -1 ||
+        fcntl(descriptor, F_SETFL,
+              fcntl(descriptor, F_GETFL) | O_NONBLOCK) == -1) {
+        ErrnoException error{"Can't connect socket"};
+        close(descriptor);
+        throw error;
+    }
+}
+
+uint32_t UnixSocket::read(void *buffer, uint32_t size)
+{
+    auto result = ::read(descriptor, buffer, size);
+    if (result > 0) {
+        return static_cast<uint32_t>(result);
+    }
+    if (result == 0 && size != 0) {
+        // would be readable forever after
+        throw std::logic_error("Device emulator closed the socket");
+    }
+    if (result == -1 && errno != EAGAIN && errno != EWOULDBLOCK &&
+        errno != EINTR) {
+        throw ErrnoException("Can't read socket");
+    }
+    return 0;
+}
+
+uint32_t UnixSocket::write(const void *buffer, uint32_t size)
+{
+    ConstBuffer whole{buffer, size};
+    std::span<ConstBuffer> pending{&whole, 1};
+    return writeSome(pending);
+}
+
+uint32_t UnixSocket::writeSome(std::span<ConstBuffer> &pending)
+{
+    trace::Span span{"port write", track};
+    std::array<iovec, 8> vectors{};
+    size_t count = std::min(pending.size(), vectors.size());
+    for (size_t i = 0; i < count; ++i) {
+        vectors[i] = {const_cast<void *>(pending[i].data), pending[i].size};
+    }
+    msghdr message{};
+    message.msg_iov = vectors.data();
+    message.msg_iovlen = static_cast<decltype(message.msg_iovlen)>(count);
+
+    ssize_t result;
+    do {
+        result = sendmsg(descriptor, &message, sendFlags);
+    } while (result == -1 && errno == EINTR);
+    if (result == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return 0;
+        }
+        throw ErrnoException("Can't write socket");
+    }
+    dropWritten(pending, static_cast<size_t>(result));
+    return static_cast<uint32_t>(result);
+}
+
+void UnixSocket::writeAll(std::initializer_list<ConstBuffer> buffers)
+{
+    std::array<ConstBuffer, 8> copy{};
+    if (buffers.size() > copy.size()) {
+        throw std::logic_error("Too many buffers for one write");
+    }
+    std::copy(buffers.begin(), buffers.end(), copy.begin());
+    std::span<ConstBuffer> pending{copy.data(), buffers.size()};
+    while (!pending.empty()) {
+        if (writeSome(pending) != 0 || pending.empty()) {
+            continue;
+        }
+        pollfd waited{.fd = descriptor, .events = POLLOUT, .revents = 0};
+        if (poll(&waited, 1, -1) == -1 && errno != EINTR) {
+            throw ErrnoException("Can't poll socket");
+        }
+    }
+}
+
+Task<bool> UnixSocket::readable(EventLoop &loop, Deadline deadline)
+{
+    auto ready = co_await loop.readable(descriptor, deadline);
+    co_return ready;
+}
+
+Task<bool> UnixSocket::writable(EventLoop &loop, Deadline deadline)
+{
+    auto ready = co_await loop.writable(descriptor, deadline);
+    co_return ready;
+}
+
+void UnixSocket::setBaudRate(uint32_t baudRate)
+{
+    trace::instant("set baud", track, "rate", baudRate);
+}
+
+uint32_t UnixSocket::traceTrack() const noexcept { return track; }
+
+UnixSocket::~UnixSocket()
+{
+    if (descriptor != -1) {
+        close(descriptor);
+    }
+}
+
+} // namespace smp
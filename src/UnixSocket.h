@@ -0,0 +1,35 @@
+#pragma once
+
+#include "EventLoop.h"
+#include "Task.h"
+#include "Transport.h"
+#include <cstdint>
+#include <initializer_list>
+#include <span>
+#include <string_view>
+
+namespace smp {
+
+// stream socket to a device emulator listening on path, the emulator paces
+// bytes as its line would, so rate switches are only traced here
+class UnixSocket final : public Transport {
+public:
+    explicit UnixSocket(std::string_view path);
+
+    uint32_t read(void *buffer, uint32_t size) override;
+    uint32_t write(const void *buffer, uint32_t size) override;
+    uint32_t writeSome(std::span<ConstBuffer> &pending) override;
+    void writeAll(std::initializer_list<ConstBuffer> buffers) override;
+    Task<bool> readable(EventLoop &loop, Deadline deadline) override;
+    Task<bool> writable(EventLoop &loop, Deadline deadline) override;
+    void setBaudRate(uint32_t baudRate) override;
+    [[nodiscard]] uint32_t traceTrack() const noexcept override;
+
+    ~UnixSocket() override;
+
+private:
+    int descriptor;
+    uint32_t track;
+};
+
+} // namespace smp
@@ -0,0 +1,668 @@
+#include "Channel.h"
+#include "Checksum.h"
+#include "ErrnoException.h"
+#include "FaultyTransport.h"
+#include "Frame.h"
+#include "Loopback.h"
+#include "Simulator.h"
+#include "Trace.h"
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <csignal>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <unistd.h>
+
+namespace {
+
+using clock = std::chrono::steady_clock;
+
+struct BenchConfig {
+    std::vector<uint32_t> imageSizes{4096, 16384};
+    std::vector<uint32_t> packetSizes{64, 256, 1024};
+    std::vector<uint32_t> baudRates{115200, 230400};
+    std::vector<uint32_t> windowSizes{1, 8};
+    uint32_t features = smp::sim::DeviceConfig{}.features; // device offers
+    double bitErrorRate = 0;
+    std::string transport{"pty"}; // pty, unix or loopback
+    std::chrono::microseconds latency{0}; // of loopback link, each way
+    std::vector<std::string> faults{"clean"}; // profiles, see parseFaults
+    std::vector<uint32_t> fecModes{0}; // 1 -> parity on loading payloads
+    std::string format{"csv"};
+    std::string output{};
+    std::string trace{}; // Chrome trace json of the whole sweep
+};
+
+struct BenchResult {
+    uint32_t imageSize;
+    uint32_t packetSize;
+    uint32_t baudRate;
+    uint32_t windowSize; // negotiated
+    std::string result;
+    double seconds;
+    double payloadBytesPerSecond;
+    double linkUtilisation;
+    uint32_t frames;
+    uint32_t retransmits;
+    double rttP50;
+    double rttP99;
+    double rttMax;
+    double rtoUs; // retransmit timeout the upload ended with
+    std::string payloadSizes; // "size x frames;..." as the sizer chose
+    std::string faults;
+    uint64_t injected; // faults of both directions
+    bool fec;          // requested, device may still refuse
+};
+
+std::vector<uint32_t> parseList(std::string_view list)
+{
+    std::vector<uint32_t> values;
+    while (!list.empty()) {
+        auto comma = list.find(',');
+        auto item = list.substr(0, comma);
+        uint32_t value{};
+        auto [ptr, err] =
+            std::from_chars(item.data(), item.data() + item.size(), value);
+        if (err != std::errc() || ptr != item.data() + item.size()) {
+            throw std::logic_error("Can't convert to number: " +
+                                   std::string(item));
+        }
+        values.push_back(value);
+        list = comma == std::string_view::npos ? std::string_view{}
+                                               : list.substr(comma + 1);
+    }
+    return values;
+}
+
+std::vector<std::string> splitList(std::string_view list)
+{
+    std::vector<std::string> items;
+    while (!list.empty()) {
+        auto comma = list.find(',');
+        items.emplace_back(list.substr(0, comma));
+        list = comma == std::string_view::npos ? std::string_view{}
+                                               : list.substr(comma + 1);
+    }
+    return items;
+}
+
+/*
+ * Preset name or settings joined by '+', e.g. "drop=1e-4+jitter-us=500".
+ * Presets are rough figures of links seen in the field: flips of a noisy
+ * cable, drops of an overrun uart fifo, bursts of a motor switching on.
+ */
+smp::sim::FaultProfile parseFaults(std::string_view spec, uint32_t seed)
+{
+    smp::sim::FaultProfile profile{};
+    profile.seed = seed;
+    if (spec == "clean") {
+        return profile;
+    }
+    if (spec == "flips") {
+        profile.bitErrorRate = 1e-5;
+    } else if (spec == "drops") {
+        profile.dropRate = 1e-4;
+    } else if (spec == "dups") {
+        profile.duplicateRate = 1e-4;
+    } else if (spec == "bursts") {
+        profile.burstRate = 2e-5;
+        profile.burstLength = 16;
+    } else if (spec == "jitter") {
+        profile.jitter = std::chrono::microseconds{2000};
+    } else if (spec == "marginal") {
+        profile.bitErrorRate = 1e-6;
+        profile.dropRate = 1e-5;
+        profile.burstRate = 1e-6;
+        profile.jitter = std::chrono::microseconds{500};
+    } else {
+        while (!spec.empty()) {
+            auto plus = spec.find('+');
+            auto setting = spec.substr(0, plus);
+            auto equals = setting.find('=');
+            if (equals == std::string_view::npos) {
+                throw std::logic_error("Unknown fault profile: " +
+                                       std::string(setting));
+            }
+            auto key = setting.substr(0, equals);
+            auto value = std::string(setting.substr(equals + 1));
+            if (key == "ber") {
+                profile.bitErrorRate = std::stod(value);
+            } else if (key == "drop") {
+                profile.dropRate = std::stod(value);
+            } else if (key == "dup") {
+                profile.duplicateRate = std::stod(value);
+            } else if (key == "burst") {
+                profile.burstRate = std::stod(value);
+            } else if (key == "burst-len") {
+                profile.burstLength =
+                    static_cast<uint32_t>(std::stoul(value, nullptr, 0));
+            } else if (key == "jitter-us") {
+                profile.jitter =
+                    std::chrono::microseconds{std::stoul(value, nullptr, 0)};
+            } else {
+                throw std::logic_error("Unknown fault setting: " +
+                                       std::string(key));
+            }
+            spec = plus == std::string_view::npos ? std::string_view{}
+                                                  : spec.substr(plus + 1);
+        }
+    }
+    return profile;
+}
+
+uint64_t countFaults(const smp::sim::FaultStats &stats)
+{
+    return stats.flippedBits + stats.droppedBytes + stats.duplicatedBytes +
+           stats.burstBytes;
+}
+
+std::vector<char> makeImage(uint32_t size)
+{
+    // code-like random bytes followed by erased flash padding
+    std::mt19937 generator{size};
+    std::uniform_int_distribution<int> byte{0, 255};
+    std::vector<char> image(size, static_cast<char>(0xFF));
+    std::generate_n(image.begin(), size - size / 8,
+                    [&] { return static_cast<char>(byte(generator)); });
+    return image;
+}
+
+double percentileMicros(std::vector<std::chrono::nanoseconds> &samples,
+                        double percentile)
+{
+    if (samples.empty()) {
+        return 0;
+    }
+    std::sort(samples.begin(), samples.end());
+    auto index = static_cast<size_t>(
+        percentile * static_cast<double>(samples.size() - 1) + 0.5);
+    return static_cast<double>(samples[index].count()) / 1000.0;
+}
+
+std::string describeSizes(const std::map<uint32_t, uint32_t> &sizes)
+{
+    std::string text;
+    // biggest first, clean links send little else
+    for (auto it = sizes.rbegin(); it != sizes.rend(); ++it) {
+        if (!text.empty()) {
+            text += ';';
+        }
+        text += std::to_string(it->first) + 'x' + std::to_string(it->second);
+    }
+    return text;
+}
+
+BenchResult runOne(uint32_t imageSize, uint32_t packetSize, uint32_t baudRate,
+                   uint32_t windowSize, const std::string &faults, bool fec,
+                   const BenchConfig &config)
+{
+    smp::sim::DeviceConfig device{};
+    device.features = config.features;
+    device.packetSize = static_cast<uint16_t>(packetSize);
+    device.flashSize = std::max(device.flashSize, imageSize);
+    // loopback runs device in this thread, others on a line of their own
+    std::unique_ptr<smp::sim::LineSimulator> simulator;
+    if (config.transport == "pty") {
+        simulator = std::make_unique<smp::sim::PtySimulator>(device, baudRate);
+    } else if (config.transport == "unix") {
+        simulator = std::make_unique<smp::sim::SocketSimulator>(
+            device, baudRate,
+            "/tmp/stm32_bench_" + std::to_string(getpid()) + ".sock");
+    }
+    std::atomic<bool> stop{false};
+    std::thread line;
+    if (simulator) {
+        simulator->setBitErrorRate(config.bitErrorRate, imageSize ^ packetSize);
+        line = std::thread{[&] { simulator->run(stop); }};
+    }
+
+    BenchResult bench{.imageSize = imageSize,
+                      .packetSize = packetSize,
+                      .baudRate = baudRate,
+                      .windowSize = 1,
+                      .result = "Loaded",
+                      .seconds = 0,
+                      .payloadBytesPerSecond = 0,
+                      .linkUtilisation = 0,
+                      .frames = 0,
+                      .retransmits = 0,
+                      .rttP50 = 0,
+                      .rttP99 = 0,
+                      .rttMax = 0,
+                      .rtoUs = 0,
+                      .payloadSizes = {},
+                      .faults = faults,
+                      .injected = 0,
+                      .fec = fec};
+    try {
+        std::unique_ptr<smp::Transport> transport;
+        if (simulator) {
+            transport = smp::openTransport(simulator->portName(), baudRate);
+        } else {
+            // 8N1 -> 10 bits per byte, as the emulated lines pace
+            transport = std::make_unique<smp::sim::Loopback>(
+                device, smp::sim::LinkModel{.bytesPerSecond = baudRate / 10,
+                                            .latency = config.latency});
+        }
+        // clean runs measure the link alone, without the decorator
+        smp::sim::FaultyTransport *faulty = nullptr;
+        if (faults != "clean") {
+            auto decorated = std::make_unique<smp::sim::FaultyTransport>(
+                std::move(transport),
+                parseFaults(faults, imageSize ^ packetSize));
+            faulty = decorated.get();
+            transport = std::move(decorated);
+        }
+        smp::Channel channel{std::move(transport), baudRate};
+        channel.setWindowSize(static_cast<uint16_t>(windowSize));
+        channel.setFec(fec);
+        channel.handshake();
+        if (channel.handshakeAnswer() != LocalStatusCode::Ok ||
+            channel.negotiate() != LocalStatusCode::Ok) {
+            throw std::logic_error("Handshake failed");
+        }
+        bench.windowSize = channel.window();
+
+        smp::BinMsg msg{makeImage(imageSize)};
+        smp::UploadStats stats{};
+        smp::WireBuffer<smp::Answer> answer{};
+
+        auto begin = clock::now();
+        channel.startLoad(msg);
+        // resent while its answer doesn't come, as uploads see it
+        auto read = channel.getHeaderedMsg(answer.data(), answer.size(),
+                                           smp::action::startLoad);
+        if (read.localCode != LocalStatusCode::Ok ||
+            smp::decode<smp::Answer>(answer.data()).code !=
+                smp::StatusCode::Ok) {
+            bench.result = "StartLoadFailed";
+        } else {
+            auto [localCode, deviceCode] = channel.upload(msg, &stats);
+            if (localCode != LocalStatusCode::Ok ||
+                deviceCode != smp::StatusCode::Ok) {
+                bench.result = "UploadFailed";
+            }
+        }
+        std::chrono::duration<double> elapsed = clock::now() - begin;
+
+        bench.seconds = elapsed.count();
+        bench.payloadBytesPerSecond =
+            static_cast<double>(imageSize) / bench.seconds;
+        bench.linkUtilisation =
+            bench.payloadBytesPerSecond / (static_cast<double>(baudRate) / 10);
+        bench.frames = stats.frames;
+        bench.retransmits = stats.retransmits;
+        bench.rttP50 = percentileMicros(stats.frameRtt, 0.5);
+        bench.rttP99 = percentileMicros(stats.frameRtt, 0.99);
+        bench.rttMax = percentileMicros(stats.frameRtt, 1.0);
+        bench.rtoUs = std::chrono::duration<double, std::micro>(
+                          channel.retransmitTimeout())
+                          .count();
+        bench.payloadSizes = describeSizes(stats.payloadSizes);
+        if (faulty) {
+            bench.injected =
+                countFaults(faulty->sent()) + countFaults(faulty->received());
+        }
+    } catch (const std::exception &error) {
+        bench.result = error.what();
+    }
+
+    stop.store(true);
+    if (line.joinable()) {
+        line.join();
+    }
+    return bench;
+}
+
+struct HashResult {
+    std::string algorithm;
+    uint32_t size;
+    double bytesPerSecond;
+    uint32_t value; // keeps the work observable
+};
+
+template <typename Hash>
+HashResult runHash(std::string algorithm, const std::vector<char> &image,
+                   Hash hash)
+{
+    auto data = reinterpret_cast<const uint8_t *>(image.data());
+    auto size = static_cast<uint32_t>(image.size());
+    uint32_t value = hash(data, size); // warm up caches
+    uint32_t rounds = 0;
+    auto begin = clock::now();
+    std::chrono::duration<double> elapsed{};
+    do {
+        value ^= hash(data, size);
+        rounds += 1;
+        elapsed = clock::now() - begin;
+    } while (elapsed < std::chrono::milliseconds{200});
+    return {std::move(algorithm), size,
+            static_cast<double>(size) * rounds / elapsed.count(), value};
+}
+
+// djb2 vs crc32c over whole image, as startLoad hashes it
+std::vector<HashResult> runHashBench(const std::vector<uint32_t> &sizes)
+{
+    std::vector<HashResult> results;
+    for (auto size : sizes) {
+        auto image = makeImage(size);
+        results.push_back(runHash("djb2", image, [](auto data, auto length) {
+            return smp::djb2(data, length);
+        }));
+        results.push_back(
+            runHash("crc32c_slice8", image, [](auto data, auto length) {
+                return smp::crc32cSlice8(data, length);
+            }));
+        if (smp::crc32cHardwareAvailable()) {
+            results.push_back(
+                runHash("crc32c_hw", image, [](auto data, auto length) {
+                    return smp::crc32c(data, length);
+                }));
+        }
+    }
+    return results;
+}
+
+void writeHashResults(std::ostream &out, const std::vector<HashResult> &results,
+                      bool json)
+{
+    if (!json) {
+        out << "version,algorithm,size,bytes_per_s\n";
+    } else {
+        out << "[\n";
+    }
+    for (size_t i = 0; i < results.size(); ++i) {
+        const auto &hash = results[i];
+        if (json) {
+            out << "  {\"version\": \"" << STM32_CLIENT_VERSION
+                << "\", \"algorithm\": \"" << hash.algorithm
+                << "\", \"size\": " << hash.size
+                << ", \"bytes_per_s\": " << hash.bytesPerSecond << '}'
+                << (i + 1 == results.size() ? "\n" : ",\n");
+        } else {
+            out << STM32_CLIENT_VERSION << ',' << hash.algorithm << ','
+                << hash.size << ',' << hash.bytesPerSecond << '\n';
+        }
+    }
+    if (json) {
+        out << "]\n";
+    }
+}
+
+void writeCsv(std::ostream &out, const std::vector<BenchResult> &results)
+{
+    out << "version,image_size,packet_size,baud,window,result,seconds,"
+           "payload_bytes_per_s,link_utilisation,frames,retransmits,"
+           "rtt_p50_us,rtt_p99_us,rtt_max_us,rto_us,payload_sizes,faults,"
+           "injected_faults,fec\n";
+    for (const auto &bench : results) {
+        out << STM32_CLIENT_VERSION << ',' << bench.imageSize << ','
+            << bench.packetSize << ',' << bench.baudRate << ','
+            << bench.windowSize << ',' << bench.result << ',' << bench.seconds
+            << ',' << bench.payloadBytesPerSecond << ','
+            << bench.linkUtilisation << ',' << bench.frames << ','
+            << bench.retransmits << ',' << bench.rttP50 << ','
+            << bench.rttP99 << ',' << bench.rttMax << ',' << bench.rtoUs
+            << ',' << bench.payloadSizes << ',' << bench.faults << ','
+            << bench.injected << ',' << bench.fec << '\n';
+    }
+}
+
+void writeJson(std::ostream &out, const std::vector<BenchResult> &results)
+{
+    out << "[\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const auto &bench = results[i];
+        out << "  {\"version\": \"" << STM32_CLIENT_VERSION
+            << "\", \"image_size\": " << bench.imageSize
+            << ", \"packet_size\": " << bench.packetSize
+            << ", \"baud\": " << bench.baudRate
+            << ", \"window\": " << bench.windowSize << ", \"result\": \""
+            << bench.result << "\", \"seconds\": " << bench.seconds
+            << ", \"payload_bytes_per_s\": " << bench.payloadBytesPerSecond
+            << ", \"link_utilisation\": " << bench.linkUtilisation
+            << ", \"frames\": " << bench.frames
+            << ", \"retransmits\": " << bench.retransmits
+            << ", \"rtt_p50_us\": " << bench.rttP50
+            << ", \"rtt_p99_us\": " << bench.rttP99
+            << ", \"rtt_max_us\": " << bench.rttMax
+            << ", \"rto_us\": " << bench.rtoUs
+            << ", \"payload_sizes\": \"" << bench.payloadSizes
+            << "\", \"faults\": \"" << bench.faults
+            << "\", \"injected_faults\": " << bench.injected
+            << ", \"fec\": " << (bench.fec ? "true" : "false") << '}'
+            << (i + 1 == results.size() ? "\n" : ",\n");
+    }
+    out << "]\n";
+}
+
+/*
+ * Per sweep point, lowest bit error rate of the fault profiles at which fec
+ * loads at least as fast as plain retransmit. Parity costs a fixed share
+ * of the line, resends grow with the error rate, so above it fec wins.
+ */
+void reportCrossover(const std::vector<BenchResult> &results)
+{
+    using Point = std::tuple<uint32_t, uint32_t, uint32_t, uint32_t>;
+    std::map<Point, std::optional<double>> crossover;
+    for (const auto &fec : results) {
+        if (!fec.fec || fec.result != "Loaded") {
+            continue;
+        }
+        auto plain = std::find_if(
+            results.cbegin(), results.cend(), [&](const BenchResult &bench) {
+                return !bench.fec && bench.imageSize == fec.imageSize &&
+                       bench.packetSize == fec.packetSize &&
+                       bench.baudRate == fec.baudRate &&
+                       bench.windowSize == fec.windowSize &&
+                       bench.faults == fec.faults;
+            });
+        if (plain == results.cend()) {
+            continue;
+        }
+        auto &lowest = crossover[{fec.imageSize, fec.packetSize, fec.baudRate,
+                                  fec.windowSize}];
+        auto ber = parseFaults(fec.faults, 0).bitErrorRate;
+        if ((plain->result != "Loaded" ||
+             fec.payloadBytesPerSecond >= plain->payloadBytesPerSecond) &&
+            (!lowest || ber < *lowest)) {
+            lowest = ber;
+        }
+    }
+    for (const auto &[point, ber] : crossover) {
+        auto [imageSize, packetSize, baudRate, windowSize] = point;
+        std::cerr << "fec crossover, image " << imageSize << " packet "
+                  << packetSize << " baud " << baudRate << " window "
+                  << windowSize << ": ";
+        if (ber) {
+            std::cerr << "ber " << *ber << '\n';
+        } else {
+            std::cerr << "none, plain retransmit is faster\n";
+        }
+    }
+}
+
+/*
+ * Clean line loses nothing, a retransmit there is a timer firing before
+ * the answer could come. It costs a frame and shrinks adaptive payloads,
+ * so a sweep that has one fails.
+ */
+bool reportCleanRetransmits(const std::vector<BenchResult> &results,
+                            const BenchConfig &config)
+{
+    if (config.bitErrorRate > 0) {
+        return false;
+    }
+    bool found = false;
+    for (const auto &bench : results) {
+        if (bench.faults != "clean" || bench.retransmits == 0) {
+            continue;
+        }
+        std::cerr << "regression, " << bench.retransmits
+                  << " retransmits on clean link, image " << bench.imageSize
+                  << " packet " << bench.packetSize << " baud "
+                  << bench.baudRate << " window " << bench.windowSize
+                  << '\n';
+        found = true;
+    }
+    return found;
+}
+
+void usage(const char *program)
+{
+    std::cerr << "Usage: " << program
+              << " [hash] [--sizes N,...] [--packets N,...] [--bauds N,...]"
+                 " [--windows N,...] [--features N] [--ber X]"
+                 " [--transport pty|unix|loopback] [--latency-us N]"
+                 " [--faults profile,...] [--fec 0,1]"
+                 " [--format csv|json] [--output path] [--trace path]\n";
+}
+
+void exceptionHandler()
+{
+    try {
+        throw;
+    } catch (const ErrnoException &error) {
+        std::cerr << error.what() << '\t' << "Errno: " << error.errno_code()
+                  << std::endl;
+    } catch (const std::exception &error) {
+        std::cerr << error.what() << std::endl;
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    BenchConfig config{};
+    try {
+        // hash -> checksum microbenchmark instead of upload sweep
+        bool hashMode = argc > 1 && std::string_view{argv[1]} == "hash";
+        if (hashMode) {
+            config.imageSizes = {1024, 64 * 1024, 1024 * 1024};
+        }
+        for (int i = hashMode ? 2 : 1; i < argc; ++i) {
+            if (i + 1 == argc) {
+                usage(argv[0]);
+                return 1;
+            }
+            std::string_view option{argv[i]};
+            std::string_view value{argv[++i]};
+            if (option == "--sizes") {
+                config.imageSizes = parseList(value);
+            } else if (option == "--packets") {
+                config.packetSizes = parseList(value);
+            } else if (option == "--bauds") {
+                config.baudRates = parseList(value);
+            } else if (option == "--windows") {
+                config.windowSizes = parseList(value);
+            } else if (option == "--features") {
+                config.features = static_cast<uint32_t>(
+                    std::stoul(std::string(value), nullptr, 0));
+            } else if (option == "--ber") {
+                config.bitErrorRate = std::stod(std::string(value));
+            } else if (option == "--transport" &&
+                       (value == "pty" || value == "unix" ||
+                        value == "loopback")) {
+                config.transport = value;
+            } else if (option == "--faults") {
+                config.faults = splitList(value);
+                for (const auto &faults : config.faults) {
+                    parseFaults(faults, 0); // fails before the sweep
+                }
+            } else if (option == "--fec") {
+                config.fecModes = parseList(value);
+            } else if (option == "--latency-us") {
+                config.latency = std::chrono::microseconds{
+                    std::stoul(std::string(value), nullptr, 0)};
+            } else if (option == "--format" &&
+                       (value == "csv" || value == "json")) {
+                config.format = value;
+            } else if (option == "--output") {
+                config.output = value;
+            } else if (option == "--trace") {
+                config.trace = value;
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+
+        if (config.transport == "loopback" && config.bitErrorRate > 0) {
+            throw std::logic_error("Bit errors need a pty or unix line");
+        }
+        std::signal(SIGPIPE, SIG_IGN); // closed sockets fail writes instead
+
+        std::ofstream file;
+        if (!config.output.empty()) {
+            file.open(config.output);
+            if (!file) {
+                throw std::logic_error("Can't open output: " + config.output);
+            }
+        }
+        std::ostream &out = config.output.empty() ? std::cout : file;
+        std::ofstream traceFile;
+        if (!config.trace.empty()) {
+            traceFile.open(config.trace);
+            if (!traceFile) {
+                throw std::logic_error("Can't open trace: " + config.trace);
+            }
+            smp::trace::enable(1 << 20);
+        }
+
+        if (hashMode) {
+            writeHashResults(out, runHashBench(config.imageSizes),
+                             config.format == "json");
+            return 0;
+        }
+
+        std::vector<BenchResult> results;
+        for (auto imageSize : config.imageSizes) {
+            for (auto packetSize : config.packetSizes) {
+                for (auto baudRate : config.baudRates) {
+                    for (auto windowSize : config.windowSizes) {
+                        for (const auto &faults : config.faults) {
+                            for (auto fec : config.fecModes) {
+                                results.push_back(
+                                    runOne(imageSize, packetSize, baudRate,
+                                           windowSize, faults, fec != 0,
+                                           config));
+                                std::cerr << '.' << std::flush;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+        std::cerr << '\n';
+        reportCrossover(results);
+        if (traceFile.is_open()) {
+            smp::trace::disable();
+            smp::trace::writeChromeJson(traceFile);
+        }
+
+        if (config.format == "json") {
+            writeJson(out, results);
+        } else {
+            writeCsv(out, results);
+        }
+        if (reportCleanRetransmits(results, config)) {
+            return 2;
+        }
+    } catch (...) {
+        exceptionHandler();
+        return 1;
+    }
+    return 0;
+}
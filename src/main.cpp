@@ -1,16 +1,59 @@
 #include "CommandProcesser.h"
 #include "ErrnoException.h"
+#include "Fleet.h"
+#include "Trace.h"
 #include <chrono>
+#include <fstream>
 #include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
 
 void exceptionHandler();
+int runMode(int argc, char **argv);
+int traceCommand(int argc, char **argv);
+int flashCommand(int argc, char **argv);
+int scriptCommand(int argc, char **argv);
+
+// script and fleet modes, so CI needn't parse answers
+enum exitCode : int { succeeded = 0, commandFailed = 1, notRun = 2 };
+
+// serial sessions mostly wait on io, one thread interleaves them
+constexpr size_t maxFlashSessions = 32;
+
+// ~10 MB, spans of a few megabytes of image, oldest ones are dropped
+constexpr size_t traceEvents = 1 << 18;
+
+constexpr std::string_view scriptHelp =
+    "Scripts hold one command per line, # starts a comment. Consecutive LED\n"
+    "commands run stop-and-wait; 'pipeline <n>' lets n of them be sent\n"
+    "before their answers are read, for devices that queue that many.\n";
 
 int main(int argc, char **argv)
 {
-    using namespace std::chrono_literals;
+    if (argc > 2 && std::string_view{argv[1]} == "--trace") {
+        return traceCommand(argc, argv);
+    }
+    return runMode(argc, argv);
+}
 
+int runMode(int argc, char **argv)
+{
+    if (argc > 1 && std::string_view{argv[1]} == "--flash") {
+        return flashCommand(argc, argv);
+    }
+    if (argc > 1 && std::string_view{argv[1]} == "--script") {
+        return scriptCommand(argc, argv);
+    }
     if (argc != 3) {
-        std::cerr << "Usage: " << argv[0] << " <port_name> <baud_rate>\n";
+        std::cerr << "Usage: " << argv[0] << " <port_name> <baud_rate>\n"
+                  << "       " << argv[0]
+                  << " --flash <baud_rate> <bin_file> <port_name>...\n"
+                  << "       " << argv[0]
+                  << " --script <port_name> <baud_rate> <script_file|->\n"
+                  << "       " << argv[0]
+                  << " --trace <trace_json> <any of the above>\n"
+                  << scriptHelp;
         return 0;
     }
     std::cin.exceptions(std::ios::badbit | std::ios::failbit);
@@ -33,6 +76,114 @@ int main(int argc, char **argv)
     return 0;
 }
 
+// whole run recorded, written as Chrome trace json when it ends
+int traceCommand(int argc, char **argv)
+{
+    std::ofstream out{argv[2]};
+    if (!out) {
+        std::cerr << "Can't open trace file: " << argv[2] << std::endl;
+        return notRun;
+    }
+    smp::trace::enable(traceEvents);
+    argv[2] = argv[0]; // program name for usage of the traced mode
+    auto result = runMode(argc - 2, argv + 2);
+    smp::trace::disable();
+    smp::trace::writeChromeJson(out);
+    return result;
+}
+
+int flashCommand(int argc, char **argv)
+{
+    if (argc < 5) {
+        std::cerr << "Usage: " << argv[0]
+                  << " --flash <baud_rate> <bin_file> <port_name>...\n";
+        return notRun;
+    }
+    try {
+        auto baudRate = static_cast<uint32_t>(std::stoul(argv[2]));
+        smp::BinMsg image{argv[3]};
+        std::vector<std::string> ports(argv + 4, argv + argc);
+
+        auto begin = std::chrono::steady_clock::now();
+        auto results = flashFleet(ports, baudRate, image,
+                                  std::min(ports.size(), maxFlashSessions));
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - begin;
+
+        size_t flashed = 0;
+        for (const auto &flash : results) {
+            std::cout << flash.port << ": " << flash.result << " ("
+                      << flash.elapsed.count() << " s)\n";
+            flashed += flash.succeeded;
+        }
+        std::cout << "Flashed " << flashed << '/' << results.size()
+                  << ", fleet throughput "
+                  << static_cast<double>(flashed * image.getMsgSize()) /
+                         elapsed.count()
+                  << " bytes/s" << std::endl;
+        return flashed == results.size() ? succeeded : commandFailed;
+    } catch (...) {
+        exceptionHandler();
+    }
+    return notRun;
+}
+
+// whole script at once, answers buffered and printed with a summary
+int scriptCommand(int argc, char **argv)
+{
+    if (argc != 5) {
+        std::cerr << "Usage: " << argv[0]
+                  << " --script <port_name> <baud_rate> <script_file|->\n"
+                  << scriptHelp;
+        return notRun;
+    }
+    try {
+        std::ifstream file;
+        std::string_view path{argv[4]};
+        if (path != "-") {
+            file.open(argv[4]);
+            if (!file) {
+                throw std::logic_error("Can't open script: " +
+                                       std::string(path));
+            }
+        }
+        std::istream &in = path == "-" ? std::cin : file;
+
+        // blank lines and # comments are skipped, numbers kept for report
+        std::vector<std::string> script;
+        std::vector<size_t> lineNumbers;
+        std::string line;
+        for (size_t number = 1; std::getline(in, line); ++number) {
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            if (line.empty() || line.front() == '#') {
+                continue;
+            }
+            script.push_back(line);
+            lineNumbers.push_back(number);
+        }
+
+        CommandProcesser processer{argv[2], std::stoul(argv[3])};
+        auto results = processer.run(script);
+
+        std::string report;
+        size_t failed = 0;
+        for (size_t i = 0; i < results.size(); ++i) {
+            report += std::to_string(lineNumbers[i]) + ": " + script[i] +
+                      ": " + results[i].text + '\n';
+            failed += !results[i].ok;
+        }
+        report += "Script: " + std::to_string(results.size()) +
+                  " commands, " + std::to_string(failed) + " failed\n";
+        std::cout << report << std::flush;
+        return failed ? commandFailed : succeeded;
+    } catch (...) {
+        exceptionHandler();
+    }
+    return notRun;
+}
+
 void exceptionHandler()
 {
     try {
@@ -0,0 +1,124 @@
+#include "ErrnoException.h"
+#include "Simulator.h"
+#include <atomic>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+
+namespace {
+
+std::atomic<bool> stopRequested{false};
+
+void onSignal(int) { stopRequested.store(true); }
+
+void exceptionHandler();
+
+void usage(const char *program)
+{
+    std::cerr << "Usage: " << program
+              << " [--baud N] [--packet-size N] [--id N] [--window N]"
+                 " [--features N] [--flash-size N] [--frame-delay-us N]"
+                 " [--flash-delay-us N] [--max-baud N] [--usart-clock N]"
+                 " [--erase-page N] [--erase-us N] [--ber X] [--seed N]"
+                 " [--socket PATH]\n";
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    smp::sim::DeviceConfig config{};
+    uint32_t baudRate = 0;
+    double bitErrorRate = 0;
+    uint32_t seed = 1;
+    std::string socketPath{}; // empty -> pty
+
+    try {
+        for (int i = 1; i < argc; ++i) {
+            if (i + 1 == argc) {
+                usage(argv[0]);
+                return 1;
+            }
+            std::string_view option{argv[i]};
+            if (option == "--ber") {
+                bitErrorRate = std::stod(argv[++i]);
+                continue;
+            }
+            if (option == "--socket") {
+                socketPath = argv[++i];
+                continue;
+            }
+            auto value = std::stoul(argv[++i], nullptr, 0);
+            if (option == "--baud") {
+                baudRate = static_cast<uint32_t>(value);
+            } else if (option == "--packet-size") {
+                config.packetSize = static_cast<uint16_t>(value);
+            } else if (option == "--id") {
+                config.id = static_cast<uint16_t>(value);
+            } else if (option == "--window") {
+                config.windowSize = static_cast<uint16_t>(value);
+            } else if (option == "--features") {
+                config.features = static_cast<uint32_t>(value);
+            } else if (option == "--flash-size") {
+                config.flashSize = static_cast<uint32_t>(value);
+            } else if (option == "--frame-delay-us") {
+                config.frameDelay = std::chrono::microseconds{value};
+            } else if (option == "--flash-delay-us") {
+                config.flashWriteDelay = std::chrono::microseconds{value};
+            } else if (option == "--erase-page") {
+                config.erasePageSize = static_cast<uint32_t>(value);
+            } else if (option == "--erase-us") {
+                config.pageEraseTime = std::chrono::microseconds{value};
+            } else if (option == "--max-baud") {
+                config.maxBaudRate = static_cast<uint32_t>(value);
+            } else if (option == "--usart-clock") {
+                config.usartClock = static_cast<uint32_t>(value);
+            } else if (option == "--seed") {
+                seed = static_cast<uint32_t>(value);
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        if (config.packetSize <= sizeof(smp::LoadHeader)) {
+            throw std::logic_error("Packet size must be bigger than load header");
+        }
+
+        std::unique_ptr<smp::sim::LineSimulator> simulator;
+        if (socketPath.empty()) {
+            simulator =
+                std::make_unique<smp::sim::PtySimulator>(config, baudRate);
+        } else {
+            simulator = std::make_unique<smp::sim::SocketSimulator>(
+                config, baudRate, socketPath);
+        }
+        simulator->setBitErrorRate(bitErrorRate, seed);
+        std::signal(SIGINT, onSignal);
+        std::signal(SIGTERM, onSignal);
+        std::signal(SIGPIPE, SIG_IGN); // clients leaving are seen by poll
+        std::cout << "Device: " << simulator->portName() << std::endl;
+        simulator->run(stopRequested);
+    } catch (...) {
+        exceptionHandler();
+        return 1;
+    }
+    return 0;
+}
+
+namespace {
+
+void exceptionHandler()
+{
+    try {
+        throw;
+    } catch (const ErrnoException &error) {
+        std::cerr << error.what() << '\t' << "Errno: " << error.errno_code()
+                  << std::endl;
+    } catch (const std::exception &error) {
+        std::cerr << error.what() << std::endl;
+    }
+}
+
+} // namespace
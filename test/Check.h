@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdio>
+
+// plain checks, a test exits non-zero if any of them failed
+namespace smp::test {
+
+inline int failures = 0;
+
+inline void check(bool ok, const char *text, const char *file, int line)
+{
+    if (!ok) {
+        std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, text);
+        failures += 1;
+    }
+}
+
+inline int result() noexcept { return failures ? 1 : 0; }
+
+} // namespace smp::test
+
+#define CHECK(condition)                                                       \
+    smp::test::check(static_cast<bool>(condition), #condition, __FILE__,       \
+                     __LINE__)
@@ -0,0 +1,129 @@
+#include "Check.h"
+#include "Checksum.h"
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+using smp::crc32c;
+using smp::crc32cSlice8;
+
+namespace {
+
+// bit by bit, as the polynomial is defined
+uint32_t crc32cReference(const uint8_t *buffer, uint32_t size)
+{
+    uint32_t crc = 0xFFFFFFFF;
+    for (uint32_t i = 0; i < size; ++i) {
+        crc ^= buffer[i];
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = crc & 1 ? crc >> 1 ^ 0x82F63B78 : crc >> 1;
+        }
+    }
+    return ~crc;
+}
+
+std::vector<uint8_t> randomBytes(size_t size, uint32_t seed)
+{
+    std::mt19937 noise{seed};
+    std::vector<uint8_t> bytes(size);
+    for (auto &byte : bytes) {
+        byte = static_cast<uint8_t>(noise());
+    }
+    return bytes;
+}
+
+// standard check value and iSCSI vectors of RFC 3720
+void testKnownValues()
+{
+    const uint8_t check[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+    CHECK(crc32c(check, sizeof(check)) == 0xE3069283);
+    CHECK(crc32cSlice8(check, sizeof(check)) == 0xE3069283);
+    CHECK(crc32c(check, 0) == 0);
+    CHECK(crc32cSlice8(check, 0) == 0);
+
+    std::vector<uint8_t> zeros(32, 0x00);
+    std::vector<uint8_t> ones(32, 0xFF);
+    std::vector<uint8_t> ascending(32);
+    std::vector<uint8_t> descending(32);
+    for (uint8_t i = 0; i < 32; ++i) {
+        ascending[i] = i;
+        descending[i] = static_cast<uint8_t>(31 - i);
+    }
+    for (auto *crc : {&crc32c, &crc32cSlice8}) {
+        CHECK((*crc)(zeros.data(), 32, 0) == 0x8A9136AA);
+        CHECK((*crc)(ones.data(), 32, 0) == 0x62A8AB43);
+        CHECK((*crc)(ascending.data(), 32, 0) == 0x46DD794E);
+        CHECK((*crc)(descending.data(), 32, 0) == 0x113FDB5C);
+    }
+}
+
+// hardware path, if the host has it, matches table and bitwise ones at
+// every length and alignment, tails and 8 byte blocks alike
+void testImplementationsAgree()
+{
+    std::printf("crc32c hardware: %s\n",
+                smp::crc32cHardwareAvailable() ? "yes" : "no");
+    auto bytes = randomBytes(4096 + 16, 1);
+    for (uint32_t offset = 0; offset < 8; ++offset) {
+        for (uint32_t size = 0; size < 300; ++size) {
+            auto *data = bytes.data() + offset;
+            auto expected = crc32cReference(data, size);
+            CHECK(crc32c(data, size) == expected);
+            CHECK(crc32cSlice8(data, size) == expected);
+        }
+    }
+    for (uint32_t size : {1024u, 4095u, 4096u}) {
+        auto expected = crc32cReference(bytes.data() + 3, size);
+        CHECK(crc32c(bytes.data() + 3, size) == expected);
+        CHECK(crc32cSlice8(bytes.data() + 3, size) == expected);
+    }
+}
+
+// frame hashes are chained over header and payload
+void testChaining()
+{
+    auto bytes = randomBytes(200, 2);
+    const auto size = static_cast<uint32_t>(bytes.size());
+    const auto whole = crc32c(bytes.data(), size);
+    for (uint32_t split = 0; split <= size; ++split) {
+        auto first = crc32c(bytes.data(), split);
+        CHECK(crc32c(bytes.data() + split, size - split, first) == whole);
+        auto firstTable = crc32cSlice8(bytes.data(), split);
+        CHECK(crc32cSlice8(bytes.data() + split, size - split, firstTable) ==
+              whole);
+        // either implementation may continue the other one's hash
+        CHECK(crc32cSlice8(bytes.data() + split, size - split, first) ==
+              whole);
+    }
+    // three pieces, one of them empty
+    auto chained = crc32c(bytes.data(), 10);
+    chained = crc32c(bytes.data() + 10, 0, chained);
+    chained = crc32c(bytes.data() + 10, size - 10, chained);
+    CHECK(chained == whole);
+}
+
+void testChecksumDispatch()
+{
+    auto bytes = randomBytes(64, 3);
+    using smp::HashKind;
+    CHECK(smp::checksum(HashKind::crc32c, bytes.data(), 64) ==
+          crc32c(bytes.data(), 64));
+    CHECK(smp::checksum(HashKind::djb2, bytes.data(), 64) ==
+          smp::djb2(bytes.data(), 64));
+    CHECK(smp::checksum(HashKind::djb2, bytes.data(), 0) == 5381);
+    auto start = smp::checksum(HashKind::djb2, bytes.data(), 20);
+    CHECK(smp::checksum(HashKind::djb2, bytes.data() + 20, 44, start) ==
+          smp::djb2(bytes.data(), 64));
+}
+
+} // namespace
+
+int main()
+{
+    testKnownValues();
+    testImplementationsAgree();
+    testChaining();
+    testChecksumDispatch();
+    return smp::test::result();
+}
@@ -0,0 +1,137 @@
+#include "Check.h"
+#include "Fec.h"
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace fec = smp::fec;
+
+namespace {
+
+constexpr uint32_t blockWire = fec::blockData + fec::parityBytes;
+
+std::vector<uint8_t> randomBytes(size_t size, std::mt19937 &noise)
+{
+    std::vector<uint8_t> bytes(size);
+    for (auto &byte : bytes) {
+        byte = static_cast<uint8_t>(noise());
+    }
+    return bytes;
+}
+
+// flips count distinct bytes of wire[begin, end), parity included
+void corrupt(std::vector<uint8_t> &wire, size_t begin, size_t end,
+             size_t count, std::mt19937 &noise)
+{
+    std::vector<size_t> positions(end - begin);
+    for (size_t i = 0; i < positions.size(); ++i) {
+        positions[i] = begin + i;
+    }
+    std::shuffle(positions.begin(), positions.end(), noise);
+    for (size_t i = 0; i < count; ++i) {
+        wire[positions[i]] ^= static_cast<uint8_t>(noise() % 255 + 1);
+    }
+}
+
+std::vector<uint8_t> encoded(const std::vector<uint8_t> &data)
+{
+    std::vector<uint8_t> wire;
+    fec::encode(data, wire);
+    return wire;
+}
+
+std::vector<uint8_t> stripped(const std::vector<uint8_t> &wire)
+{
+    std::vector<uint8_t> data;
+    fec::strip(wire, data);
+    return data;
+}
+
+void testIntact()
+{
+    std::mt19937 noise{1};
+    for (uint32_t size : {1u, 100u, fec::blockData, fec::blockData + 1,
+                          3 * fec::blockData + 17}) {
+        auto data = randomBytes(size, noise);
+        auto wire = encoded(data);
+        CHECK(wire.size() == fec::encodedSize(size));
+        CHECK(fec::correct(wire) == 0u);
+        CHECK(stripped(wire) == data);
+    }
+}
+
+// last block is shortened, errors in it are found within its length
+void testRepairsUpToHalfParity()
+{
+    std::mt19937 noise{2};
+    for (uint32_t size : {40u, fec::blockData, 2 * fec::blockData + 53}) {
+        for (size_t broken = 1; broken <= fec::parityBytes / 2; ++broken) {
+            for (int round = 0; round < 20; ++round) {
+                auto data = randomBytes(size, noise);
+                auto wire = encoded(data);
+                size_t blocks = 0;
+                for (size_t begin = 0; begin < wire.size();
+                     begin += blockWire, ++blocks) {
+                    corrupt(wire, begin,
+                            std::min<size_t>(begin + blockWire, wire.size()),
+                            broken, noise);
+                }
+                auto repaired = fec::correct(wire);
+                CHECK(repaired == static_cast<uint32_t>(broken * blocks));
+                CHECK(stripped(wire) == data);
+            }
+        }
+    }
+}
+
+// too many for the parity in a shortened block, the Chien search finds
+// fewer roots than the locator degree and the block is reported broken
+void testTooManyBroken()
+{
+    std::mt19937 noise{3};
+    for (uint32_t size : {60u, fec::blockData + 90}) {
+        for (size_t broken : {size_t{5}, size_t{6}, size_t{8}, size_t{20}}) {
+            for (int round = 0; round < 20; ++round) {
+                auto wire = encoded(randomBytes(size, noise));
+                auto last = (wire.size() - 1) / blockWire * blockWire;
+                corrupt(wire, last, wire.size(), broken, noise);
+                CHECK(!fec::correct(wire));
+            }
+        }
+    }
+}
+
+// a full block may land within 4 bytes of another codeword, about 1 in 4!
+// of such patterns is miscorrected, frame hash catches those
+void testMiscorrectionIsRare()
+{
+    std::mt19937 noise{4};
+    int accepted = 0;
+    constexpr int rounds = 500;
+    for (int round = 0; round < rounds; ++round) {
+        auto wire = encoded(randomBytes(fec::blockData, noise));
+        corrupt(wire, 0, wire.size(), 5 + round % 4, noise);
+        accepted += fec::correct(wire) ? 1 : 0;
+    }
+    CHECK(accepted < rounds / 10);
+}
+
+void testWrongLength()
+{
+    // a block of parity alone holds no data
+    std::vector<uint8_t> wire(blockWire + fec::parityBytes);
+    CHECK(!fec::correct(wire));
+}
+
+} // namespace
+
+int main()
+{
+    testIntact();
+    testRepairsUpToHalfParity();
+    testTooManyBroken();
+    testMiscorrectionIsRare();
+    testWrongLength();
+    return smp::test::result();
+}
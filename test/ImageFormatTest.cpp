@@ -0,0 +1,300 @@
+#include "Check.h"
+#include "ImageFormat.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <initializer_list>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using smp::ImageFormat;
+using smp::Segment;
+
+namespace {
+
+std::string hexByte(uint8_t byte)
+{
+    char text[3];
+    std::snprintf(text, sizeof(text), "%02X", byte);
+    return text;
+}
+
+// ":LLAAAATT<data>CC" with a valid checksum
+std::string intelRecord(uint8_t type, uint16_t address,
+                        std::vector<uint8_t> data)
+{
+    std::vector<uint8_t> bytes{static_cast<uint8_t>(data.size()),
+                               static_cast<uint8_t>(address >> 8),
+                               static_cast<uint8_t>(address), type};
+    bytes.insert(bytes.end(), data.begin(), data.end());
+    uint8_t sum = 0;
+    std::string line = ":";
+    for (auto byte : bytes) {
+        line += hexByte(byte);
+        sum = static_cast<uint8_t>(sum + byte);
+    }
+    return line + hexByte(static_cast<uint8_t>(-sum)) + "\n";
+}
+
+// "S<type><count><address><data><checksum>" with addressSize bytes of address
+std::string sRecord(int type, size_t addressSize, uint32_t address,
+                    std::vector<uint8_t> data)
+{
+    std::vector<uint8_t> bytes{
+        static_cast<uint8_t>(addressSize + data.size() + 1)};
+    for (size_t i = addressSize; i-- > 0;) {
+        bytes.push_back(static_cast<uint8_t>(address >> i * 8));
+    }
+    bytes.insert(bytes.end(), data.begin(), data.end());
+    uint8_t sum = 0;
+    std::string line = "S" + std::to_string(type);
+    for (auto byte : bytes) {
+        line += hexByte(byte);
+        sum = static_cast<uint8_t>(sum + byte);
+    }
+    return line + hexByte(static_cast<uint8_t>(~sum)) + "\n";
+}
+
+std::vector<Segment> read(ImageFormat format, const std::string &text)
+{
+    return smp::readSegments(format, {text.data(), text.size()});
+}
+
+// message of the logic_error read throws, empty if it didn't
+std::string readError(ImageFormat format, const std::string &text)
+{
+    try {
+        read(format, text);
+    } catch (const std::logic_error &error) {
+        return error.what();
+    }
+    return {};
+}
+
+bool isSegment(const Segment &segment, uint32_t address,
+               std::vector<uint8_t> bytes)
+{
+    return segment.address == address && segment.bytes == bytes;
+}
+
+void testIntelHex()
+{
+    // well known record, checksum computed by hand
+    auto segments = read(ImageFormat::intelHex,
+                         ":0300300002337A1E\r\n:00000001FF\r\n");
+    CHECK(segments.size() == 1);
+    CHECK(isSegment(segments[0], 0x30, {0x02, 0x33, 0x7A}));
+
+    // contiguous records join, a gap starts a new segment, extended linear
+    // and segment addresses move the base, data after end of file is ignored
+    segments = read(ImageFormat::intelHex,
+                    intelRecord(0x04, 0, {0x08, 0x00}) +
+                        intelRecord(0x00, 0x0000, {1, 2}) + "\n  \n" +
+                        intelRecord(0x00, 0x0002, {3}) +
+                        intelRecord(0x05, 0, {0x08, 0, 0, 0x01}) +
+                        intelRecord(0x00, 0x0100, {4}) +
+                        intelRecord(0x02, 0, {0x10, 0x00}) +
+                        intelRecord(0x00, 0x0010, {5}) +
+                        intelRecord(0x01, 0, {}) +
+                        intelRecord(0x00, 0x0200, {6}));
+    CHECK(segments.size() == 3);
+    CHECK(isSegment(segments[0], 0x08000000, {1, 2, 3}));
+    CHECK(isSegment(segments[1], 0x08000100, {4}));
+    CHECK(isSegment(segments[2], 0x10010, {5}));
+
+    auto good = intelRecord(0x00, 0, {1, 2});
+    auto badSum = good;
+    badSum[badSum.size() - 2] = badSum[badSum.size() - 2] == '0' ? '1' : '0';
+    CHECK(readError(ImageFormat::intelHex, good + badSum) ==
+          "Broken Intel HEX record at line 2");
+    CHECK(!readError(ImageFormat::intelHex, "0200000001020B\n").empty());
+    CHECK(!readError(ImageFormat::intelHex, ":02000000010\n").empty());
+    CHECK(!readError(ImageFormat::intelHex, ":0G\n").empty());
+    // length byte disagrees with the record
+    CHECK(!readError(ImageFormat::intelHex, ":0300000001020A\n").empty());
+    CHECK(!readError(ImageFormat::intelHex,
+                     intelRecord(0x04, 0, {0x08})).empty());
+    CHECK(!readError(ImageFormat::intelHex, intelRecord(0x06, 0, {})).empty());
+}
+
+void testSRecord()
+{
+    // well known S1 record, checksum computed by hand
+    auto segments = read(ImageFormat::sRecord, "S1061000AABBCCB8\n");
+    CHECK(segments.size() == 1);
+    CHECK(isSegment(segments[0], 0x1000, {0xAA, 0xBB, 0xCC}));
+
+    // header, count and start records carry nothing to flash
+    segments = read(ImageFormat::sRecord,
+                    sRecord(0, 2, 0, {'h', 'd', 'r'}) +
+                        sRecord(1, 2, 0x0010, {1, 2}) +
+                        sRecord(1, 2, 0x0012, {3}) +
+                        sRecord(2, 3, 0x123456, {4, 5}) +
+                        sRecord(3, 4, 0x08000000, {6}) +
+                        sRecord(5, 2, 4, {}) +
+                        sRecord(7, 4, 0x08000000, {}));
+    CHECK(segments.size() == 3);
+    CHECK(isSegment(segments[0], 0x10, {1, 2, 3}));
+    CHECK(isSegment(segments[1], 0x123456, {4, 5}));
+    CHECK(isSegment(segments[2], 0x08000000, {6}));
+
+    auto good = sRecord(1, 2, 0, {1});
+    auto badSum = good;
+    badSum[badSum.size() - 2] = badSum[badSum.size() - 2] == '0' ? '1' : '0';
+    CHECK(readError(ImageFormat::sRecord, good + good + badSum) ==
+          "Broken S-record at line 3");
+    CHECK(!readError(ImageFormat::sRecord, "X1061000AABBCCB8\n").empty());
+    CHECK(!readError(ImageFormat::sRecord, "S4030000FC\n").empty());
+    // count says more than the line holds
+    CHECK(!readError(ImageFormat::sRecord, "S1071000AABBCCB8\n").empty());
+    // count too short for the address of the type
+    CHECK(!readError(ImageFormat::sRecord, "S3030000FC\n").empty());
+}
+
+struct ProgramHeader final {
+    uint32_t type;
+    uint32_t offset;
+    uint32_t physicalAddress;
+    uint32_t fileSize;
+};
+
+template <typename T>
+void writeAt(std::vector<char> &content, size_t offset, T value)
+{
+    std::memcpy(content.data() + offset, &value, sizeof(T));
+}
+
+// 32 bit little endian ELF with program headers right after its header,
+// segment data is appended in order
+std::vector<char> elfImage(std::initializer_list<ProgramHeader> headers,
+                           const std::vector<char> &data)
+{
+    constexpr size_t headerSize = 52;
+    constexpr size_t programHeaderSize = 32;
+    std::vector<char> content(headerSize + headers.size() * programHeaderSize);
+    std::memcpy(content.data(), "\x7F" "ELF", 4);
+    content[4] = 1; // 32 bit
+    content[5] = 1; // little endian
+    writeAt<uint32_t>(content, 28, headerSize);
+    writeAt<uint16_t>(content, 42, programHeaderSize);
+    writeAt<uint16_t>(content, 44, static_cast<uint16_t>(headers.size()));
+    size_t header = headerSize;
+    for (const auto &program : headers) {
+        writeAt<uint32_t>(content, header, program.type);
+        writeAt<uint32_t>(content, header + 4, program.offset);
+        writeAt<uint32_t>(content, header + 8, 0x20000000); // virtual, unused
+        writeAt<uint32_t>(content, header + 12, program.physicalAddress);
+        writeAt<uint32_t>(content, header + 16, program.fileSize);
+        header += programHeaderSize;
+    }
+    content.insert(content.end(), data.begin(), data.end());
+    return content;
+}
+
+std::string elfError(const std::vector<char> &content)
+{
+    try {
+        smp::readSegments(ImageFormat::elf, content);
+    } catch (const std::logic_error &error) {
+        return error.what();
+    }
+    return {};
+}
+
+void testElf()
+{
+    constexpr uint32_t data = 52 + 4 * 32;
+    auto content = elfImage({{1, data, 0x08000000, 4},
+                             {1, data, 0x08000010, 0}, // bss
+                             {4, data, 0x08000020, 4}, // note
+                             {1, data + 4, 0x08000004, 2}},
+                            {1, 2, 3, 4, 5, 6});
+    auto segments = smp::readSegments(ImageFormat::elf, content);
+    CHECK(segments.size() == 1);
+    CHECK(isSegment(segments[0], 0x08000000, {1, 2, 3, 4, 5, 6}));
+
+    CHECK(!elfError(std::vector<char>(content.begin(), content.begin() + 51))
+               .empty());
+    auto bigEndian = content;
+    bigEndian[5] = 2;
+    CHECK(elfError(bigEndian) == "Only 32 bit little endian ELF is supported");
+    auto sixtyFour = content;
+    sixtyFour[4] = 2;
+    CHECK(!elfError(sixtyFour).empty());
+    auto moreHeaders = content;
+    writeAt<uint16_t>(moreHeaders, 44, 40);
+    CHECK(elfError(moreHeaders) == "Broken ELF program headers");
+    constexpr uint32_t shortData = 52 + 2 * 32;
+    CHECK(elfError(elfImage({{1, shortData, 0, 4}, {1, shortData, 4, 8}},
+                            {1, 2, 3, 4})) == "Broken ELF program header 1");
+}
+
+void testImageFormat()
+{
+    std::vector<char> elf{0x7F, 'E', 'L', 'F', 1, 1};
+    std::vector<char> text{':', '0', '0'};
+    CHECK(smp::imageFormat("fw.hex", elf) == ImageFormat::elf);
+    CHECK(smp::imageFormat("fw.bin", elf) == ImageFormat::elf);
+    CHECK(smp::imageFormat("fw.HEX", text) == ImageFormat::intelHex);
+    CHECK(smp::imageFormat("fw.ihx", text) == ImageFormat::intelHex);
+    CHECK(smp::imageFormat("fw.s19", text) == ImageFormat::sRecord);
+    CHECK(smp::imageFormat("fw.Mot", text) == ImageFormat::sRecord);
+    CHECK(smp::imageFormat("fw.bin", text) == ImageFormat::binary);
+    CHECK(smp::imageFormat("fw", {}) == ImageFormat::binary);
+    CHECK(smp::readSegments(ImageFormat::binary, text).empty());
+}
+
+std::string flattenError(std::vector<Segment> segments)
+{
+    try {
+        smp::flatten(std::move(segments));
+    } catch (const std::logic_error &error) {
+        return error.what();
+    }
+    return {};
+}
+
+void testFlatten()
+{
+    auto empty = smp::flatten({});
+    CHECK(empty.bytes.empty());
+
+    // out of order, gaps are erased flash
+    auto flat = smp::flatten({{0x1006, {7, 8}}, {0x1000, {1, 2}},
+                              {0x1002, {3}}});
+    CHECK(flat.baseAddress == 0x1000);
+    const std::vector<char> gapped{1, 2, 3, '\xFF', '\xFF', '\xFF', 7, 8};
+    CHECK(flat.bytes == gapped);
+
+    CHECK(flattenError({{0x1000, {1, 2, 3}}, {0x1002, {4}}}) ==
+          "Image segments overlap at address 4098");
+    CHECK(flattenError({{0x1000, {1, 2}}, {0x1000, {3}}}) ==
+          "Image segments overlap at address 4096");
+    // touching segments don't overlap
+    CHECK(flattenError({{0x1000, {1, 2}}, {0x1002, {3}}}).empty());
+
+    // 256 MiB is the most flash the protocol addresses, checked before
+    // anything is allocated
+    constexpr uint32_t maxSpan = 256 * 1024 * 1024;
+    CHECK(flattenError({{0x08000000, {1}}, {0x08000000 + maxSpan, {2}}}) ==
+          "Image segments span too much to flash");
+    CHECK(flattenError({{0, {1}}, {0xFFFFFFFF, {2}}}) ==
+          "Image segments span too much to flash");
+    flat = smp::flatten({{0x08000000, {1}}, {0x08000000 + maxSpan - 1, {2}}});
+    CHECK(flat.bytes.size() == maxSpan);
+    CHECK(flat.bytes.front() == 1 && flat.bytes.back() == 2);
+    CHECK(flat.bytes[maxSpan / 2] == '\xFF');
+}
+
+} // namespace
+
+int main()
+{
+    testIntelHex();
+    testSRecord();
+    testElf();
+    testImageFormat();
+    testFlatten();
+    return smp::test::result();
+}
@@ -0,0 +1,144 @@
+#include "BinMsg.h"
+#include "Check.h"
+#include "ImageManifest.h"
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr uint32_t blockSize = 64;
+
+fs::path scratchFile(const std::string &name)
+{
+    return fs::temp_directory_path() /
+           ("smp-manifest-test-" + name);
+}
+
+fs::path manifestOf(const fs::path &image)
+{
+    auto path = image;
+    path += ".manifest";
+    return path;
+}
+
+void writeFile(const fs::path &path, const std::string &content)
+{
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out << content;
+}
+
+// two records 0x100 apart, flattened to 0x104 bytes from a 52 byte file
+const std::string hexImage = ":0400000001020304F2\n"
+                             ":0401000005060708E1\n"
+                             ":00000001FF\n";
+constexpr uint64_t hexImageSize = 0x104;
+
+std::vector<uint32_t> hashesOf(const smp::BinMsg &image)
+{
+    auto hashes = image.blockHashes(smp::HashKind::crc32c, blockSize);
+    return {hashes.begin(), hashes.end()};
+}
+
+// hashes of a flattened image outlive the file size check
+void testSegmentImageKeepsBlocks()
+{
+    auto path = scratchFile("image.hex");
+    writeFile(path, hexImage);
+    fs::remove(manifestOf(path));
+
+    std::vector<uint32_t> first;
+    {
+        smp::BinMsg image{path.string()};
+        CHECK(image.getMsgSize() == hexImageSize);
+        first = hashesOf(image);
+        image.saveManifest();
+    }
+    auto manifest = smp::ImageManifest::of(path);
+    CHECK(manifest && manifest->size == hexImage.size());
+    CHECK(manifest && manifest->imageSize == hexImageSize);
+    CHECK(manifest && manifest->blocks.size() == 1 &&
+          manifest->blocks[0].hashes == first);
+
+    // kept hashes are used, nothing new to save
+    {
+        smp::BinMsg image{path.string()};
+        fs::remove(manifestOf(path));
+        CHECK(hashesOf(image) == first);
+        image.saveManifest();
+    }
+    CHECK(!fs::exists(manifestOf(path)));
+    fs::remove(path);
+}
+
+// a manifest kept for another image length is dropped, not trusted
+void testOtherImageSizeIsDropped()
+{
+    auto path = scratchFile("stale.hex");
+    writeFile(path, hexImage);
+    auto manifest = smp::ImageManifest::of(path);
+    CHECK(manifest.has_value());
+    if (!manifest) {
+        return;
+    }
+    manifest->imageSize = blockSize;
+    manifest->blocks.push_back({.kind = smp::HashKind::crc32c,
+                                .blockSize = blockSize,
+                                .hashes = {0x12345678}});
+    CHECK(manifest->write(path));
+    auto kept = smp::ImageManifest::of(path);
+    CHECK(kept && kept->imageSize == blockSize && kept->blocks.size() == 1);
+
+    {
+        smp::BinMsg image{path.string()};
+        auto hashes = hashesOf(image);
+        CHECK(hashes.size() == (hexImageSize + blockSize - 1) / blockSize);
+        CHECK(hashes.front() != 0x12345678);
+        image.saveManifest();
+    }
+    kept = smp::ImageManifest::of(path);
+    CHECK(kept && kept->imageSize == hexImageSize);
+    fs::remove(manifestOf(path));
+    fs::remove(path);
+}
+
+// block count not matching the kept image length ends the manifest
+void testWrongBlockCount()
+{
+    auto path = scratchFile("image.bin");
+    writeFile(path, std::string(100, 'x'));
+    auto manifest = smp::ImageManifest::of(path);
+    CHECK(manifest.has_value());
+    if (!manifest) {
+        return;
+    }
+    manifest->imageSize = 100;
+    manifest->hashes[0] = 7;
+    manifest->blocks.push_back({.kind = smp::HashKind::crc32c,
+                                .blockSize = blockSize,
+                                .hashes = {1, 2}});
+    manifest->blocks.push_back({.kind = smp::HashKind::crc32c,
+                                .blockSize = 32,
+                                .hashes = {1, 2, 3}});
+    CHECK(manifest->write(path));
+    auto kept = smp::ImageManifest::of(path);
+    CHECK(kept && kept->hashes[0] == 7u);
+    CHECK(kept && kept->blocks.size() == 1 &&
+          kept->blocks[0].blockSize == blockSize);
+    fs::remove(manifestOf(path));
+    fs::remove(path);
+}
+
+} // namespace
+
+int main()
+{
+    testSegmentImageKeepsBlocks();
+    testOtherImageSizeIsDropped();
+    testWrongBlockCount();
+    return smp::test::result();
+}
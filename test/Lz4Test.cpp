@@ -0,0 +1,136 @@
+#include "Check.h"
+#include "Lz4.h"
+#include <cstdint>
+#include <random>
+#include <span>
+#include <vector>
+
+using smp::lz4Compress;
+using smp::lz4Decompress;
+
+namespace {
+
+std::vector<uint8_t> randomBytes(size_t size, uint32_t seed)
+{
+    std::mt19937 noise{seed};
+    std::vector<uint8_t> bytes(size);
+    for (auto &byte : bytes) {
+        byte = static_cast<uint8_t>(noise());
+    }
+    return bytes;
+}
+
+// few distinct words, compresses like code does
+std::vector<uint8_t> repetitiveBytes(size_t size, uint32_t seed)
+{
+    std::mt19937 noise{seed};
+    const auto words = randomBytes(64, seed);
+    std::vector<uint8_t> bytes;
+    while (bytes.size() < size) {
+        auto word = noise() % 16 * 4;
+        bytes.insert(bytes.end(), words.begin() + word,
+                     words.begin() + word + 4);
+    }
+    bytes.resize(size);
+    return bytes;
+}
+
+bool roundTrips(const std::vector<uint8_t> &data)
+{
+    std::vector<uint8_t> packed(data.size() + data.size() / 255 + 16);
+    auto size = lz4Compress(data, packed);
+    if (size == 0) {
+        return false;
+    }
+    packed.resize(size);
+    std::vector<uint8_t> unpacked(data.size());
+    return lz4Decompress(packed, unpacked) && unpacked == data;
+}
+
+void testRoundTrip()
+{
+    CHECK(roundTrips({}));
+    CHECK(roundTrips({1, 2, 3}));
+    CHECK(roundTrips(std::vector<uint8_t>(11, 0xAA))); // too short to match
+    CHECK(roundTrips(std::vector<uint8_t>(4096, 0xFF)));
+    for (uint32_t seed = 0; seed < 8; ++seed) {
+        CHECK(roundTrips(randomBytes(1000 + seed * 131, seed)));
+        CHECK(roundTrips(repetitiveBytes(200 + seed * 997, seed)));
+    }
+    // matches further back than a 16 bit offset reaches
+    auto far = randomBytes(0x11000, 1);
+    far.insert(far.end(), far.begin(), far.begin() + 256);
+    CHECK(roundTrips(far));
+}
+
+void testCompression()
+{
+    auto data = repetitiveBytes(4096, 3);
+    std::vector<uint8_t> packed(data.size());
+    auto size = lz4Compress(data, packed);
+    CHECK(size != 0);
+    CHECK(size < data.size());
+
+    // incompressible data doesn't fit into less than itself
+    auto noise = randomBytes(1024, 4);
+    std::vector<uint8_t> small(noise.size() - 1);
+    CHECK(lz4Compress(noise, small) == 0);
+}
+
+void testWrongSize()
+{
+    auto data = repetitiveBytes(1024, 5);
+    std::vector<uint8_t> packed(data.size());
+    packed.resize(lz4Compress(data, packed));
+    std::vector<uint8_t> shorter(data.size() - 1);
+    std::vector<uint8_t> longer(data.size() + 1);
+    CHECK(!lz4Decompress(packed, shorter));
+    CHECK(!lz4Decompress(packed, longer));
+}
+
+void testMalformed()
+{
+    std::vector<uint8_t> out(64);
+    CHECK(!lz4Decompress({}, out));
+    // 4 literals, then the offset is cut off
+    CHECK(!lz4Decompress(std::vector<uint8_t>{0x40, 1, 2, 3, 4, 0x01}, out));
+    // offset 0 points at the byte being written
+    CHECK(!lz4Decompress(std::vector<uint8_t>{0x40, 1, 2, 3, 4, 0, 0, 0x00},
+                         out));
+    // offset reaches before output start
+    CHECK(!lz4Decompress(std::vector<uint8_t>{0x40, 1, 2, 3, 4, 5, 0, 0x00},
+                         out));
+    // literal length continues past input end
+    CHECK(!lz4Decompress(std::vector<uint8_t>{0xF0}, out));
+    CHECK(!lz4Decompress(std::vector<uint8_t>{0xF0, 255, 255}, out));
+    // match length continues past input end
+    CHECK(!lz4Decompress(std::vector<uint8_t>{0x4F, 1, 2, 3, 4, 1, 0, 255},
+                         out));
+    // more literals announced than input holds
+    CHECK(!lz4Decompress(std::vector<uint8_t>{0x50, 1, 2, 3, 4}, out));
+
+    // literals and matches overrunning output
+    std::vector<uint8_t> tiny(4);
+    CHECK(!lz4Decompress(std::vector<uint8_t>{0x50, 1, 2, 3, 4, 5}, tiny));
+    CHECK(!lz4Decompress(std::vector<uint8_t>{0x10, 1, 1, 0, 0x00}, tiny));
+    CHECK(!lz4Decompress(
+        std::vector<uint8_t>{0x1F, 1, 1, 0, 255, 255, 255, 255, 0x00}, out));
+
+    // valid block of an overlapping match decodes fine
+    std::vector<uint8_t> run(9);
+    CHECK(lz4Decompress(std::vector<uint8_t>{0x10, 7, 1, 0, 0x00},
+                        std::span{run}.first(5)));
+    CHECK(lz4Decompress(std::vector<uint8_t>{0x14, 7, 1, 0, 0x00}, run));
+    CHECK(run == std::vector<uint8_t>(9, 7));
+}
+
+} // namespace
+
+int main()
+{
+    testRoundTrip();
+    testCompression();
+    testWrongSize();
+    testMalformed();
+    return smp::test::result();
+}
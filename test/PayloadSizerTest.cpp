@@ -0,0 +1,87 @@
+#include "Check.h"
+#include "PayloadSizer.h"
+#include <cstdint>
+
+using smp::PayloadSizer;
+
+namespace {
+
+constexpr uint32_t minPayload = 32;
+constexpr uint32_t maxPayload = 1008;
+constexpr uint32_t overhead = 40;
+
+void testCleanLinkKeepsBiggest()
+{
+    PayloadSizer sizer{minPayload, maxPayload, overhead};
+    CHECK(sizer.payload(0) == maxPayload);
+    for (int i = 0; i < 1000; ++i) {
+        sizer.delivered(maxPayload + overhead);
+        CHECK(sizer.payload(0) == maxPayload);
+        CHECK(sizer.payload(500) == maxPayload);
+    }
+    CHECK(sizer.bitErrorRate() == 0);
+}
+
+void testCorruptionShrinks()
+{
+    PayloadSizer sizer{minPayload, maxPayload, overhead};
+    for (int i = 0; i < 50; ++i) {
+        sizer.delivered(maxPayload + overhead);
+    }
+    // about one frame in three broken
+    for (int i = 0; i < 60; ++i) {
+        if (i % 3) {
+            sizer.delivered(maxPayload + overhead);
+        } else {
+            sizer.failed(maxPayload + overhead);
+        }
+    }
+    CHECK(sizer.bitErrorRate() > 0);
+    auto noisy = sizer.payload(0);
+    CHECK(noisy < maxPayload);
+    CHECK(noisy >= minPayload);
+
+    // round trip paid per frame makes small frames costlier
+    CHECK(sizer.payload(2000) > noisy);
+
+    // every small frame broken too, frames shrink further
+    for (int i = 0; i < 200; ++i) {
+        sizer.failed(minPayload + overhead);
+    }
+    CHECK(sizer.payload(0) < noisy);
+    CHECK(sizer.payload(0) >= minPayload);
+}
+
+// old errors fade out, frames grow back once the line is clean again
+void testRecovers()
+{
+    PayloadSizer sizer{minPayload, maxPayload, overhead};
+    for (int i = 0; i < 20; ++i) {
+        sizer.failed(200 + overhead);
+    }
+    auto noisy = sizer.payload(0);
+    for (int i = 0; i < 400; ++i) {
+        sizer.delivered(noisy + overhead);
+    }
+    CHECK(sizer.payload(0) > noisy);
+    CHECK(sizer.payload(0) == maxPayload);
+}
+
+void testBounds()
+{
+    // min above max is taken as max
+    PayloadSizer sizer{2048, maxPayload, overhead};
+    sizer.failed(100);
+    CHECK(sizer.payload(0) == maxPayload);
+}
+
+} // namespace
+
+int main()
+{
+    testCleanLinkKeepsBiggest();
+    testCorruptionShrinks();
+    testRecovers();
+    testBounds();
+    return smp::test::result();
+}
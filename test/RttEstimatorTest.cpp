@@ -0,0 +1,99 @@
+#include "Check.h"
+#include "RttEstimator.h"
+#include <chrono>
+
+using namespace std::chrono_literals;
+using smp::RttEstimator;
+
+namespace {
+
+bool within(RttEstimator::duration value, RttEstimator::duration low,
+            RttEstimator::duration high)
+{
+    return value >= low && value <= high;
+}
+
+void testInitial()
+{
+    RttEstimator estimate{1000ms, 20ms, 10s};
+    CHECK(estimate.timeout() == 1000ms);
+    CHECK(estimate.smoothed() == 0ms);
+    CHECK(RttEstimator(5ms, 20ms, 10s).timeout() == 20ms);
+    CHECK(RttEstimator(20s, 20ms, 10s).timeout() == 10s);
+}
+
+void testFirstSample()
+{
+    // deviation starts at half the round trip, timeout at three times it
+    RttEstimator estimate{1000ms, 1ms, 10s};
+    estimate.sample(10ms);
+    CHECK(estimate.smoothed() == 10ms);
+    CHECK(estimate.timeout() == 30ms);
+}
+
+// steady device, deviation fades and timeout closes in on the round trip
+void testSteady()
+{
+    RttEstimator estimate{1000ms, 1ms, 10s};
+    for (int i = 0; i < 100; ++i) {
+        estimate.sample(10ms);
+    }
+    CHECK(within(estimate.smoothed(), 9900us, 10100us));
+    // timer granularity is kept above the round trip
+    CHECK(within(estimate.timeout(), 10900us, 11500us));
+
+    RttEstimator floored{1000ms, 20ms, 10s};
+    for (int i = 0; i < 100; ++i) {
+        floored.sample(1ms);
+    }
+    CHECK(floored.timeout() == 20ms);
+}
+
+// jitter keeps timeout above the slower answers
+void testJitter()
+{
+    RttEstimator estimate{1000ms, 1ms, 10s};
+    for (int i = 0; i < 100; ++i) {
+        estimate.sample(i % 2 ? 30ms : 10ms);
+    }
+    CHECK(within(estimate.smoothed(), 15ms, 25ms));
+    CHECK(estimate.timeout() > 30ms);
+
+    // one slow answer raises the timeout at once
+    RttEstimator spiked{1000ms, 1ms, 10s};
+    for (int i = 0; i < 100; ++i) {
+        spiked.sample(10ms);
+    }
+    auto before = spiked.timeout();
+    spiked.sample(50ms);
+    CHECK(spiked.timeout() > before + 30ms);
+}
+
+void testBackOff()
+{
+    RttEstimator estimate{1000ms, 1ms, 3s};
+    estimate.sample(10ms);
+    estimate.backOff();
+    CHECK(estimate.timeout() == 60ms);
+    estimate.backOff();
+    CHECK(estimate.timeout() == 120ms);
+    for (int i = 0; i < 10; ++i) {
+        estimate.backOff();
+    }
+    CHECK(estimate.timeout() == 3s);
+    // next measurement replaces backed off timeout
+    estimate.sample(10ms);
+    CHECK(estimate.timeout() < 100ms);
+}
+
+} // namespace
+
+int main()
+{
+    testInitial();
+    testFirstSample();
+    testSteady();
+    testJitter();
+    testBackOff();
+    return smp::test::result();
+}
@@ -0,0 +1,67 @@
+#include "Check.h"
+#include "Trace.h"
+#include <sstream>
+#include <string>
+
+namespace trace = smp::trace;
+
+namespace {
+
+size_t count(const std::string &text, const std::string &part)
+{
+    size_t found = 0;
+    for (auto at = text.find(part); at != std::string::npos;
+         at = text.find(part, at + part.size())) {
+        found += 1;
+    }
+    return found;
+}
+
+// reopened ports keep their row instead of adding one each time
+void testTracksAreReused()
+{
+    auto port = trace::track("/dev/ttyUSB0");
+    for (int i = 0; i < 1000; ++i) {
+        CHECK(trace::track("/dev/ttyUSB0") == port);
+    }
+    auto other = trace::track("/dev/ttyUSB1");
+    CHECK(other != port);
+    CHECK(trace::track("/dev/ttyUSB1") == other);
+
+    std::ostringstream json;
+    trace::writeChromeJson(json);
+    CHECK(count(json.str(), "\"thread_name\"") == 2);
+}
+
+void testRecordsOnTrack()
+{
+    auto port = trace::track("sim");
+    trace::enable(16);
+    {
+        trace::Span span{"tx", port, "bytes", 8};
+    }
+    trace::instant("retransmit", port);
+    trace::disable();
+    {
+        trace::Span ignored{"rx", port};
+    }
+
+    std::ostringstream json;
+    trace::writeChromeJson(json);
+    auto text = json.str();
+    auto tid = "\"tid\":" + std::to_string(port);
+    CHECK(count(text, "\"name\":\"tx\"") == 1);
+    CHECK(count(text, "\"name\":\"retransmit\"") == 1);
+    CHECK(count(text, "\"name\":\"rx\"") == 0);
+    CHECK(count(text, tid) == 3); // row name and both events
+    CHECK(count(text, "\"bytes\":8") == 1);
+}
+
+} // namespace
+
+int main()
+{
+    testTracksAreReused();
+    testRecordsOnTrack();
+    return smp::test::result();
+}